@@ -0,0 +1,77 @@
+#include "bench.h"
+
+
+static unsigned long long __bench_mix__(unsigned long long *state) {
+    // SplitMix64, independent of `hash.h` so the keys owe nothing to the hash under test.
+    unsigned long long z = (*state += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+
+long long bench_rss() {
+    #if defined(__linux__)
+        FILE *f = fopen("/proc/self/statm", "r");
+        if (f == NULL) return -1;
+        long long size = 0, resident = 0;
+        int n = fscanf(f, "%lld %lld", &size, &resident);
+        fclose(f);
+        return n == 2 ? resident * sysconf(_SC_PAGESIZE) : -1;
+    #else
+        return -1;
+    #endif
+}
+
+
+char **bench_keys(int n, unsigned long long seed) {
+    char **keys = (char **)malloc((size_t)n * (sizeof(char *) + BENCH_KEY_LENGTH));
+    if (keys == NULL) return NULL;
+    char *bytes = (char *)(keys + n);
+    unsigned long long state = seed;
+    for (int i = 0; i < n; i++) {
+        keys[i] = bytes + (size_t)i * BENCH_KEY_LENGTH;
+        // The index keeps the keys distinct, the scrambled part spreads their lengths and prefixes.
+        unsigned long long r = __bench_mix__(&state);
+        snprintf(keys[i], BENCH_KEY_LENGTH, "k%llu-%.*llx-%d", seed, (int)(r & 7) + 1, r >> 8, i);
+    }
+    return keys;
+}
+
+
+void bench_shuffle(char **items, int n, unsigned long long seed) {
+    unsigned long long state = seed ^ 0x5DEECE66DULL;
+    for (int i = n - 1; i > 0; i--) {
+        int j = (int)(__bench_mix__(&state) % (unsigned long long)(i + 1));
+        char *item = items[i];
+        items[i] = items[j];
+        items[j] = item;
+    }
+}
+
+
+static int __bench_compare__(const void *a, const void *b) {
+    long long x = *(const long long *)a, y = *(const long long *)b;
+    return x < y ? -1 : x > y;
+}
+
+
+long long bench_percentile(long long *samples, long long n, double p) {
+    if (n <= 0) return 0;
+    qsort(samples, (size_t)n, sizeof(long long), __bench_compare__);
+    long long index = (long long)(p / 100.0 * (double)n);
+    return samples[index < n ? index : n - 1];
+}
+
+
+int bench_spawn(char *program, char *arguments) {
+    char command[1024];
+    snprintf(command, sizeof(command), "\"%s\" %s", program, arguments);
+    fflush(stdout);
+    return system(command);
+}
+
+
+long long bench_arg(int argc, char *argv[], int index, long long fallback) {
+    return index < argc ? atoll(argv[index]) : fallback;
+}
@@ -0,0 +1,71 @@
+#ifndef _BENCH_H_
+#define _BENCH_H_
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+#include "os.h"
+
+
+#define BENCH_KEY_LENGTH 32     // Bytes reserved for a key from `bench_keys` with the terminating null.
+
+
+/**
+ * @brief Read the resident set size of the process.
+ * @return Bytes (`-1` where `/proc/self/statm` is missing).
+**/
+long long bench_rss();
+
+
+/**
+ * @brief Make `n` distinct string keys of up to 30 characters ("k", the seed, 1 to 8 scrambled hex digits, then the index).
+ * @param n The number of keys.
+ * @param seed The keys of two seeds never overlap.
+ * @return The keys, all in one block released with `free` (`NULL` for failure).
+**/
+char **bench_keys(int n, unsigned long long seed);
+
+
+/**
+ * @brief Put the elements of an array in a random order (the same for the same seed).
+ * @param items The array of pointers.
+ * @param n The number of elements.
+ * @param seed The seed.
+**/
+void bench_shuffle(char **items, int n, unsigned long long seed);
+
+
+/**
+ * @brief Sort samples and read one percentile.
+ * @param samples The samples (sorted in place).
+ * @param n The number of samples.
+ * @param p The percentile (e.g., `99.0`).
+ * @return The sample below which `p` percent of them lie.
+**/
+long long bench_percentile(long long *samples, long long n, double p);
+
+
+/**
+ * @brief Run this benchmark again in a child process and wait for it (so that a case starts from a fresh heap).
+ * @param program `argv[0]` of `main`.
+ * @param arguments The arguments of the child, separated by spaces.
+ * @return The exit status of the child (`0` for success).
+**/
+int bench_spawn(char *program, char *arguments);
+
+
+/**
+ * @brief Read the argument at `index` as a number.
+ * @param argc The argument count of `main`.
+ * @param argv The arguments of `main`.
+ * @param index The position of the argument.
+ * @param fallback The value of a missing argument.
+ * @return The number.
+**/
+long long bench_arg(int argc, char *argv[], int index, long long fallback);
+
+
+#endif
@@ -0,0 +1,66 @@
+#include "bench.h"
+#include "hashmap.h"
+
+
+/**
+ * Loading a HashMap at startup with `malloc` per node and string against `hashmap_create_arena`:
+ * the time to put all pairs, the RSS they add, the time to remove half and put them back (the arena reuses its freelists),
+ * the RSS after that churn, and the time to destroy the map.
+ * Every mode runs in a process of its own so the RSS growth is not blurred by the heap the previous one left behind.
+ * >>> ./bench_arena [n_pairs = 1000000] [mode = all]
+**/
+static const char *MODES[] = {"malloc", "arena"};
+
+
+int __bench_mode__(int arena, int n) {
+    char **keys = bench_keys(n, 1);
+    char **values = bench_keys(n, 2);
+    if (keys == NULL || values == NULL) return 1;
+
+    long long rss = bench_rss();
+    double t0 = os_time();
+    HashMap *dict = arena ? hashmap_create_arena() : hashmap_create();
+    for (int i = 0; i < n; i++) hashmap_put(dict, keys[i], values[i]);
+    double t1 = os_time();
+    long long loaded = bench_rss() - rss;
+
+    for (int i = 0; i < n; i += 2) hashmap_remove(dict, keys[i]);
+    for (int i = 0; i < n; i += 2) hashmap_put(dict, keys[i], values[i]);
+    double t2 = os_time();
+    long long churned = bench_rss() - rss;
+
+    int missing = 0;
+    for (int i = 0; i < n; i++) missing += hashmap_get(dict, keys[i]) == NULL;
+    double t3 = os_time();
+    hashmap_destroy(dict);
+    double t4 = os_time();
+
+    free(keys);
+    free(values);
+    if (missing) {
+        fprintf(stderr, "%s: %d of %d keys missing\n", MODES[arena], missing, n);
+        return 1;
+    }
+    printf("%-8s %10.1f %10.1f %10.1f %10.1f %10.1f\n", MODES[arena],
+        (t1 - t0) * 1e3, rss < 0 ? -1.0 : loaded / 1048576.0, (t2 - t1) * 1e3, rss < 0 ? -1.0 : churned / 1048576.0, (t4 - t3) * 1e3);
+    return 0;
+}
+
+
+int main(int argc, char *argv[]) {
+    int n = (int)bench_arg(argc, argv, 1, 1000000);
+    if (argc > 2) {
+        for (int m = 0; m < 2; m++) if (strcmp(argv[2], MODES[m]) == 0) return __bench_mode__(m, n);
+        fprintf(stderr, "unknown mode %s\n", argv[2]);
+        return 1;
+    }
+
+    printf("%d string pairs, milliseconds and MiB\n", n);
+    printf("%-8s %10s %10s %10s %10s %10s\n", "mode", "load", "RSS", "churn", "RSS after", "destroy");
+    for (int m = 0; m < 2; m++) {
+        char arguments[64];
+        snprintf(arguments, sizeof(arguments), "%d %s", n, MODES[m]);
+        if (bench_spawn(argv[0], arguments) != 0) return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,91 @@
+#include "bench.h"
+#include "thread.h"
+#include "async_log.h"
+
+
+/**
+ * The ring backend of `async_log` (`async_log_init_ring`) at 1 to 32 producer threads, formatting on the caller and deferred:
+ * the messages per second the callers get through, the messages per second until all are written, and the call latency.
+ * Every case runs in a process of its own (the logger is global) and writes `bench_async_log.log` in the working directory,
+ * whose lines are counted before it is removed.
+ * >>> ./bench_async_log [n_messages = 1000000] [ring_bytes = 1048576]
+**/
+#define BENCH_MAX_PRODUCERS 32
+
+
+typedef struct {
+    int id;
+    int n_messages;
+    long long *latency;     // Nanoseconds of every call.
+} _BenchProducer;
+
+
+int __bench_producer__(void *args) {
+    _BenchProducer *producer = (_BenchProducer *)args;
+    for (int i = 0; i < producer->n_messages; i++) {
+        double start = os_time();
+        asynclog_info("producer %d message %d payload %s %.3f", producer->id, i, "abcdefghijklmnop", i * 0.5);
+        producer->latency[i] = (long long)((os_time() - start) * 1e9);
+    }
+    return 0;
+}
+
+
+int __bench_case__(int n_producers, int deferred, int n_messages, int ring) {
+    char *path = "bench_async_log.log";
+    FILE *f = fopen(path, "w");
+    int each = n_messages / n_producers;
+    long long total = (long long)each * n_producers;
+    long long *latency = (long long *)malloc((size_t)total * sizeof(long long));
+    if (f == NULL || latency == NULL || async_log_init_ring(ring) != 0) return 1;
+    async_log_setting(1);
+    async_log_config_write(f);
+    if (deferred) async_log_config_deferred(1);
+
+    Thread threads[BENCH_MAX_PRODUCERS];
+    _BenchProducer producers[BENCH_MAX_PRODUCERS];
+    double start = os_time();
+    for (int i = 0; i < n_producers; i++) {
+        producers[i] = (_BenchProducer){i, each, latency + (long long)i * each};
+        thread_create(&threads[i], __bench_producer__, &producers[i]);
+    }
+    for (int i = 0; i < n_producers; i++) thread_join(&threads[i], NULL);
+    double called = os_time() - start;
+    async_log_exit(1);
+    double written = os_time() - start;
+    fclose(f);
+
+    long long lines = 0;
+    f = fopen(path, "r");
+    for (int c; f && (c = fgetc(f)) != EOF; ) lines += c == '\n';
+    if (f) fclose(f);
+    remove(path);
+    if (lines != total) {
+        fprintf(stderr, "%d producers: %lld of %lld lines written\n", n_producers, lines, total);
+        return 1;
+    }
+    printf("%9d %-9s %10.2f %10.2f %8lld %8lld %8lld\n", n_producers, deferred ? "deferred" : "caller",
+        total / called / 1e6, total / written / 1e6, bench_percentile(latency, total, 50.0),
+        bench_percentile(latency, total, 99.0), bench_percentile(latency, total, 99.9));
+    free(latency);
+    return 0;
+}
+
+
+int main(int argc, char *argv[]) {
+    int n_messages = (int)bench_arg(argc, argv, 1, 1000000);
+    int ring = (int)bench_arg(argc, argv, 2, 1 << 20);
+    if (argc > 4) return __bench_case__((int)bench_arg(argc, argv, 3, 1), (int)bench_arg(argc, argv, 4, 0), n_messages, ring);
+
+    printf("%d messages, %d-byte rings, %d CPUs, million messages per second and call latency in ns\n", n_messages, ring, thread_cpu_count());
+    printf("%9s %-9s %10s %10s %8s %8s %8s\n", "producers", "format", "calls", "written", "p50", "p99", "p99.9");
+    int producers[] = {1, 2, 4, 8, 16, 32};
+    for (int p = 0; p < (int)(sizeof(producers) / sizeof(producers[0])); p++) {
+        for (int deferred = 0; deferred < 2; deferred++) {
+            char arguments[64];
+            snprintf(arguments, sizeof(arguments), "%d %d %d %d", n_messages, ring, producers[p], deferred);
+            if (bench_spawn(argv[0], arguments) != 0) return 1;
+        }
+    }
+    return 0;
+}
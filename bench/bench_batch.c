@@ -0,0 +1,113 @@
+#include "bench.h"
+#include "hashmap.h"
+#include "set.h"
+
+
+/**
+ * The batched `_many` functions (hashed and prefetched `HASHMAP_BATCH` / `SET_BATCH` keys at a time) against a scalar loop:
+ * putting `n` string keys into an empty HashMap and adding them to an empty Set, then `n_queries` random lookups in both.
+ * Every case runs `rounds` times, the best time is reported.
+ * >>> ./bench_batch [n_keys = 2000000] [n_queries = 4000000] [rounds = 3]
+**/
+char **KEYS;
+char **QUERIES;
+char **VALUES;
+int N_KEYS;
+int N_QUERIES;
+
+
+double __bench_hashmap_put__(int batched) {
+    HashMap *dict = hashmap_create();
+    double start = os_time();
+    if (batched) hashmap_put_many(dict, KEYS, KEYS, N_KEYS);
+    else for (int i = 0; i < N_KEYS; i++) hashmap_put(dict, KEYS[i], KEYS[i]);
+    double elapsed = os_time() - start;
+    hashmap_destroy(dict);
+    return elapsed;
+}
+
+
+double __bench_hashmap_get__(HashMap *dict, int batched) {
+    long long found = 0;
+    double start = os_time();
+    if (batched) {
+        hashmap_get_many(dict, QUERIES, VALUES, N_QUERIES);
+        for (int i = 0; i < N_QUERIES; i++) found += VALUES[i] != NULL;
+    } else {
+        for (int i = 0; i < N_QUERIES; i++) found += hashmap_get(dict, QUERIES[i]) != NULL;
+    }
+    double elapsed = os_time() - start;
+    return found == N_QUERIES ? elapsed : -1;
+}
+
+
+double __bench_set_add__(int batched) {
+    Set *set = set_create();
+    double start = os_time();
+    if (batched) set_add_many(set, KEYS, N_KEYS);
+    else for (int i = 0; i < N_KEYS; i++) set_add(set, KEYS[i]);
+    double elapsed = os_time() - start;
+    set_destroy(set);
+    return elapsed;
+}
+
+
+double __bench_set_contains__(Set *set, int batched) {
+    long long found = 0;
+    double start = os_time();
+    if (batched) found = set_contains_many(set, QUERIES, N_QUERIES, NULL);
+    else for (int i = 0; i < N_QUERIES; i++) found += set_contains(set, QUERIES[i]);
+    double elapsed = os_time() - start;
+    return found == N_QUERIES ? elapsed : -1;
+}
+
+
+int main(int argc, char *argv[]) {
+    N_KEYS = (int)bench_arg(argc, argv, 1, 2000000);
+    N_QUERIES = (int)bench_arg(argc, argv, 2, 4000000);
+    int rounds = (int)bench_arg(argc, argv, 3, 3);
+    KEYS = bench_keys(N_KEYS, 1);
+    QUERIES = (char **)malloc((size_t)N_QUERIES * sizeof(char *));
+    VALUES = (char **)malloc((size_t)N_QUERIES * sizeof(char *));
+    if (KEYS == NULL || QUERIES == NULL || VALUES == NULL) return 1;
+    unsigned long long state = 5;
+    for (int i = 0; i < N_QUERIES; i++) {
+        state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+        QUERIES[i] = KEYS[(state >> 33) % (unsigned long long)N_KEYS];
+    }
+
+    HashMap *dict = hashmap_create();
+    Set *set = set_create();
+    for (int i = 0; i < N_KEYS; i++) {
+        hashmap_put(dict, KEYS[i], KEYS[i]);
+        set_add(set, KEYS[i]);
+    }
+
+    char *cases[] = {"HashMap put", "HashMap get", "Set add", "Set contains"};
+    printf("%d keys, %d queries, best of %d rounds, seconds\n", N_KEYS, N_QUERIES, rounds);
+    printf("%-14s %10s %10s %8s\n", "case", "scalar", "batched", "gain");
+    for (int c = 0; c < 4; c++) {
+        double best[2] = {-1, -1};
+        for (int r = 0; r < rounds; r++) {
+            // Alternate which of the two runs first, so neither always meets the warmer cache.
+            for (int j = 0; j < 2; j++) {
+                int batched = (r + j) & 1;
+                double elapsed = c == 0 ? __bench_hashmap_put__(batched) : c == 1 ? __bench_hashmap_get__(dict, batched) :
+                    c == 2 ? __bench_set_add__(batched) : __bench_set_contains__(set, batched);
+                if (elapsed < 0) {
+                    fprintf(stderr, "%s: keys lost\n", cases[c]);
+                    return 1;
+                }
+                if (best[batched] < 0 || elapsed < best[batched]) best[batched] = elapsed;
+            }
+        }
+        printf("%-14s %10.3f %10.3f %7.2fx\n", cases[c], best[0], best[1], best[0] / best[1]);
+    }
+
+    hashmap_destroy(dict);
+    set_destroy(set);
+    free(KEYS);
+    free(QUERIES);
+    free(VALUES);
+    return 0;
+}
@@ -0,0 +1,98 @@
+#include "bench.h"
+#include "thread.h"
+#include "hashmap.h"
+#include "concurrent_hashmap.h"
+
+
+/**
+ * ConcurrentHashMap against a HashMap behind one global `Mutex` at 1 to 64 threads and several read/write mixes.
+ * Both maps hold `n` keys, every thread runs its share of `n_ops` random gets and puts (updates of present keys).
+ * >>> ./bench_concurrent [n_keys = 1000000] [n_ops = 1000000]
+**/
+#define BENCH_MAX_THREADS 64
+
+
+typedef struct {
+    int concurrent;
+    int write_permille;     // Puts per thousand operations.
+    long long n_ops;
+    unsigned long long seed;
+    long long found;
+} _BenchWorker;
+
+
+char **KEYS;
+int N_KEYS;
+HashMap *LOCKED;
+Mutex LOCK;
+ConcurrentHashMap *SHARDED;
+
+
+int __bench_worker__(void *args) {
+    _BenchWorker *worker = (_BenchWorker *)args;
+    unsigned long long state = worker->seed;
+    char buffer[BENCH_KEY_LENGTH];
+    for (long long i = 0; i < worker->n_ops; i++) {
+        state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+        char *key = KEYS[(state >> 33) % (unsigned long long)N_KEYS];
+        int write = (int)((state >> 20) % 1000) < worker->write_permille;
+        if (worker->concurrent) {
+            if (write) concurrent_hashmap_put(SHARDED, key, key);
+            else worker->found += concurrent_hashmap_get(SHARDED, key, buffer, sizeof(buffer)) >= 0;
+        } else {
+            mutex_lock(&LOCK);
+            if (write) hashmap_put(LOCKED, key, key);
+            else worker->found += hashmap_get(LOCKED, key) != NULL;
+            mutex_unlock(&LOCK);
+        }
+    }
+    return 0;
+}
+
+
+int main(int argc, char *argv[]) {
+    N_KEYS = (int)bench_arg(argc, argv, 1, 1000000);
+    long long n_ops = bench_arg(argc, argv, 2, 1000000);
+    KEYS = bench_keys(N_KEYS, 1);
+    LOCKED = hashmap_create();
+    SHARDED = concurrent_hashmap_create(0);
+    if (KEYS == NULL || SHARDED == NULL || mutex_create(&LOCK, 1) != 0) return 1;
+    for (int i = 0; i < N_KEYS; i++) {
+        hashmap_put(LOCKED, KEYS[i], KEYS[i]);
+        concurrent_hashmap_put(SHARDED, KEYS[i], KEYS[i]);
+    }
+
+    int threads[] = {1, 2, 4, 8, 16, 32, 64};
+    int n_counts = (int)(sizeof(threads) / sizeof(threads[0]));
+    int writes[] = {0, 50, 200, 500};
+    printf("%d keys, %lld operations per cell, %d CPUs, million operations per second\n", N_KEYS, n_ops, thread_cpu_count());
+    printf("%-22s", "map, writes");
+    for (int t = 0; t < n_counts; t++) printf(" %7d", threads[t]);
+    printf("\n");
+    for (int w = 0; w < (int)(sizeof(writes) / sizeof(writes[0])); w++) {
+        for (int concurrent = 0; concurrent < 2; concurrent++) {
+            printf("%-17s %3d%%", concurrent ? "ConcurrentHashMap" : "HashMap + Mutex", writes[w] / 10);
+            for (int t = 0; t < n_counts; t++) {
+                Thread handles[BENCH_MAX_THREADS];
+                _BenchWorker workers[BENCH_MAX_THREADS];
+                double start = os_time();
+                for (int i = 0; i < threads[t]; i++) {
+                    workers[i] = (_BenchWorker){concurrent, writes[w], n_ops / threads[t], (unsigned long long)i * 7919 + 1, 0};
+                    thread_create(&handles[i], __bench_worker__, &workers[i]);
+                }
+                for (int i = 0; i < threads[t]; i++) thread_join(&handles[i], NULL);
+                double elapsed = os_time() - start;
+                long long done = n_ops / threads[t] * threads[t];
+                printf(" %7.2f", done / elapsed / 1e6);
+                fflush(stdout);
+            }
+            printf("\n");
+        }
+    }
+
+    concurrent_hashmap_destroy(SHARDED);
+    hashmap_destroy(LOCKED);
+    mutex_destroy(&LOCK);
+    free(KEYS);
+    return 0;
+}
@@ -0,0 +1,75 @@
+#include "bench.h"
+#include "atomic.h"
+#include "threadpool.h"
+
+
+/**
+ * Ping-pong dispatch latency of a one-worker ThreadPool: the time from `threadpool_add` to the start of the task,
+ * the submitter waiting for every task to finish (then for `gap` microseconds) before it adds the next.
+ * An idle worker polls with `atomic_pause`, then with `thread_yield`, then parks (`threadpool_config_wait`):
+ * the default polling, parking at once, and polling long enough to outlast the gap are compared.
+ * >>> ./bench_dispatch [n_rounds = 20000] [gap_us = 0 and 500]
+**/
+typedef struct {
+    char *name;
+    double spin;    // Seconds, `-1` for the default of the pool.
+    double yield;
+} _BenchWait;
+
+
+static const _BenchWait WAITS[] = {
+    {"default", -1, -1},
+    {"park", 0, 0},
+    {"yield 1ms", 0, 1e-3},
+    {"spin 1ms", 1e-3, 0},
+};
+
+
+double SUBMITTED;
+double STARTED;
+int DONE;
+
+
+void __bench_ping__(void *args) {
+    (void)args;
+    STARTED = os_time();
+    atomic_set(&DONE, 1);
+}
+
+
+int main(int argc, char *argv[]) {
+    int n_rounds = (int)bench_arg(argc, argv, 1, 20000);
+    int gaps[] = {0, 500};
+    int n_gaps = 2;
+    if (argc > 2) {
+        gaps[0] = (int)bench_arg(argc, argv, 2, 0);
+        n_gaps = 1;
+    }
+    long long *latency = (long long *)malloc((size_t)n_rounds * sizeof(long long));
+    if (latency == NULL) return 1;
+
+    printf("%d rounds, %d CPUs, dispatch-to-start latency in ns\n", n_rounds, thread_cpu_count());
+    printf("%-10s %7s %8s %8s %8s %8s\n", "wait", "gap us", "p50", "p90", "p99", "p99.9");
+    for (int g = 0; g < n_gaps; g++) {
+        for (int w = 0; w < (int)(sizeof(WAITS) / sizeof(WAITS[0])); w++) {
+            ThreadPool *pool = threadpool_create(1, 64);
+            if (pool == NULL) return 1;
+            if (WAITS[w].spin >= 0) threadpool_config_wait(pool, WAITS[w].spin, WAITS[w].yield);
+            for (int r = 0; r < n_rounds; r++) {
+                atomic_set(&DONE, 0);
+                SUBMITTED = os_time();
+                threadpool_add(pool, __bench_ping__, NULL, 1, NULL);
+                // Yielding leaves a single CPU to the worker.
+                while (!atomic_get(&DONE)) thread_yield();
+                latency[r] = (long long)((STARTED - SUBMITTED) * 1e9);
+                if (gaps[g] > 0) os_sleep(gaps[g] / 1e6);
+            }
+            threadpool_destroy(pool, 1);
+            printf("%-10s %7d %8lld %8lld %8lld %8lld\n", WAITS[w].name, gaps[g], bench_percentile(latency, n_rounds, 50.0),
+                bench_percentile(latency, n_rounds, 90.0), bench_percentile(latency, n_rounds, 99.0), bench_percentile(latency, n_rounds, 99.9));
+            fflush(stdout);
+        }
+    }
+    free(latency);
+    return 0;
+}
@@ -0,0 +1,98 @@
+#include "bench.h"
+#include "hashmap.h"
+#include "flatmap.h"
+
+
+/**
+ * FlatMap (open addressing, 16-slot control-byte groups) against the chained HashMap on the same string keys:
+ * insert all, look all up in another order, look up as many absent keys, remove half, then destroy the rest.
+ * Every map runs in a process of its own so the RSS growth is not blurred by the heap the previous one left behind.
+ * >>> ./bench_flatmap [n_keys = 1000000] [map = all]
+**/
+typedef struct {
+    char *name;
+    void *(*create)();
+    void (*put)(void *dict, char *key, char *value);
+    char *(*get)(void *dict, char *key);
+    int (*remove)(void *dict, char *key);
+    void (*destroy)(void *dict);
+} _BenchMap;
+
+
+static void *__hashmap_create__() { return hashmap_create(); }
+static void __hashmap_put__(void *dict, char *key, char *value) { hashmap_put((HashMap *)dict, key, value); }
+static char *__hashmap_get__(void *dict, char *key) { return hashmap_get((HashMap *)dict, key); }
+static int __hashmap_remove__(void *dict, char *key) { return hashmap_remove((HashMap *)dict, key); }
+static void __hashmap_destroy__(void *dict) { hashmap_destroy((HashMap *)dict); }
+
+static void *__flatmap_create__() { return flatmap_create(); }
+static void __flatmap_put__(void *dict, char *key, char *value) { flatmap_put((FlatMap *)dict, key, value); }
+static char *__flatmap_get__(void *dict, char *key) { return flatmap_get((FlatMap *)dict, key); }
+static int __flatmap_remove__(void *dict, char *key) { return flatmap_remove((FlatMap *)dict, key); }
+static void __flatmap_destroy__(void *dict) { flatmap_destroy((FlatMap *)dict); }
+
+
+static const _BenchMap MAPS[] = {
+    {"HashMap", __hashmap_create__, __hashmap_put__, __hashmap_get__, __hashmap_remove__, __hashmap_destroy__},
+    {"FlatMap", __flatmap_create__, __flatmap_put__, __flatmap_get__, __flatmap_remove__, __flatmap_destroy__},
+};
+
+
+int __bench_map__(const _BenchMap *map, int n) {
+    char **keys = bench_keys(n, 1);
+    char **absent = bench_keys(n, 2);
+    char **order = (char **)malloc((size_t)n * sizeof(char *));
+    if (keys == NULL || absent == NULL || order == NULL) return 1;
+    memcpy(order, keys, (size_t)n * sizeof(char *));
+    bench_shuffle(order, n, 3);
+
+    long long rss = bench_rss();
+    double t0 = os_time();
+    void *dict = map->create();
+    for (int i = 0; i < n; i++) map->put(dict, keys[i], keys[i]);
+    double t1 = os_time();
+    long long grown = bench_rss() - rss;
+
+    long long found = 0;
+    for (int i = 0; i < n; i++) found += map->get(dict, order[i]) != NULL;
+    double t2 = os_time();
+    for (int i = 0; i < n; i++) found -= map->get(dict, absent[i]) != NULL;
+    double t3 = os_time();
+    for (int i = 0; i < n; i += 2) map->remove(dict, order[i]);
+    double t4 = os_time();
+    map->destroy(dict);
+    double t5 = os_time();
+
+    free(keys);
+    free(absent);
+    free(order);
+    if (found != n) {
+        fprintf(stderr, "%s: %lld of %d keys found\n", map->name, found, n);
+        return 1;
+    }
+    int half = n / 2;
+    printf("%-8s %8.1f %8.1f %8.1f %8.1f %8.1f %10.1f\n", map->name,
+        (t1 - t0) * 1e9 / n, (t2 - t1) * 1e9 / n, (t3 - t2) * 1e9 / n, (t4 - t3) * 1e9 / (n - half), (t5 - t4) * 1e9 / (half > 0 ? half : 1),
+        rss < 0 ? -1.0 : grown / 1048576.0);
+    return 0;
+}
+
+
+int main(int argc, char *argv[]) {
+    int n = (int)bench_arg(argc, argv, 1, 1000000);
+    int n_maps = (int)(sizeof(MAPS) / sizeof(MAPS[0]));
+    if (argc > 2) {
+        for (int m = 0; m < n_maps; m++) if (strcmp(argv[2], MAPS[m].name) == 0) return __bench_map__(&MAPS[m], n);
+        fprintf(stderr, "unknown map %s\n", argv[2]);
+        return 1;
+    }
+
+    printf("%d string keys, ns per operation (destroy: per key left)\n", n);
+    printf("%-8s %8s %8s %8s %8s %8s %10s\n", "map", "put", "get", "miss", "remove", "destroy", "RSS MiB");
+    for (int m = 0; m < n_maps; m++) {
+        char arguments[64];
+        snprintf(arguments, sizeof(arguments), "%d %s", n, MAPS[m].name);
+        if (bench_spawn(argv[0], arguments) != 0) return 1;
+    }
+    return 0;
+}
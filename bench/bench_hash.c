@@ -0,0 +1,145 @@
+#include "bench.h"
+#include "hash.h"
+
+
+/**
+ * The shared word-at-a-time hash against the ELF hash (HashMap, reduced with `%`) and FNV-1a (Set) it replaced.
+ * Distribution: `n` keys of a family into a power-of-two table of at least `n` buckets, the probes a hit costs on average
+ * (the sum of the squared bucket sizes over `n`) relative to an ideal random hash, and the longest bucket.
+ * Throughput: nanoseconds per hash and bytes per nanosecond for keys of a fixed length.
+ * >>> ./bench_hash [n_keys = 1000000]
+**/
+typedef struct {
+    char *name;
+    unsigned long long (*hash)(const char *key, int length, unsigned long long size);
+} _BenchHash;
+
+
+unsigned long long __hash_elf__(const char *key, int length, unsigned long long size) {
+    // As `__hash_function_ELF__` was, the table size need not be a power of two.
+    (void)length;
+    unsigned int hash = 0;
+    unsigned int x = 0;
+    while (*key) {
+        hash = (hash << 4) + *(key++);
+        if ((x = hash & 0xF0000000L) != 0) hash = hash ^ (x >> 24);
+        hash = hash & (~x);
+    }
+    return hash % size;
+}
+
+
+unsigned long long __hash_fnv__(const char *key, int length, unsigned long long size) {
+    // As `__hash_fnv_1a__` was.
+    unsigned int hash = 2166136261U;
+    for (int i = 0; i < length; i++) hash = (hash ^ (unsigned char)key[i]) * 16777619U;
+    return hash & (size - 1);
+}
+
+
+unsigned long long __hash_shared_string__(const char *key, int length, unsigned long long size) {
+    (void)length;
+    return hash_string(key) & (size - 1);
+}
+
+
+unsigned long long __hash_shared_bytes__(const char *key, int length, unsigned long long size) {
+    return hash_bytes(key, (unsigned long long)length, 0) & (size - 1);
+}
+
+
+static const _BenchHash HASHES[] = {
+    {"ELF %", __hash_elf__},
+    {"FNV-1a", __hash_fnv__},
+    {"hash_string", __hash_shared_string__},
+    {"hash_bytes", __hash_shared_bytes__},
+};
+#define N_HASHES ((int)(sizeof(HASHES) / sizeof(HASHES[0])))
+
+
+volatile unsigned long long SINK;    // Keeps the hashes of the throughput loop from being optimized away.
+
+
+void __bench_distribution__(char *family, char **keys, int n) {
+    unsigned long long size = 1;
+    while (size < (unsigned long long)n) size <<= 1;
+    unsigned int *buckets = (unsigned int *)malloc(size * sizeof(unsigned int));
+    if (buckets == NULL) return;
+    // A random hash puts a key among `1 + (n - 1) / size` others on average.
+    double ideal = 1.0 + (double)(n - 1) / (double)size;
+    printf("%-12s", family);
+    for (int h = 0; h < N_HASHES; h++) {
+        memset(buckets, 0, size * sizeof(unsigned int));
+        for (int i = 0; i < n; i++) buckets[HASHES[h].hash(keys[i], (int)strlen(keys[i]), size)]++;
+        double probes = 0;
+        unsigned int longest = 0;
+        for (unsigned long long b = 0; b < size; b++) {
+            probes += (double)buckets[b] * buckets[b];
+            if (buckets[b] > longest) longest = buckets[b];
+        }
+        printf(" %9.2f %5u", probes / n / ideal, longest);
+    }
+    printf("\n");
+    free(buckets);
+}
+
+
+void __bench_throughput__(int length) {
+    // Enough distinct keys to leave the L1 cache, none containing a `'\0'`.
+    int n_keys = 4096;
+    char *keys = (char *)malloc((size_t)n_keys * (length + 1));
+    if (keys == NULL) return;
+    unsigned long long state = 7;
+    for (long long i = 0; i < (long long)n_keys * (length + 1); i++) {
+        state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+        keys[i] = (char)('!' + (state >> 33) % 94);
+    }
+    for (int k = 0; k < n_keys; k++) keys[(long long)k * (length + 1) + length] = '\0';
+
+    long long rounds = 64LL * 1024 * 1024 / (length + 16);
+    printf("%-12d", length);
+    for (int h = 0; h < N_HASHES; h++) {
+        unsigned long long sink = 0;
+        double start = os_time();
+        for (long long r = 0; r < rounds; r++) sink += HASHES[h].hash(keys + (r & (n_keys - 1)) * (length + 1), length, 1ULL << 32);
+        double elapsed = os_time() - start;
+        SINK = sink;
+        printf(" %9.2f %5.2f", elapsed * 1e9 / rounds, (double)length * rounds / (elapsed * 1e9));
+    }
+    printf("\n");
+    free(keys);
+}
+
+
+int main(int argc, char *argv[]) {
+    int n = (int)bench_arg(argc, argv, 1, 1000000);
+    char **keys = (char **)malloc((size_t)n * (sizeof(char *) + BENCH_KEY_LENGTH));
+    if (keys == NULL) return 1;
+    char *bytes = (char *)(keys + n);
+    for (int i = 0; i < n; i++) keys[i] = bytes + (size_t)i * BENCH_KEY_LENGTH;
+
+    printf("Distribution of %d keys: probes per hit relative to a random hash, longest bucket\n", n);
+    printf("%-12s", "keys");
+    for (int h = 0; h < N_HASHES; h++) printf(" %15s", HASHES[h].name);
+    printf("\n");
+    for (int i = 0; i < n; i++) snprintf(keys[i], BENCH_KEY_LENGTH, "%d", i);
+    __bench_distribution__("decimal", keys, n);
+    for (int i = 0; i < n; i++) snprintf(keys[i], BENCH_KEY_LENGTH, "user:%08d", i);
+    __bench_distribution__("user:%08d", keys, n);
+    for (int i = 0; i < n; i++) snprintf(keys[i], BENCH_KEY_LENGTH, "%d.%d.%d.%d", 10, (i >> 16) & 255, (i >> 8) & 255, i & 255);
+    __bench_distribution__("IPv4", keys, n);
+    char **mixed = bench_keys(n, 1);
+    if (mixed == NULL) return 1;
+    __bench_distribution__("mixed", mixed, n);
+    free(mixed);
+
+    printf("\nThroughput: ns per hash, bytes per ns\n");
+    printf("%-12s", "length");
+    for (int h = 0; h < N_HASHES; h++) printf(" %15s", HASHES[h].name);
+    printf("\n");
+    int lengths[] = {4, 8, 16, 32, 64, 256, 4096};
+    for (int l = 0; l < (int)(sizeof(lengths) / sizeof(lengths[0])); l++) __bench_throughput__(lengths[l]);
+
+    free(keys);
+    return 0;
+}
@@ -0,0 +1,124 @@
+#include "bench.h"
+#include "atomic.h"
+#include "threadpool.h"
+
+
+/**
+ * Recursive task trees on a ThreadPool with the shared queue against `threadpool_config_stealing`, at 1 to 8 workers:
+ * fib (every call above the cutoff adds its two halves as tasks) and quicksort (every partition adds its two sides).
+ * The cutoffs keep a tree well below the queue capacity, a worker adding to a full queue would wait for itself.
+ * >>> ./bench_stealing [fib_n = 38] [sort_n = 4000000]
+**/
+#define BENCH_FIB_CUTOFF 20     // Calls below compute serially.
+#define BENCH_SORT_CUTOFF 4096  // Ranges below sort serially.
+
+
+typedef struct {
+    int *items;
+    long long n;
+} _BenchRange;
+
+
+ThreadPool *POOL;
+long long FIB_SUM;
+long long N_TASKS;
+
+
+long long __bench_fib__(int n) {
+    return n < 2 ? n : __bench_fib__(n - 1) + __bench_fib__(n - 2);
+}
+
+
+void __bench_fib_task__(void *args) {
+    int n = (int)(long long)args;
+    atomic_add(&N_TASKS, 1);
+    if (n < BENCH_FIB_CUTOFF) {
+        atomic_add(&FIB_SUM, __bench_fib__(n));
+        return;
+    }
+    threadpool_add(POOL, __bench_fib_task__, (void *)(long long)(n - 1), 1, NULL);
+    threadpool_add(POOL, __bench_fib_task__, (void *)(long long)(n - 2), 1, NULL);
+}
+
+
+static int __bench_compare__(const void *a, const void *b) {
+    int x = *(const int *)a, y = *(const int *)b;
+    return x < y ? -1 : x > y;
+}
+
+
+void __bench_sort_task__(void *args) {
+    _BenchRange *range = (_BenchRange *)args;
+    int *items = range->items;
+    long long n = range->n;
+    atomic_add(&N_TASKS, 1);
+    if (n < BENCH_SORT_CUTOFF) {
+        qsort(items, (size_t)n, sizeof(int), __bench_compare__);
+        return;
+    }
+    // Hoare partition around the middle item.
+    int pivot = items[n / 2];
+    long long i = -1, j = n;
+    for (;;) {
+        do i++; while (items[i] < pivot);
+        do j--; while (items[j] > pivot);
+        if (i >= j) break;
+        int item = items[i];
+        items[i] = items[j];
+        items[j] = item;
+    }
+    _BenchRange *left = (_BenchRange *)malloc(sizeof(_BenchRange));
+    _BenchRange *right = (_BenchRange *)malloc(sizeof(_BenchRange));
+    *left = (_BenchRange){items, j + 1};
+    *right = (_BenchRange){items + j + 1, n - j - 1};
+    threadpool_add(POOL, __bench_sort_task__, left, 1, free);
+    threadpool_add(POOL, __bench_sort_task__, right, 1, free);
+}
+
+
+int main(int argc, char *argv[]) {
+    int fib_n = (int)bench_arg(argc, argv, 1, 38);
+    long long sort_n = bench_arg(argc, argv, 2, 4000000);
+    int *items = (int *)malloc((size_t)sort_n * sizeof(int));
+    if (items == NULL) return 1;
+
+    int workers[] = {1, 2, 4, 8};
+    printf("fib(%d) cut at %d, quicksort of %lld ints cut at %d, %d CPUs, seconds\n", fib_n, BENCH_FIB_CUTOFF, sort_n, BENCH_SORT_CUTOFF, thread_cpu_count());
+    printf("%-6s %-9s %8s %8s %10s\n", "tree", "queue", "workers", "seconds", "tasks");
+    for (int tree = 0; tree < 2; tree++) {
+        for (int stealing = 0; stealing < 2; stealing++) {
+            for (int w = 0; w < (int)(sizeof(workers) / sizeof(workers[0])); w++) {
+                POOL = threadpool_create(workers[w], 1 << 16);
+                if (POOL == NULL || threadpool_config_stealing(POOL, stealing) != 0) return 1;
+                unsigned long long state = 11;
+                for (long long i = 0; i < sort_n; i++) {
+                    state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+                    items[i] = (int)(state >> 33);
+                }
+                FIB_SUM = 0;
+                N_TASKS = 0;
+                _BenchRange *range = (_BenchRange *)malloc(sizeof(_BenchRange));
+                *range = (_BenchRange){items, sort_n};
+
+                double start = os_time();
+                if (tree == 0) threadpool_add(POOL, __bench_fib_task__, (void *)(long long)fib_n, 1, NULL);
+                else threadpool_add(POOL, __bench_sort_task__, range, 1, free);
+                threadpool_wait(POOL);
+                double elapsed = os_time() - start;
+                threadpool_destroy(POOL, 1);
+                if (tree == 0) free(range);
+
+                int valid = tree == 0 ? FIB_SUM == __bench_fib__(fib_n) : 1;
+                for (long long i = 1; tree == 1 && i < sort_n; i++) valid &= items[i - 1] <= items[i];
+                if (!valid) {
+                    fprintf(stderr, "%s with %d workers: wrong result\n", tree == 0 ? "fib" : "sort", workers[w]);
+                    return 1;
+                }
+                printf("%-6s %-9s %8d %8.3f %10lld\n", tree == 0 ? "fib" : "sort", stealing ? "stealing" : "shared", workers[w], elapsed, N_TASKS);
+                fflush(stdout);
+            }
+        }
+    }
+    free(items);
+    return 0;
+}
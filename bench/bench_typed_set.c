@@ -0,0 +1,91 @@
+#include "bench.h"
+#include "set.h"
+
+
+/**
+ * The typed sets (`IntSet` with SIMD-probed integer slots, `StrSet`) against the mixed-type `Set` holding the same values:
+ * add `n` values, look all up in another order, look up as many absent values, then destroy.
+ * Every set runs in a process of its own so the RSS growth is not blurred by the heap the previous one left behind.
+ * >>> ./bench_typed_set [n_values = 1000000] [set = all]
+**/
+static const char *SETS[] = {"Set<int>", "IntSet", "Set<char*>", "StrSet"};
+#define N_SETS ((int)(sizeof(SETS) / sizeof(SETS[0])))
+
+
+int __bench_set__(int kind, int n) {
+    // Scrambled integers, the absent ones differ in the lowest bit.
+    int *values = (int *)malloc((size_t)n * 2 * sizeof(int));
+    char **keys = bench_keys(n, 1);
+    char **absent = bench_keys(n, 2);
+    if (values == NULL || keys == NULL || absent == NULL) return 1;
+    int *order = values + n;
+    for (int i = 0; i < n; i++) values[i] = (int)((unsigned int)i * 2654435761U) & ~1;
+    for (int i = 0; i < n; i++) order[i] = values[(int)(((unsigned long long)i * 48271) % (unsigned long long)n)];
+
+    Set *set = NULL;
+    IntSet *ints = NULL;
+    StrSet *strs = NULL;
+    long long rss = bench_rss();
+    double t0 = os_time();
+    if (kind == 0) {
+        set = set_create();
+        for (int i = 0; i < n; i++) set_add(set, values[i]);
+    } else if (kind == 1) {
+        ints = intset_create();
+        for (int i = 0; i < n; i++) set_add(ints, values[i]);
+    } else if (kind == 2) {
+        set = set_create();
+        for (int i = 0; i < n; i++) set_add(set, keys[i]);
+    } else {
+        strs = strset_create();
+        for (int i = 0; i < n; i++) set_add(strs, keys[i]);
+    }
+    double t1 = os_time();
+    long long grown = bench_rss() - rss;
+
+    long long found = 0;
+    if (kind == 0) for (int i = 0; i < n; i++) found += set_contains(set, order[i]);
+    if (kind == 1) for (int i = 0; i < n; i++) found += set_contains(ints, order[i]);
+    if (kind == 2) for (int i = 0; i < n; i++) found += set_contains(set, keys[n - 1 - i]);
+    if (kind == 3) for (int i = 0; i < n; i++) found += set_contains(strs, keys[n - 1 - i]);
+    double t2 = os_time();
+    if (kind == 0) for (int i = 0; i < n; i++) found -= set_contains(set, order[i] | 1);
+    if (kind == 1) for (int i = 0; i < n; i++) found -= set_contains(ints, order[i] | 1);
+    if (kind == 2) for (int i = 0; i < n; i++) found -= set_contains(set, absent[i]);
+    if (kind == 3) for (int i = 0; i < n; i++) found -= set_contains(strs, absent[i]);
+    double t3 = os_time();
+    if (set) set_destroy(set);
+    if (ints) intset_destroy(ints);
+    if (strs) strset_destroy(strs);
+    double t4 = os_time();
+
+    free(values);
+    free(keys);
+    free(absent);
+    if (found != n) {
+        fprintf(stderr, "%s: %lld of %d values found\n", SETS[kind], found, n);
+        return 1;
+    }
+    printf("%-11s %8.1f %8.1f %8.1f %8.1f %10.1f\n", SETS[kind],
+        (t1 - t0) * 1e9 / n, (t2 - t1) * 1e9 / n, (t3 - t2) * 1e9 / n, (t4 - t3) * 1e9 / n, rss < 0 ? -1.0 : grown / 1048576.0);
+    return 0;
+}
+
+
+int main(int argc, char *argv[]) {
+    int n = (int)bench_arg(argc, argv, 1, 1000000);
+    if (argc > 2) {
+        for (int s = 0; s < N_SETS; s++) if (strcmp(argv[2], SETS[s]) == 0) return __bench_set__(s, n);
+        fprintf(stderr, "unknown set %s\n", argv[2]);
+        return 1;
+    }
+
+    printf("%d values, ns per operation\n", n);
+    printf("%-11s %8s %8s %8s %8s %10s\n", "set", "add", "hit", "miss", "destroy", "RSS MiB");
+    for (int s = 0; s < N_SETS; s++) {
+        char arguments[64];
+        snprintf(arguments, sizeof(arguments), "%d \"%s\"", n, SETS[s]);
+        if (bench_spawn(argv[0], arguments) != 0) return 1;
+    }
+    return 0;
+}
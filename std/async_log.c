@@ -1,4 +1,5 @@
 #include "async_log.h"
+#include "log_sink.h"
 
 
 const char *TIPS[6] = {"TRACE", "DEBUG", "INFO", "WARNING", "ERROR", "FATAL"};
@@ -9,14 +10,52 @@ struct {
     void *ctx;
     int level;
     int mode;
+    int precision;
     _LogLockFunc lock;
     _LogCallback callback[ASYNC_LOG_MAX_CALLBACKS];
     ThreadPool *pool;
     _AsyncLogTask array[ASYNC_LOG_MAX_THREAD_POOL_SIZE];
     _AsyncLogTask *linklist;
+    _AsyncLogRing *rings[ASYNC_LOG_MAX_RINGS];
+    int n_rings;
+    long long ring_capacity;
+    int generation;     // Bumped by `async_log_init_ring`, the rings cached by the threads belong to one generation.
+    int running;    // `1` while the writer thread runs.
+    int stop;       // `1` to drain the rings and stop the writer thread, `2` to stop it at once.
+    int idle;       // `1` while the writer thread sleeps on `wakeup`.
+    Mutex ring_lock;    // Taken to register a ring and to switch the binary file.
+    #if defined(__OS_UNIX__)
+        pthread_key_t ring_key;     // Calls `__async_log_ring_retire__` when a thread with a ring exits.
+    #elif defined(__OS_WINDOWS__)
+        DWORD ring_key;
+    #endif
+    int ring_key_ready;     // `1` once `ring_key` is created (never deleted), rings are not reclaimed without it.
+    ThreadEvent wakeup;
+    Thread writer;
+    _AsyncLogRecord **batch;    // The records of the current batch in time order (writer thread only).
+    char *text;     // The formatted text of the current batch (writer thread only).
+    long long epoch;    // The wall clock minus the monotonic clock, in nanoseconds.
+    int sinks;      // `1` once a batch went to a sink, the idle writer thread polls the sinks from then on (writer thread only).
+    int deferred;   // `1` to leave the formatting to the writer thread.
+    char message[ASYNC_LOG_MAX_MESSAGE_LENGTH];     // The last deferred message formatted (writer thread only).
+    FILE *binary;   // Writer thread only.
+    FILE *binary_pending;   // The file of the last `async_log_config_binary`, taken over by the writer thread.
+    int binary_request;     // Bumped by `async_log_config_binary`.
+    int binary_done;    // The last request the writer thread carried out.
+    int binary_length;  // Bytes of `text` not written to `binary` yet.
+    const char **strings;   // The format strings and file names written to `binary` (open addressing by address).
+    unsigned int *ids;
+    unsigned int n_strings;
+    unsigned int strings_capacity;
 } _LogLock;
 
 
+#if defined(ASYNC_LOG_TLS)
+    static ASYNC_LOG_TLS _AsyncLogRing *__async_log_current__ = NULL;
+    static ASYNC_LOG_TLS int __async_log_generation__ = 0;
+#endif
+
+
 void async_log_init(int n_workers, int queue_capacity) {
     _LogLock.pool = threadpool_create(n_workers, queue_capacity);
     for (int i = 0; i < ASYNC_LOG_MAX_THREAD_POOL_SIZE - 1; i++) _LogLock.array[i].next = &_LogLock.array[i + 1];
@@ -25,11 +64,205 @@ void async_log_init(int n_workers, int queue_capacity) {
 }
 
 
+int async_log_init_ring(int capacity) {
+    if (capacity <= 0 || _LogLock.running) return 1;
+    // At least a few of the longest records fit in a ring.
+    long long size = 4096;
+    while (size < capacity) size = size << 1;
+
+    _LogLock.batch = (_AsyncLogRecord **)malloc(ASYNC_LOG_BATCH * sizeof(_AsyncLogRecord *));
+    _LogLock.text = (char *)malloc(ASYNC_LOG_BATCH_SIZE);
+    if (!_LogLock.batch || !_LogLock.text) {
+        free(_LogLock.batch);
+        free(_LogLock.text);
+        return 1;
+    }
+    if (mutex_create(&_LogLock.ring_lock, 1) != 0) {
+        free(_LogLock.batch);
+        free(_LogLock.text);
+        return 1;
+    }
+    if (event_init(&_LogLock.wakeup) != 0) {
+        mutex_destroy(&_LogLock.ring_lock);
+        free(_LogLock.batch);
+        free(_LogLock.text);
+        return 1;
+    }
+
+    if (!_LogLock.ring_key_ready) {
+        #if defined(__OS_UNIX__)
+            _LogLock.ring_key_ready = pthread_key_create(&_LogLock.ring_key, __async_log_ring_retire__) == 0;
+        #elif defined(__OS_WINDOWS__)
+            _LogLock.ring_key = FlsAlloc(__async_log_ring_retire_win32__);
+            _LogLock.ring_key_ready = _LogLock.ring_key != FLS_OUT_OF_INDEXES;
+        #endif
+    }
+
+    _LogLock.ring_capacity = size;
+    _LogLock.epoch = log_time_now(LOG_TIME_MICROSECOND) - __async_log_clock__();
+    _LogLock.n_rings = 0;
+    _LogLock.stop = 0;
+    _LogLock.idle = 0;
+    _LogLock.generation++;
+    if (thread_create(&_LogLock.writer, __async_log_writer__, NULL) != 0) {
+        event_destroy(&_LogLock.wakeup);
+        mutex_destroy(&_LogLock.ring_lock);
+        free(_LogLock.batch);
+        free(_LogLock.text);
+        return 1;
+    }
+    atomic_set(&_LogLock.running, 1);
+    return 0;
+}
+
+
 void async_log_exit(int safe_exit) {
+    if (_LogLock.running) {
+        atomic_set(&_LogLock.running, 0);
+        atomic_set(&_LogLock.stop, safe_exit ? 1 : 2);
+        event_set(&_LogLock.wakeup);
+        thread_join(&_LogLock.writer, NULL);
+        for (int i = 0; i < _LogLock.n_rings; i++) {
+            free(_LogLock.rings[i]->buffer);
+            free(_LogLock.rings[i]);
+        }
+        _LogLock.n_rings = 0;
+        _LogLock.sinks = 0;
+        _LogLock.deferred = 0;
+        _LogLock.binary = NULL;
+        _LogLock.binary_pending = NULL;
+        free(_LogLock.strings);
+        free(_LogLock.ids);
+        _LogLock.strings = NULL;
+        _LogLock.ids = NULL;
+        _LogLock.n_strings = 0;
+        _LogLock.strings_capacity = 0;
+        event_destroy(&_LogLock.wakeup);
+        mutex_destroy(&_LogLock.ring_lock);
+        free(_LogLock.batch);
+        free(_LogLock.text);
+        return;
+    }
     threadpool_destroy(_LogLock.pool, safe_exit); 
 }
 
 
+int async_log_config_deferred(int enable) {
+    if (!_LogLock.running) return 1;
+    atomic_set(&_LogLock.deferred, enable ? 1 : 0);
+    return 0;
+}
+
+
+int async_log_config_binary(FILE *f) {
+    if (!atomic_get(&_LogLock.running)) return 1;
+    // The files, the string table and the staging buffer belong to the writer thread, it makes the switch and acknowledges it.
+    mutex_lock(&_LogLock.ring_lock);
+    _LogLock.binary_pending = f;
+    int request = atomic_get(&_LogLock.binary_request) + 1;
+    atomic_set(&_LogLock.binary_request, request);
+    event_set(&_LogLock.wakeup);
+    while (atomic_get(&_LogLock.binary_done) != request && atomic_get(&_LogLock.running)) thread_yield();
+    mutex_unlock(&_LogLock.ring_lock);
+    return 0;
+}
+
+
+int async_log_decode(FILE *in, FILE *out) {
+    char magic[4];
+    unsigned int version;
+    unsigned int order;
+    unsigned char sizes[8];
+    unsigned char expected[8] = {sizeof(long), sizeof(long long), sizeof(intmax_t), sizeof(size_t), sizeof(ptrdiff_t), sizeof(double), sizeof(long double), sizeof(void *)};
+    if (fread(magic, 1, 4, in) != 4 || memcmp(magic, "ALOG", 4) != 0) return 1;
+    if (fread(&version, sizeof(version), 1, in) != 1 || version != ASYNC_LOG_BINARY_VERSION) return 1;
+    if (fread(&order, sizeof(order), 1, in) != 1 || order != 0x01020304) return 1;
+    if (fread(sizes, 1, sizeof(sizes), in) != sizeof(sizes) || memcmp(sizes, expected, sizeof(sizes)) != 0) return 1;
+
+    char **strings = NULL;
+    unsigned int n_strings = 0;
+    char payload[ASYNC_LOG_MAX_MESSAGE_LENGTH + 1];
+    char message[ASYNC_LOG_MAX_MESSAGE_LENGTH];
+    char line[ASYNC_LOG_MAX_MESSAGE_LENGTH + 256];
+    int status = 0;
+    int type;
+    while (status == 0 && (type = fgetc(in)) != EOF) {
+        if (type == 'S') {
+            unsigned int id;
+            unsigned int length;
+            if (fread(&id, sizeof(id), 1, in) != 1 || fread(&length, sizeof(length), 1, in) != 1 || id == 0 || id > (1u << 24) || length > (1u << 24)) {
+                status = 1;
+                break;
+            }
+            if (id > n_strings) {
+                char **grown = (char **)realloc(strings, (id + 64) * sizeof(char *));
+                if (!grown) {
+                    status = 1;
+                    break;
+                }
+                for (unsigned int i = n_strings; i < id + 64; i++) grown[i] = NULL;
+                strings = grown;
+                n_strings = id + 64;
+            }
+            char *string = (char *)malloc(length + 1);
+            if (!string || fread(string, 1, length, in) != length) {
+                free(string);
+                status = 1;
+                break;
+            }
+            string[length] = '\0';
+            free(strings[id - 1]);
+            strings[id - 1] = string;
+        } else if (type == 'R') {
+            long long time;
+            unsigned int file;
+            int number;
+            unsigned char level;
+            unsigned int format;
+            unsigned int length;
+            if (
+                fread(&time, sizeof(time), 1, in) != 1
+                || fread(&file, sizeof(file), 1, in) != 1
+                || fread(&number, sizeof(number), 1, in) != 1
+                || fread(&level, sizeof(level), 1, in) != 1
+                || fread(&format, sizeof(format), 1, in) != 1
+                || fread(&length, sizeof(length), 1, in) != 1
+                || level > LOG_FATAL
+                || length > ASYNC_LOG_MAX_MESSAGE_LENGTH
+                || fread(payload, 1, length, in) != length
+                || file > n_strings || (file && !strings[file - 1])
+                || format > n_strings || (format && !strings[format - 1])
+            ) {
+                status = 1;
+                break;
+            }
+            payload[length] = '\0';
+            if (format) __async_log_render__(message, sizeof(message), strings[format - 1], payload, length);
+            LogEvent event = {
+                .fmt = NULL,
+                .file = file ? strings[file - 1] : "?",
+                .line = number,
+                .level = level,
+                .time = log_time_local(time),
+                .timestamp = time,
+                .ctx = out,
+                .async_message = format ? message : payload
+            };
+            fwrite(line, 1, __async_log_format__(&event, 0, line, sizeof(line)), out);
+        } else status = 1;
+    }
+
+    for (unsigned int i = 0; i < n_strings; i++) free(strings[i]);
+    free(strings);
+    return status;
+}
+
+
+void async_log_config_precision(int precision) {
+    _LogLock.precision = precision;
+}
+
+
 void async_log_setting(int mode) {
     _LogLock.mode = mode;
 }
@@ -40,6 +273,11 @@ void async_log_config_write(FILE *f) {
 }
 
 
+void async_log_config_sink(LogSink *sink) {
+    async_log_add_callback(__async_log_callback_sink__, sink);
+}
+
+
 void async_log_config_thread_lock(_LogLockFunc func, void *ctx) {
     _LogLock.lock = func;
     _LogLock.ctx = ctx;
@@ -57,6 +295,19 @@ void async_log_add_callback(_LogCallbackFunc func, void *ctx) {
 
 
 void __async_log_print__(int level, char *file, int line, char *fmt, ...) {
+    if (atomic_get_relaxed(&_LogLock.running)) {
+        _AsyncLogRing *ring = __async_log_ring__();
+        if (!ring) {
+            fprintf(stderr, "Async log rings exhausted!\n");
+            return;
+        }
+        va_list args;
+        va_start(args, fmt);
+        __async_log_ring_push__(ring, level, file, line, fmt, args);
+        va_end(args);
+        return;
+    }
+
     if (_LogLock.pool) {
         __async_log_lock__();
         _AsyncLogTask *task = __async_log_threadpool_allocate__();
@@ -70,8 +321,7 @@ void __async_log_print__(int level, char *file, int line, char *fmt, ...) {
         task->level = level;
         task->file = file;
         task->line = line;
-        time_t now = time(NULL);
-        task->time = *localtime(&now);
+        task->time = log_time_now(_LogLock.precision);
         va_list args;
         va_start(args, fmt);
         vsnprintf(task->message, ASYNC_LOG_MAX_MESSAGE_LENGTH, fmt, args);
@@ -118,7 +368,8 @@ void __async_log_worker__(void *args) {
         .file = task->file,
         .line = task->line,
         .level = task->level,
-        .time = &task->time,
+        .time = log_time_local(task->time),
+        .timestamp = task->time,
         .async_message = task->message
     };
 
@@ -137,6 +388,635 @@ void __async_log_worker__(void *args) {
 }
 
 
+_AsyncLogRing *__async_log_ring__() {
+    #if defined(ASYNC_LOG_TLS)
+        if (__async_log_generation__ == _LogLock.generation) return __async_log_current__;
+    #else
+        unsigned long long id = thread_id();
+        int registered = atomic_get(&_LogLock.n_rings);
+        for (int i = 0; i < registered; i++) {
+            _AsyncLogRing *ring = _LogLock.rings[i];
+            if (!atomic_get(&ring->retired) && atomic_get(&ring->owner) == id) return ring;
+        }
+    #endif
+
+    _AsyncLogRing *ring = NULL;
+    int index = -1;
+    while (1) {
+        int waiting = 0;
+        mutex_lock(&_LogLock.ring_lock);
+        int n_rings = _LogLock.n_rings;
+        // A ring left by an exited thread is taken over once empty, its old producer wrote it last before retiring it.
+        for (int i = 0; i < n_rings && index < 0; i++) {
+            _AsyncLogRing *old = _LogLock.rings[i];
+            if (!atomic_get(&old->retired)) continue;
+            if (atomic_get(&old->head) == old->tail) index = i;
+            else waiting = 1;
+        }
+        if (index >= 0) {
+            ring = _LogLock.rings[index];
+            atomic_set(&ring->owner, thread_id());
+            atomic_set(&ring->retired, 0);
+        } else if (n_rings < ASYNC_LOG_MAX_RINGS) {
+            ring = (_AsyncLogRing *)calloc(1, sizeof(_AsyncLogRing));
+            char *buffer = ring ? (char *)malloc(_LogLock.ring_capacity) : NULL;
+            if (buffer) {
+                ring->buffer = buffer;
+                ring->capacity = _LogLock.ring_capacity;
+                ring->owner = thread_id();
+                _LogLock.rings[n_rings] = ring;
+                index = n_rings;
+                // The writer thread reads the rings below `n_rings` only, the ring is complete by then.
+                atomic_set(&_LogLock.n_rings, n_rings + 1);
+            } else {
+                free(ring);
+                ring = NULL;
+            }
+        }
+        mutex_unlock(&_LogLock.ring_lock);
+        // Every ring is taken, wait for the writer thread to empty one left by an exited thread.
+        if (ring || !waiting || !atomic_get(&_LogLock.running)) break;
+        event_set(&_LogLock.wakeup);
+        thread_yield();
+    }
+
+    if (ring && _LogLock.ring_key_ready) {
+        void *token = (void *)((uintptr_t)_LogLock.generation * (ASYNC_LOG_MAX_RINGS + 1) + (uintptr_t)index + 1);
+        #if defined(__OS_UNIX__)
+            pthread_setspecific(_LogLock.ring_key, token);
+        #elif defined(__OS_WINDOWS__)
+            FlsSetValue(_LogLock.ring_key, token);
+        #endif
+    }
+    #if defined(ASYNC_LOG_TLS)
+        __async_log_current__ = ring;
+        __async_log_generation__ = _LogLock.generation;
+    #endif
+    return ring;
+}
+
+
+void __async_log_ring_retire__(void *value) {
+    uintptr_t token = (uintptr_t)value;
+    #if defined(ASYNC_LOG_TLS)
+        // A message logged later on this thread (by another destructor) registers a ring again.
+        __async_log_current__ = NULL;
+        __async_log_generation__ = 0;
+    #endif
+    // A token of an earlier `async_log_init_ring` points to freed rings.
+    if (!atomic_get(&_LogLock.running) || token / (ASYNC_LOG_MAX_RINGS + 1) != (uintptr_t)_LogLock.generation) return;
+    atomic_set(&_LogLock.rings[token % (ASYNC_LOG_MAX_RINGS + 1) - 1]->retired, 1);
+}
+
+
+#if defined(__OS_WINDOWS__)
+    void WINAPI __async_log_ring_retire_win32__(void *value) {
+        if (value) __async_log_ring_retire__(value);
+    }
+#endif
+
+
+int __async_log_ring_push__(_AsyncLogRing *ring, int level, char *file, int line, char *fmt, va_list args) {
+    long long mask = ring->capacity - 1;
+    long long tail = ring->tail;
+    long long offset = tail & mask;
+    // Reserve room for the longest message, the record written is usually much shorter.
+    long long need = ASYNC_LOG_RECORD_SIZE(ASYNC_LOG_MAX_MESSAGE_LENGTH);
+    long long skip = ring->capacity - offset < need ? ring->capacity - offset : 0;
+    while (tail + skip + need - ring->cached_head > ring->capacity) {
+        ring->cached_head = atomic_get(&ring->head);
+        if (tail + skip + need - ring->cached_head <= ring->capacity) break;
+        // A full ring waits for the writer thread instead of losing the message.
+        if (atomic_get(&_LogLock.stop)) return 1;
+        event_set(&_LogLock.wakeup);
+        thread_yield();
+    }
+    if (skip >= (long long)sizeof(_AsyncLogRecord)) ((_AsyncLogRecord *)(ring->buffer + offset))->size = 0;
+    tail = tail + skip;
+
+    // Stamped once the room is there, a message held up by a full ring would otherwise carry the time it started waiting.
+    _AsyncLogRecord *record = (_AsyncLogRecord *)(ring->buffer + (tail & mask));
+    record->time = __async_log_clock__();
+    record->file = file;
+    record->line = line;
+    record->level = level;
+    int n = -1;
+    if (atomic_get_relaxed(&_LogLock.deferred)) {
+        va_list copy;
+        va_copy(copy, args);
+        n = __async_log_capture__(record->message, ASYNC_LOG_MAX_MESSAGE_LENGTH, fmt, copy);
+        va_end(copy);
+    }
+    if (n >= 0) {
+        record->format = fmt;
+        record->length = n;
+        record->size = (int)ASYNC_LOG_RECORD_SIZE(n);
+    } else {
+        n = vsnprintf(record->message, ASYNC_LOG_MAX_MESSAGE_LENGTH, fmt, args);
+        record->format = NULL;
+        record->length = n < 0 ? 0 : (n < ASYNC_LOG_MAX_MESSAGE_LENGTH ? n : ASYNC_LOG_MAX_MESSAGE_LENGTH - 1);
+        record->size = (int)ASYNC_LOG_RECORD_SIZE(record->length + 1);
+    }
+    tail = tail + record->size;
+    atomic_set(&ring->tail, tail);
+
+    // The writer thread looks at the rings every `ASYNC_LOG_FLUSH_INTERVAL`, it is woken up early only when a ring is filling up.
+    if (tail - ring->cached_head > ring->capacity / 2 && atomic_get_relaxed(&_LogLock.idle)) event_set(&_LogLock.wakeup);
+    return 0;
+}
+
+
+_AsyncLogRecord *__async_log_ring_peek__(_AsyncLogRing *ring) {
+    while (ring->read < ring->limit) {
+        long long offset = ring->read & (ring->capacity - 1);
+        _AsyncLogRecord *record = (_AsyncLogRecord *)(ring->buffer + offset);
+        if (ring->capacity - offset >= (long long)sizeof(_AsyncLogRecord) && record->size > 0) return record;
+        ring->read = ring->read + ring->capacity - offset;
+    }
+    return NULL;
+}
+
+
+int __async_log_writer__(void *args) {
+    (void)args;
+    while (1) {
+        // Read before draining, so a drain coming up empty after `stop == 1` has written everything logged before `async_log_exit`.
+        int stop = atomic_get(&_LogLock.stop);
+        if (atomic_get(&_LogLock.binary_request) != _LogLock.binary_done) {
+            // The records logged before `async_log_config_binary` go to the previous file.
+            while (__async_log_drain__() == ASYNC_LOG_BATCH);
+            __async_log_switch_binary__();
+            continue;
+        }
+        if (stop == 2) break;
+        if (__async_log_drain__() > 0) continue;
+        if (stop == 1) break;
+        // Nothing came in, lines waiting in a sink longer than its flush interval go out now.
+        for (int n = 0; _LogLock.sinks && n < ASYNC_LOG_MAX_CALLBACKS && _LogLock.callback[n].func; n++) {
+            if (_LogLock.callback[n].func == __async_log_callback_sink__) log_sink_poll((LogSink *)_LogLock.callback[n].ctx);
+        }
+        atomic_set(&_LogLock.idle, 1);
+        event_wait(&_LogLock.wakeup, ASYNC_LOG_FLUSH_INTERVAL);
+        atomic_set(&_LogLock.idle, 0);
+    }
+    return 0;
+}
+
+
+int __async_log_drain__() {
+    int n_rings = atomic_get(&_LogLock.n_rings);
+    for (int i = 0; i < n_rings; i++) {
+        _AsyncLogRing *ring = _LogLock.rings[i];
+        ring->read = ring->head;
+        ring->limit = atomic_get(&ring->tail);
+    }
+
+    // Every ring is in time order already, the oldest of their first records comes next.
+    int count = 0;
+    while (count < ASYNC_LOG_BATCH) {
+        _AsyncLogRing *next = NULL;
+        _AsyncLogRecord *first = NULL;
+        for (int i = 0; i < n_rings; i++) {
+            _AsyncLogRecord *record = __async_log_ring_peek__(_LogLock.rings[i]);
+            if (record && (!first || record->time < first->time)) {
+                first = record;
+                next = _LogLock.rings[i];
+            }
+        }
+        if (!first) break;
+        _LogLock.batch[count++] = first;
+        next->read = next->read + first->size;
+    }
+
+    if (count > 0) {
+        __async_log_lock__();
+        if (!_LogLock.mode) __async_log_write_batch__(stderr, 1, count);
+        if (_LogLock.binary) __async_log_write_binary__(_LogLock.binary, count);
+        for (int n = 0; n < ASYNC_LOG_MAX_CALLBACKS && _LogLock.callback[n].func; n++) {
+            _LogCallback *callback = &_LogLock.callback[n];
+            // The built-in outputs take the whole batch at once, a custom callback gets one event per record.
+            if (callback->func == __async_log_callback_stdout__) __async_log_write_batch__((FILE *)callback->ctx, 1, count);
+            else if (callback->func == __async_log_callback_write__) __async_log_write_batch__((FILE *)callback->ctx, 0, count);
+            else if (callback->func == __async_log_callback_sink__) __async_log_write_sink__((LogSink *)callback->ctx, count);
+            else {
+                for (int i = 0; i < count; i++) {
+                    _AsyncLogRecord *record = _LogLock.batch[i];
+                    LogEvent event = {
+                        .fmt = NULL,
+                        .file = record->file,
+                        .line = record->line,
+                        .level = record->level,
+                        .time = log_time_local(record->time + _LogLock.epoch),
+                        .timestamp = record->time + _LogLock.epoch,
+                        .async_message = __async_log_message__(record)
+                    };
+                    __async_log_init_event__(&event, callback->ctx);
+                    callback->func(&event);
+                }
+            }
+        }
+        __async_log_unlock__();
+    }
+
+    for (int i = 0; i < n_rings; i++) {
+        _AsyncLogRing *ring = _LogLock.rings[i];
+        if (ring->read != ring->head) atomic_set(&ring->head, ring->read);
+    }
+    return count;
+}
+
+
+int __async_log_format_batch__(int *index, int count, int enable_colour, int *level) {
+    char *text = _LogLock.text;
+    int length = 0;
+    // Written out once the longest line might not fit any more.
+    while (*index < count && ASYNC_LOG_BATCH_SIZE - length >= ASYNC_LOG_MAX_MESSAGE_LENGTH + 256) {
+        _AsyncLogRecord *record = _LogLock.batch[(*index)++];
+        LogEvent event = {
+            .fmt = NULL,
+            .file = record->file,
+            .line = record->line,
+            .level = record->level,
+            .time = log_time_local(record->time + _LogLock.epoch),
+            .timestamp = record->time + _LogLock.epoch,
+            .async_message = __async_log_message__(record)
+        };
+        length = length + __async_log_format__(&event, enable_colour, text + length, ASYNC_LOG_BATCH_SIZE - length);
+        if (record->level > *level) *level = record->level;
+    }
+    return length;
+}
+
+
+void __async_log_write_batch__(FILE *out, int enable_colour, int count) {
+    int level = LOG_TRACE;
+    for (int i = 0; i < count;) {
+        int length = __async_log_format_batch__(&i, count, enable_colour, &level);
+        os_flockfile(out);
+        fwrite(_LogLock.text, 1, length, out);
+        os_funlockfile(out);
+    }
+    if (level >= 4) fflush(out);
+}
+
+
+void __async_log_write_sink__(LogSink *sink, int count) {
+    _LogLock.sinks = 1;
+    for (int i = 0; i < count;) {
+        // The sink decides on flushing by the highest level of each piece.
+        int level = LOG_TRACE;
+        int length = __async_log_format_batch__(&i, count, 0, &level);
+        log_sink_write(sink, _LogLock.text, length, level);
+    }
+}
+
+
+char *__async_log_message__(_AsyncLogRecord *record) {
+    if (!record->format) return record->message;
+    __async_log_render__(_LogLock.message, sizeof(_LogLock.message), record->format, record->message, record->length);
+    return _LogLock.message;
+}
+
+
+void __async_log_switch_binary__() {
+    int request = atomic_get(&_LogLock.binary_request);
+    FILE *f = _LogLock.binary_pending;
+    if (_LogLock.binary) fflush(_LogLock.binary);
+    // A new file starts without any string, each is written again on first use.
+    for (unsigned int i = 0; i < _LogLock.strings_capacity; i++) _LogLock.strings[i] = NULL;
+    _LogLock.n_strings = 0;
+    _LogLock.binary_length = 0;
+    if (f) {
+        unsigned int version = ASYNC_LOG_BINARY_VERSION;
+        unsigned int order = 0x01020304;
+        unsigned char sizes[8] = {sizeof(long), sizeof(long long), sizeof(intmax_t), sizeof(size_t), sizeof(ptrdiff_t), sizeof(double), sizeof(long double), sizeof(void *)};
+        fwrite("ALOG", 1, 4, f);
+        fwrite(&version, sizeof(version), 1, f);
+        fwrite(&order, sizeof(order), 1, f);
+        fwrite(sizes, 1, sizeof(sizes), f);
+    }
+    _LogLock.binary = f;
+    atomic_set(&_LogLock.binary_done, request);
+}
+
+
+void __async_log_write_binary__(FILE *out, int count) {
+    _LogLock.binary_length = 0;
+    int flush = 0;
+    for (int i = 0; i < count; i++) {
+        _AsyncLogRecord *record = _LogLock.batch[i];
+        unsigned char type = 'R';
+        long long time = record->time + _LogLock.epoch;
+        unsigned int file = __async_log_binary_id__(out, record->file);
+        unsigned char level = (unsigned char)record->level;
+        unsigned int format = record->format ? __async_log_binary_id__(out, record->format) : 0;
+        unsigned int length = (unsigned int)record->length;
+        __async_log_binary_put__(out, &type, sizeof(type));
+        __async_log_binary_put__(out, &time, sizeof(time));
+        __async_log_binary_put__(out, &file, sizeof(file));
+        __async_log_binary_put__(out, &record->line, sizeof(record->line));
+        __async_log_binary_put__(out, &level, sizeof(level));
+        __async_log_binary_put__(out, &format, sizeof(format));
+        __async_log_binary_put__(out, &length, sizeof(length));
+        __async_log_binary_put__(out, record->message, record->length);
+        if (record->level >= 4) flush = 1;
+    }
+    fwrite(_LogLock.text, 1, _LogLock.binary_length, out);
+    _LogLock.binary_length = 0;
+    if (flush) fflush(out);
+}
+
+
+void __async_log_binary_put__(FILE *out, const void *data, int size) {
+    if (ASYNC_LOG_BATCH_SIZE - _LogLock.binary_length < size) {
+        fwrite(_LogLock.text, 1, _LogLock.binary_length, out);
+        _LogLock.binary_length = 0;
+    }
+    if (size > ASYNC_LOG_BATCH_SIZE) fwrite(data, 1, size, out);
+    else {
+        memcpy(_LogLock.text + _LogLock.binary_length, data, size);
+        _LogLock.binary_length = _LogLock.binary_length + size;
+    }
+}
+
+
+unsigned int __async_log_binary_id__(FILE *out, const char *string) {
+    // Grown at half load, so a free slot always ends the probing.
+    if (2 * (_LogLock.n_strings + 1) > _LogLock.strings_capacity) {
+        unsigned int capacity = _LogLock.strings_capacity ? 2 * _LogLock.strings_capacity : 256;
+        const char **strings = (const char **)calloc(capacity, sizeof(const char *));
+        unsigned int *ids = (unsigned int *)calloc(capacity, sizeof(unsigned int));
+        if (!strings || !ids) {
+            free(strings);
+            free(ids);
+            return 0;
+        }
+        for (unsigned int i = 0; i < _LogLock.strings_capacity; i++) {
+            if (!_LogLock.strings[i]) continue;
+            unsigned int slot = (unsigned int)(((unsigned long long)(uintptr_t)_LogLock.strings[i] * 11400714819323198485ULL) >> 40) & (capacity - 1);
+            while (strings[slot]) slot = (slot + 1) & (capacity - 1);
+            strings[slot] = _LogLock.strings[i];
+            ids[slot] = _LogLock.ids[i];
+        }
+        free(_LogLock.strings);
+        free(_LogLock.ids);
+        _LogLock.strings = strings;
+        _LogLock.ids = ids;
+        _LogLock.strings_capacity = capacity;
+    }
+
+    unsigned int mask = _LogLock.strings_capacity - 1;
+    unsigned int slot = (unsigned int)(((unsigned long long)(uintptr_t)string * 11400714819323198485ULL) >> 40) & mask;
+    while (_LogLock.strings[slot]) {
+        if (_LogLock.strings[slot] == string) return _LogLock.ids[slot];
+        slot = (slot + 1) & mask;
+    }
+    unsigned int id = ++_LogLock.n_strings;
+    _LogLock.strings[slot] = string;
+    _LogLock.ids[slot] = id;
+
+    unsigned char type = 'S';
+    unsigned int length = (unsigned int)strlen(string);
+    __async_log_binary_put__(out, &type, sizeof(type));
+    __async_log_binary_put__(out, &id, sizeof(id));
+    __async_log_binary_put__(out, &length, sizeof(length));
+    __async_log_binary_put__(out, string, (int)length);
+    return id;
+}
+
+
+int __async_log_spec__(const char *p, int *stars, int *kind, int *precision) {
+    const char *q = p + 1;
+    *stars = 0;
+    *precision = -1;
+    if (*q == '%') {
+        *kind = ASYNC_LOG_ARG_NONE;
+        return 2;
+    }
+    while (*q && strchr("-+ #0'", *q)) q++;
+    if (*q == '*') {
+        (*stars)++;
+        q++;
+    } else while (*q >= '0' && *q <= '9') q++;
+    if (*q == '.') {
+        q++;
+        if (*q == '*') {
+            (*stars)++;
+            *precision = -2;
+            q++;
+        } else {
+            *precision = 0;
+            for (; *q >= '0' && *q <= '9'; q++) {
+                if (*precision < ASYNC_LOG_MAX_MESSAGE_LENGTH) *precision = *precision * 10 + (*q - '0');
+            }
+        }
+    }
+
+    // `h` and `hh` arguments are promoted to `int` anyway.
+    int integer = ASYNC_LOG_ARG_INT;
+    int floating = ASYNC_LOG_ARG_DOUBLE;
+    int plain = 1;
+    if (*q == 'h') {
+        q++;
+        if (*q == 'h') q++;
+        floating = ASYNC_LOG_ARG_INVALID;
+        plain = 0;
+    } else if (*q == 'l') {
+        q++;
+        if (*q == 'l') {
+            q++;
+            integer = ASYNC_LOG_ARG_LLONG;
+            floating = ASYNC_LOG_ARG_INVALID;
+        } else integer = ASYNC_LOG_ARG_LONG;
+        plain = 0;
+    } else if (*q == 'j' || *q == 'z' || *q == 't') {
+        integer = *q == 'j' ? ASYNC_LOG_ARG_INTMAX : (*q == 'z' ? ASYNC_LOG_ARG_SIZE : ASYNC_LOG_ARG_PTRDIFF);
+        floating = ASYNC_LOG_ARG_INVALID;
+        plain = 0;
+        q++;
+    } else if (*q == 'L') {
+        integer = ASYNC_LOG_ARG_INVALID;
+        floating = ASYNC_LOG_ARG_LDOUBLE;
+        plain = 0;
+        q++;
+    }
+
+    switch (*q) {
+        case 'd': case 'i': case 'u': case 'o': case 'x': case 'X':
+            *kind = integer;
+            break;
+        case 'e': case 'E': case 'f': case 'F': case 'g': case 'G': case 'a': case 'A':
+            *kind = floating;
+            break;
+        case 'c':
+            *kind = plain ? ASYNC_LOG_ARG_INT : ASYNC_LOG_ARG_INVALID;
+            break;
+        case 's':
+            *kind = plain ? ASYNC_LOG_ARG_STRING : ASYNC_LOG_ARG_INVALID;
+            break;
+        case 'p':
+            *kind = plain ? ASYNC_LOG_ARG_POINTER : ASYNC_LOG_ARG_INVALID;
+            break;
+        default:
+            // `%n`, wide characters, and a format cut short.
+            *kind = ASYNC_LOG_ARG_INVALID;
+            return (int)(q - p);
+    }
+    q++;
+    if (q - p >= 32) *kind = ASYNC_LOG_ARG_INVALID;
+    return (int)(q - p);
+}
+
+
+#define __ASYNC_LOG_CAPTURE__(type) do { \
+    type value = va_arg(args, type); \
+    if (used + (int)sizeof(value) > size) return -1; \
+    memcpy(buffer + used, &value, sizeof(value)); \
+    used = used + (int)sizeof(value); \
+} while (0)
+
+
+int __async_log_capture__(char *buffer, int size, const char *fmt, va_list args) {
+    int used = 0;
+    const char *p = fmt;
+    while (*p) {
+        if (*p != '%') {
+            p++;
+            continue;
+        }
+        int stars;
+        int kind;
+        int precision;
+        p = p + __async_log_spec__(p, &stars, &kind, &precision);
+        if (kind == ASYNC_LOG_ARG_INVALID) return -1;
+        int star = 0;
+        for (int i = 0; i < stars; i++) {
+            star = va_arg(args, int);
+            if (used + (int)sizeof(int) > size) return -1;
+            memcpy(buffer + used, &star, sizeof(int));
+            used = used + (int)sizeof(int);
+        }
+        // A negative `*` precision is taken as if it were omitted.
+        if (precision == -2) precision = star < 0 ? -1 : star;
+        switch (kind) {
+            case ASYNC_LOG_ARG_INT: __ASYNC_LOG_CAPTURE__(int); break;
+            case ASYNC_LOG_ARG_LONG: __ASYNC_LOG_CAPTURE__(long); break;
+            case ASYNC_LOG_ARG_LLONG: __ASYNC_LOG_CAPTURE__(long long); break;
+            case ASYNC_LOG_ARG_INTMAX: __ASYNC_LOG_CAPTURE__(intmax_t); break;
+            case ASYNC_LOG_ARG_SIZE: __ASYNC_LOG_CAPTURE__(size_t); break;
+            case ASYNC_LOG_ARG_PTRDIFF: __ASYNC_LOG_CAPTURE__(ptrdiff_t); break;
+            case ASYNC_LOG_ARG_DOUBLE: __ASYNC_LOG_CAPTURE__(double); break;
+            case ASYNC_LOG_ARG_LDOUBLE: __ASYNC_LOG_CAPTURE__(long double); break;
+            case ASYNC_LOG_ARG_POINTER: __ASYNC_LOG_CAPTURE__(void *); break;
+            case ASYNC_LOG_ARG_STRING: {
+                // The string is copied with its length, it may be gone by the time the writer formats it.
+                // No more than the precision is read, the array behind a `%.*s` needs no terminating null.
+                const char *string = va_arg(args, const char *);
+                if (!string) string = "(null)";
+                int bound = precision >= 0 && precision < ASYNC_LOG_MAX_MESSAGE_LENGTH ? precision : ASYNC_LOG_MAX_MESSAGE_LENGTH;
+                int length = (int)strnlen(string, bound);
+                if (used + (int)sizeof(int) + length + 1 > size) return -1;
+                memcpy(buffer + used, &length, sizeof(int));
+                memcpy(buffer + used + sizeof(int), string, length);
+                buffer[used + sizeof(int) + length] = '\0';
+                used = used + (int)sizeof(int) + length + 1;
+                break;
+            }
+        }
+    }
+    return used;
+}
+
+
+#define __ASYNC_LOG_RENDER__(type) do { \
+    type value; \
+    if (used + (int)sizeof(value) > length) goto end; \
+    memcpy(&value, args + used, sizeof(value)); \
+    used = used + (int)sizeof(value); \
+    if (stars == 0) n = snprintf(buffer + offset, size - offset, spec, value); \
+    else if (stars == 1) n = snprintf(buffer + offset, size - offset, spec, star[0], value); \
+    else n = snprintf(buffer + offset, size - offset, spec, star[0], star[1], value); \
+} while (0)
+
+
+int __async_log_render__(char *buffer, int size, const char *fmt, const char *args, int length) {
+    int offset = 0;
+    int used = 0;
+    const char *p = fmt;
+    while (*p && offset < size - 1) {
+        if (*p != '%') {
+            buffer[offset++] = *p++;
+            continue;
+        }
+        int stars;
+        int kind;
+        int precision;
+        int n = __async_log_spec__(p, &stars, &kind, &precision);
+        if (kind == ASYNC_LOG_ARG_INVALID) break;
+        if (kind == ASYNC_LOG_ARG_NONE) {
+            buffer[offset++] = '%';
+            p = p + n;
+            continue;
+        }
+        char spec[32];
+        memcpy(spec, p, n);
+        spec[n] = '\0';
+        p = p + n;
+
+        int star[2];
+        for (int i = 0; i < stars; i++) {
+            if (used + (int)sizeof(int) > length) goto end;
+            memcpy(&star[i], args + used, sizeof(int));
+            used = used + (int)sizeof(int);
+        }
+        n = 0;
+        switch (kind) {
+            case ASYNC_LOG_ARG_INT: __ASYNC_LOG_RENDER__(int); break;
+            case ASYNC_LOG_ARG_LONG: __ASYNC_LOG_RENDER__(long); break;
+            case ASYNC_LOG_ARG_LLONG: __ASYNC_LOG_RENDER__(long long); break;
+            case ASYNC_LOG_ARG_INTMAX: __ASYNC_LOG_RENDER__(intmax_t); break;
+            case ASYNC_LOG_ARG_SIZE: __ASYNC_LOG_RENDER__(size_t); break;
+            case ASYNC_LOG_ARG_PTRDIFF: __ASYNC_LOG_RENDER__(ptrdiff_t); break;
+            case ASYNC_LOG_ARG_DOUBLE: __ASYNC_LOG_RENDER__(double); break;
+            case ASYNC_LOG_ARG_LDOUBLE: __ASYNC_LOG_RENDER__(long double); break;
+            case ASYNC_LOG_ARG_POINTER: __ASYNC_LOG_RENDER__(void *); break;
+            case ASYNC_LOG_ARG_STRING: {
+                int count;
+                if (used + (int)sizeof(int) > length) goto end;
+                memcpy(&count, args + used, sizeof(int));
+                if (count < 0 || used + (int)sizeof(int) + count + 1 > length || args[used + sizeof(int) + count] != '\0') goto end;
+                const char *value = args + used + sizeof(int);
+                used = used + (int)sizeof(int) + count + 1;
+                if (stars == 0) n = snprintf(buffer + offset, size - offset, spec, value);
+                else if (stars == 1) n = snprintf(buffer + offset, size - offset, spec, star[0], value);
+                else n = snprintf(buffer + offset, size - offset, spec, star[0], star[1], value);
+                break;
+            }
+        }
+        if (n > 0) offset = offset + (n < size - offset ? n : size - offset - 1);
+    }
+
+    end:
+    buffer[offset] = '\0';
+    return offset;
+}
+
+
+long long __async_log_clock__() {
+    #if defined(__OS_UNIX__)
+        struct timespec t;
+        clock_gettime(CLOCK_MONOTONIC, &t);
+        return (long long)t.tv_sec * 1000000000LL + t.tv_nsec;
+    #elif defined(__OS_WINDOWS__)
+        LARGE_INTEGER frequency;
+        LARGE_INTEGER counter;
+        QueryPerformanceFrequency(&frequency);
+        QueryPerformanceCounter(&counter);
+        return counter.QuadPart / frequency.QuadPart * 1000000000LL + counter.QuadPart % frequency.QuadPart * 1000000000LL / frequency.QuadPart;
+    #endif
+}
+
+
 _AsyncLogTask *__async_log_threadpool_allocate__() {
     // If the thread pool is full, discard the logger.
     if (_LogLock.linklist == NULL) return NULL;
@@ -155,8 +1035,8 @@ void __async_log_threadpool_deallocate__(_AsyncLogTask *task) {
 
 void __async_log_init_event__(LogEvent *event, void *ctx) {
     if (!event->time) {
-        time_t now = time(NULL);
-        event->time = localtime(&now);
+        event->timestamp = log_time_now(_LogLock.precision);
+        event->time = log_time_local(event->timestamp);
     }
     event->ctx = ctx;
 }
@@ -172,17 +1052,18 @@ void __async_log_unlock__() {
 }
 
 
-void __async_log_callback_common_format__(LogEvent *event, int enable_colour) {
-    char buffer[ASYNC_LOG_MAX_MESSAGE_LENGTH + 256];
+int __async_log_format__(LogEvent *event, int enable_colour, char *buffer, int size) {
     int offset = 0;
-    int remaining = sizeof(buffer);
-    char time_buffer[32];
-    time_buffer[strftime(time_buffer, sizeof(time_buffer), "%Y-%m-%d %H:%M:%S", event->time)] = '\0';
+    int remaining = size;
+    char time_buffer[LOG_TIME_LENGTH];
+    log_time_format(time_buffer, event->timestamp, _LogLock.precision);
 
     int n;
     if (enable_colour == 1) n = snprintf(buffer + offset, remaining, "%s %s%-7s \x1b[90m%s:%d:\x1b[0m ", time_buffer, COLOURS[event->level], TIPS[event->level], event->file, event->line);
     else n = snprintf(buffer + offset, remaining, "%s %-7s %s:%d: ", time_buffer, TIPS[event->level], event->file, event->line);
 
+    // A truncated part only counts as far as it was written.
+    if (n >= remaining) n = remaining - 1;
     if (n > 0) {
         offset = offset + n;
         remaining = remaining - n;
@@ -196,6 +1077,7 @@ void __async_log_callback_common_format__(LogEvent *event, int enable_colour) {
         va_end(args);
     }
 
+    if (n >= remaining) n = remaining - 1;
     if (n > 0) {
         offset = offset + n;
         remaining = remaining - n;
@@ -204,6 +1086,13 @@ void __async_log_callback_common_format__(LogEvent *event, int enable_colour) {
         buffer[offset++] = '\n';
         buffer[offset] = '\0';
     }
+    return offset;
+}
+
+
+void __async_log_callback_common_format__(LogEvent *event, int enable_colour) {
+    char buffer[ASYNC_LOG_MAX_MESSAGE_LENGTH + 256];
+    int offset = __async_log_format__(event, enable_colour, buffer, sizeof(buffer));
 
     FILE *out = (FILE *)event->ctx;
     // Use `flockfile()` to further ensure atomicity on stderr.
@@ -214,6 +1103,13 @@ void __async_log_callback_common_format__(LogEvent *event, int enable_colour) {
 }
 
 
+void __async_log_callback_sink__(LogEvent *event) {
+    char buffer[ASYNC_LOG_MAX_MESSAGE_LENGTH + 256];
+    int length = __async_log_format__(event, 0, buffer, sizeof(buffer));
+    log_sink_write((LogSink *)event->ctx, buffer, length, event->level);
+}
+
+
 void __async_log_callback_write__(LogEvent *event) {
     __async_log_callback_common_format__(event, 0);
 }
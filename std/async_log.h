@@ -4,11 +4,15 @@
 
 #include <time.h>
 #include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
 #include <stdlib.h>
+#include <string.h>
 #include <stdarg.h>
 
 
 #include "os.h"
+#include "log_time.h"
 #include "threadpool.h"
 
 
@@ -22,6 +26,22 @@ enum {LOG_TRACE, LOG_DEBUG, LOG_INFO, LOG_WARNING, LOG_ERROR, LOG_FATAL};
 #define ASYNC_LOG_MAX_CALLBACKS 64
 #define ASYNC_LOG_MAX_MESSAGE_LENGTH 512
 #define ASYNC_LOG_MAX_THREAD_POOL_SIZE 1024 // Maximum concurrent asynchronous logger count.
+#define ASYNC_LOG_MAX_RINGS 1024    // Maximum threads logging through `async_log_init_ring` (one ring per thread that ever logged).
+#define ASYNC_LOG_BATCH 4096    // Most records the writer thread merges and writes at once.
+#define ASYNC_LOG_BATCH_SIZE 65536  // Bytes of formatted text the writer thread hands to one `fwrite`.
+#define ASYNC_LOG_FLUSH_INTERVAL 0.01   // Seconds the idle writer thread sleeps before it looks at the rings again.
+#define ASYNC_LOG_BINARY_VERSION 1
+
+
+/**
+ * The argument types of a conversion in a deferred message, a format with anything else (like `%n` or `%ls`) is formatted by the caller.
+**/
+enum {ASYNC_LOG_ARG_NONE, ASYNC_LOG_ARG_INT, ASYNC_LOG_ARG_LONG, ASYNC_LOG_ARG_LLONG, ASYNC_LOG_ARG_INTMAX, ASYNC_LOG_ARG_SIZE, ASYNC_LOG_ARG_PTRDIFF, ASYNC_LOG_ARG_DOUBLE, ASYNC_LOG_ARG_LDOUBLE, ASYNC_LOG_ARG_STRING, ASYNC_LOG_ARG_POINTER, ASYNC_LOG_ARG_INVALID};
+
+
+#if (defined(__GNUC__) || defined(__clang__)) && !defined(__TINYC__)
+    #define ASYNC_LOG_TLS __thread
+#endif
 
 
 #define asynclog_trace(...) __async_log_print__(LOG_TRACE, __FILE__, __LINE__, __VA_ARGS__)
@@ -32,11 +52,15 @@ enum {LOG_TRACE, LOG_DEBUG, LOG_INFO, LOG_WARNING, LOG_ERROR, LOG_FATAL};
 #define asynclog_fatal(...) __async_log_print__(LOG_FATAL, __FILE__, __LINE__, __VA_ARGS__)
 
 
+typedef struct LogSink LogSink;     // Only taken by pointer, `log_sink.h` declares it with the `log_sink_*` functions.
+
+
 typedef struct {
     va_list argument_pointer;
     char *fmt;
     char *file;
     struct tm *time;
+    long long timestamp;    // Nanoseconds since the epoch.
     void *ctx;
     int line;
     int level;
@@ -58,12 +82,48 @@ typedef struct _AsyncLogTask {
     char *file;
     int line;
     int level;
-    struct tm time;
+    long long time;     // Nanoseconds since the epoch.
     char message[ASYNC_LOG_MAX_MESSAGE_LENGTH];
     struct _AsyncLogTask *next;
 } _AsyncLogTask;
 
 
+/**
+ * A record in a ring, the message follows the header and the next record starts at the next multiple of 8 bytes.
+ * A header with `size == 0` (or no room left for a header) sends the reader back to the start of the ring.
+ * A deferred record keeps `format` and the raw arguments instead of the message, the writer thread formats it.
+**/
+typedef struct {
+    long long time;     // `CLOCK_MONOTONIC` nanoseconds, the writer merges the rings by it.
+    char *file;
+    char *format;   // `NULL` for a formatted message.
+    int line;
+    int level;
+    int size;       // The whole record in bytes.
+    int length;     // The message length without the terminating null, or the bytes of the arguments.
+    char message[];
+} _AsyncLogRecord;
+
+
+#define ASYNC_LOG_RECORD_SIZE(length) (((long long)sizeof(_AsyncLogRecord) + (length) + 7) & ~7LL)
+
+
+typedef struct {
+    char padding_head[ATOMIC_CACHE_LINE];
+    long long tail;     // Written by the producer only.
+    long long cached_head;  // The producer's last look at `head`.
+    char padding[ATOMIC_CACHE_LINE - 2 * sizeof(long long)];
+    long long head;     // Written by the writer thread only.
+    long long read;     // The writer's cursor within a batch (published to `head` after the batch is written).
+    long long limit;    // The writer's snapshot of `tail` for a batch.
+    unsigned long long owner;   // `thread_id()` of the producer, used when `ASYNC_LOG_TLS` is not available.
+    int retired;    // `1` once the producer exited, a new thread takes the ring over after the writer has drained it.
+    long long capacity;     // Bytes, a power of two.
+    char *buffer;
+    char padding_tail[ATOMIC_CACHE_LINE];
+} _AsyncLogRing;
+
+
 /**
  * @brief Initialize an asynchronous logger.
  * @param n_workers The number of threads (like `4`).
@@ -72,6 +132,51 @@ typedef struct _AsyncLogTask {
 void async_log_init(int n_workers, int queue_capacity);
 
 
+/**
+ * @brief Initialize an asynchronous logger with one lock-free ring per logging thread and a single writer thread.
+ * The writer merges the rings by timestamp and writes in batches, a thread finding its ring full waits for the writer.
+ * @param capacity The bytes of each ring (like `1 << 16`, rounded up to a power of two).
+ * @return `0` for success, `1` for failure.
+**/
+int async_log_init_ring(int capacity);
+
+
+/**
+ * @brief Defer the formatting to the writer thread of `async_log_init_ring`, the caller only copies the format pointer and the raw arguments.
+ * The format string has to outlive the logger (a string literal does), a `%s` argument is copied at once.
+ * @param enable `1` for deferred formatting, `0` for formatting on the calling thread (default).
+ * @return `0` for success, `1` without `async_log_init_ring`.
+**/
+int async_log_config_deferred(int enable);
+
+
+/**
+ * @brief Write the records of `async_log_init_ring` to a compact binary file as well, `async_log_decode` turns it into text.
+ * The file starts with a header, every format string and file name is written once, a record carries its raw arguments.
+ * Numbers are in the byte order and sizes of the writing machine, decode on the same platform.
+ * The writer thread switches files between two batches, the records logged before the call go to the previous file.
+ * The call returns once the switch is made, the previous file is flushed and may be closed then.
+ * @param f The pointer of binary log file (opened with `"wb"`), `NULL` to stop.
+ * @return `0` for success, `1` without `async_log_init_ring`.
+**/
+int async_log_config_binary(FILE *f);
+
+
+/**
+ * @brief Decode a binary log file of `async_log_config_binary` into text lines.
+ * @param in The binary log file (opened with `"rb"`).
+ * @param out The text output (like `stdout`).
+ * @return `0` for success, `1` for a malformed or foreign file.
+ * @example
+ * @code
+FILE *in = fopen("app.bin", "rb");
+async_log_decode(in, stdout);
+fclose(in);
+ * @endcode
+**/
+int async_log_decode(FILE *in, FILE *out);
+
+
 /**
  * @brief Destroy the asynchronous logger and free its memory safely.
  * @param safe_exit `1` for awaiting all tasks to be completed, `0` for exiting immediately.
@@ -79,6 +184,13 @@ void async_log_init(int n_workers, int queue_capacity);
 void async_log_exit(int safe_exit);
 
 
+/**
+ * @brief Configure the precision of the timestamps (the decoded lines of `async_log_decode` included).
+ * @param precision `LOG_TIME_SECOND` (default), `LOG_TIME_MILLISECOND` or `LOG_TIME_MICROSECOND`.
+**/
+void async_log_config_precision(int precision);
+
+
 /**
  * @brief Set the asynchronous log mode.
  * @param mode `1` for not printing, `0` for default printing.
@@ -93,6 +205,14 @@ void async_log_setting(int mode);
 void async_log_config_write(FILE *f);
 
 
+/**
+ * @brief Configure the asynchronous logger written to a buffered sink (go to the `log_sink.h` declaration to see the flush policy).
+ * With `async_log_init_ring` the writer thread hands it whole batches and writes it when the flush interval passes.
+ * @param sink The pointer of sink, closed by the caller after `async_log_exit`.
+**/
+void async_log_config_sink(LogSink *sink);
+
+
 /**
  * @brief Configure the multi-thread lock for the asynchronous log.
  * @param func Thread lock function (go to the `async_log.h` declaration to see how to use it).
@@ -150,6 +270,170 @@ void __async_log_print__(int level, char *file, int line, char *fmt, ...);
 void __async_log_worker__(void *args);
 
 
+/**
+ * @brief Get the ring of the current thread on its first message, taking over a drained ring of an exited thread or registering a new one.
+ * @return The ring, `NULL` when `ASYNC_LOG_MAX_RINGS` threads are alive or out of memory.
+**/
+_AsyncLogRing *__async_log_ring__();
+
+
+/**
+ * @brief The thread-exit destructor of a ring, marking it retired.
+ * @param value The ring token (`generation * (ASYNC_LOG_MAX_RINGS + 1) + index + 1`).
+**/
+void __async_log_ring_retire__(void *value);
+
+
+#if defined(__OS_WINDOWS__)
+    void WINAPI __async_log_ring_retire_win32__(void *value);
+#endif
+
+
+/**
+ * @brief Format a message into the ring of the current thread (no lock, no signal unless the ring is getting full).
+ * @param ring The ring of the current thread.
+ * @param level The level of asynchronous log.
+ * @param file The C language file.
+ * @param line The C language file line.
+ * @param fmt The content string.
+ * @param args The arguments of `fmt`.
+ * @return `0` for success, `1` for a full ring while the logger is stopping.
+**/
+int __async_log_ring_push__(_AsyncLogRing *ring, int level, char *file, int line, char *fmt, va_list args);
+
+
+/**
+ * @brief Get the next record of a ring within the writer's snapshot, skipping the wrap-around.
+ * @param ring The ring.
+ * @return The record, `NULL` when the snapshot is consumed.
+**/
+_AsyncLogRecord *__async_log_ring_peek__(_AsyncLogRing *ring);
+
+
+/**
+ * @brief The writer thread of the ring backend.
+ * @param args Unused.
+ * @return `0`.
+**/
+int __async_log_writer__(void *args);
+
+
+/**
+ * @brief Merge one batch of records from all rings by timestamp and hand it to the outputs.
+ * @return The number of records written.
+**/
+int __async_log_drain__();
+
+
+/**
+ * @brief Format records of the batch into the text buffer of the writer thread until it might not hold the longest line.
+ * @param index The first record, advanced past the records formatted.
+ * @param count The number of records in the batch.
+ * @param enable_colour `1` for activation, `0` for deactivation.
+ * @param level The highest level formatted, raised by the records formatted.
+ * @return The length of the text.
+**/
+int __async_log_format_batch__(int *index, int count, int enable_colour, int *level);
+
+
+/**
+ * @brief Format a batch of records into large buffers and write them to a file.
+ * @param out The output file.
+ * @param enable_colour `1` for activation, `0` for deactivation.
+ * @param count The number of records in the batch.
+**/
+void __async_log_write_batch__(FILE *out, int enable_colour, int count);
+
+
+/**
+ * @brief Format a batch of records into large buffers and append them to a sink.
+ * @param sink The pointer of sink.
+ * @param count The number of records in the batch.
+**/
+void __async_log_write_sink__(LogSink *sink, int count);
+
+
+/**
+ * @brief Get the message of a record, formatting a deferred one.
+ * @param record The record.
+ * @return The message (a deferred one is valid until the next call).
+**/
+char *__async_log_message__(_AsyncLogRecord *record);
+
+
+/**
+ * @brief Switch the binary log file to the one of `async_log_config_binary` and acknowledge it (writer thread only).
+**/
+void __async_log_switch_binary__();
+
+
+/**
+ * @brief Write a batch of records to the binary log file.
+ * @param out The binary log file.
+ * @param count The number of records in the batch.
+**/
+void __async_log_write_binary__(FILE *out, int count);
+
+
+/**
+ * @brief Append bytes to the binary output of the writer thread, written out when the buffer fills up.
+ * @param out The binary log file.
+ * @param data The bytes.
+ * @param size The number of bytes.
+**/
+void __async_log_binary_put__(FILE *out, const void *data, int size);
+
+
+/**
+ * @brief Get the identifier of a format string or file name in the binary log file, writing its text on first use.
+ * @param out The binary log file.
+ * @param string The string (identified by its address).
+ * @return The identifier (from `1`).
+**/
+unsigned int __async_log_binary_id__(FILE *out, const char *string);
+
+
+/**
+ * @brief Parse one conversion specification of a format.
+ * @param p The format at `%`.
+ * @param stars The number of `*` widths and precisions.
+ * @param kind The argument type (`ASYNC_LOG_ARG_*`).
+ * @param precision The precision, `-1` for none, `-2` for `*` (the last of the `*` arguments).
+ * @return The length of the specification.
+**/
+int __async_log_spec__(const char *p, int *stars, int *kind, int *precision);
+
+
+/**
+ * @brief Copy the raw arguments of a format.
+ * @param buffer The output buffer.
+ * @param size The size of `buffer`.
+ * @param fmt The format string.
+ * @param args The arguments of `fmt`.
+ * @return The bytes written, `-1` for an unsupported conversion or arguments too long.
+**/
+int __async_log_capture__(char *buffer, int size, const char *fmt, va_list args);
+
+
+/**
+ * @brief Format a message from the raw arguments copied by `__async_log_capture__`.
+ * @param buffer The output buffer.
+ * @param size The size of `buffer`.
+ * @param fmt The format string.
+ * @param args The raw arguments.
+ * @param length The bytes of `args`.
+ * @return The length of the message.
+**/
+int __async_log_render__(char *buffer, int size, const char *fmt, const char *args, int length);
+
+
+/**
+ * @brief Get the monotonic clock time.
+ * @return `CLOCK_MONOTONIC` nanoseconds.
+**/
+long long __async_log_clock__();
+
+
 /**
  * @brief Get an ownership of task object from the thread pool.
  * @return An asynchronous log task from thread pool.
@@ -184,6 +468,17 @@ void __async_log_lock__();
 void __async_log_unlock__();
 
 
+/**
+ * @brief Format an asynchronous log line (with the trailing newline).
+ * @param event The event of asynchronous log.
+ * @param enable_colour `1` for activation, `0` for deactivation.
+ * @param buffer The output buffer.
+ * @param size The size of `buffer` (at least `ASYNC_LOG_MAX_MESSAGE_LENGTH + 256` for an untruncated line).
+ * @return The length of the line.
+**/
+int __async_log_format__(LogEvent *event, int enable_colour, char *buffer, int size);
+
+
 /**
  * @brief Asynchronous universal callback format.
  * @param event The event of asynchronous log.
@@ -206,4 +501,11 @@ void __async_log_callback_stdout__(LogEvent *event);
 void __async_log_callback_write__(LogEvent *event);
 
 
+/**
+ * @brief Write to a buffered sink callback function.
+ * @param event The event of asynchronous log.
+**/
+void __async_log_callback_sink__(LogEvent *event);
+
+
 #endif
\ No newline at end of file
@@ -0,0 +1,28 @@
+#include "atomic.h"
+
+
+#if defined(__ATOMIC_FALLBACK__)
+    #if defined(__OS_UNIX__)
+        #include <pthread.h>
+        static pthread_mutex_t ATOMIC_FALLBACK_LOCK = PTHREAD_MUTEX_INITIALIZER;
+
+        void __atomic_fallback_lock__() {
+            pthread_mutex_lock(&ATOMIC_FALLBACK_LOCK);
+        }
+
+        void __atomic_fallback_unlock__() {
+            pthread_mutex_unlock(&ATOMIC_FALLBACK_LOCK);
+        }
+    #elif defined(__OS_WINDOWS__)
+        #include <windows.h>
+        static volatile LONG ATOMIC_FALLBACK_LOCK = 0;
+
+        void __atomic_fallback_lock__() {
+            while (InterlockedExchange(&ATOMIC_FALLBACK_LOCK, 1) != 0) Sleep(0);
+        }
+
+        void __atomic_fallback_unlock__() {
+            InterlockedExchange(&ATOMIC_FALLBACK_LOCK, 0);
+        }
+    #endif
+#endif
@@ -0,0 +1,59 @@
+#ifndef _ATOMIC_H_
+#define _ATOMIC_H_
+
+
+#if !defined(__OS_WINDOWS__) && !defined(__OS_UNIX__)
+    #if defined(_WIN32) || defined(__WIN32__) || defined(__WINDOWS__)
+        #define __OS_WINDOWS__
+    #elif defined(__linux__) || defined(__APPLE__)
+        #define __OS_UNIX__
+        #define _GNU_SOURCE
+    #else
+        #error "Unsupported platforms."
+    #endif
+#endif
+
+
+#define ATOMIC_CACHE_LINE 64    // Pad hot shared fields to this size to avoid false sharing.
+
+
+#if (defined(__GNUC__) || defined(__clang__)) && !defined(__TINYC__)
+    #define atomic_get(ptr) __atomic_load_n(ptr, __ATOMIC_ACQUIRE)
+    #define atomic_get_relaxed(ptr) __atomic_load_n(ptr, __ATOMIC_RELAXED)
+    #define atomic_set(ptr, value) __atomic_store_n(ptr, value, __ATOMIC_RELEASE)
+    #define atomic_set_relaxed(ptr, value) __atomic_store_n(ptr, value, __ATOMIC_RELAXED)
+    #define atomic_swap(ptr, value) __atomic_exchange_n(ptr, value, __ATOMIC_SEQ_CST)
+    #define atomic_add(ptr, value) __atomic_fetch_add(ptr, value, __ATOMIC_SEQ_CST)
+    #define atomic_sub(ptr, value) __atomic_fetch_sub(ptr, value, __ATOMIC_SEQ_CST)
+    #define atomic_cas(ptr, expected, desired) __atomic_compare_exchange_n(ptr, expected, desired, 0, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST)
+    #define atomic_fence() __atomic_thread_fence(__ATOMIC_SEQ_CST)
+#else
+    /**
+     * Compilers without atomic builtins (`tcc`) serialize every operation through one global lock,
+     * slower but still correct. Statement expressions and `__typeof__` are supported by `tcc`.
+    **/
+    #define __ATOMIC_FALLBACK__
+    void __atomic_fallback_lock__();
+    void __atomic_fallback_unlock__();
+    #define atomic_get(ptr) ({__atomic_fallback_lock__(); __typeof__(*(ptr)) _v_ = *(ptr); __atomic_fallback_unlock__(); _v_;})
+    #define atomic_get_relaxed(ptr) atomic_get(ptr)
+    #define atomic_set(ptr, value) do {__atomic_fallback_lock__(); *(ptr) = (value); __atomic_fallback_unlock__();} while (0)
+    #define atomic_set_relaxed(ptr, value) atomic_set(ptr, value)
+    #define atomic_swap(ptr, value) ({__atomic_fallback_lock__(); __typeof__(*(ptr)) _v_ = *(ptr); *(ptr) = (value); __atomic_fallback_unlock__(); _v_;})
+    #define atomic_add(ptr, value) ({__atomic_fallback_lock__(); __typeof__(*(ptr)) _v_ = *(ptr); *(ptr) = _v_ + (value); __atomic_fallback_unlock__(); _v_;})
+    #define atomic_sub(ptr, value) ({__atomic_fallback_lock__(); __typeof__(*(ptr)) _v_ = *(ptr); *(ptr) = _v_ - (value); __atomic_fallback_unlock__(); _v_;})
+    #define atomic_cas(ptr, expected, desired) ({__atomic_fallback_lock__(); int _ok_ = (*(ptr) == *(expected)); if (_ok_) *(ptr) = (desired); else *(expected) = *(ptr); __atomic_fallback_unlock__(); _ok_;})
+    #define atomic_fence() do {__atomic_fallback_lock__(); __atomic_fallback_unlock__();} while (0)
+#endif
+
+
+#if (defined(__GNUC__) || defined(__clang__)) && !defined(__TINYC__) && (defined(__x86_64__) || defined(__i386__))
+    #define atomic_pause() __builtin_ia32_pause()
+#elif (defined(__GNUC__) || defined(__clang__)) && !defined(__TINYC__) && (defined(__aarch64__) || defined(__arm__))
+    #define atomic_pause() __asm__ __volatile__("yield")
+#else
+    #define atomic_pause() do {} while (0)
+#endif
+
+
+#endif
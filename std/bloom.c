@@ -0,0 +1,72 @@
+#include "bloom.h"
+
+
+BloomFilter *bloom_create(unsigned long long n_elements) {
+    unsigned long long n_blocks = 1;
+    while (n_blocks * BLOOM_BLOCK_COUNTERS < n_elements * BLOOM_COUNTERS_PER_ELEMENT) n_blocks = n_blocks * 2;
+
+    BloomFilter *bloom = (BloomFilter *)calloc(1, sizeof(BloomFilter));
+    if (!bloom) return NULL;
+    bloom->memory = calloc(n_blocks * BLOOM_BLOCK_SIZE + BLOOM_BLOCK_SIZE - 1, 1);
+    if (!bloom->memory) {
+        free(bloom);
+        return NULL;
+    }
+    bloom->blocks = (unsigned char *)(((unsigned long long)bloom->memory + BLOOM_BLOCK_SIZE - 1) & ~(unsigned long long)(BLOOM_BLOCK_SIZE - 1));
+    bloom->n_blocks = n_blocks;
+    return bloom;
+}
+
+
+void bloom_destroy(BloomFilter *bloom) {
+    if (!bloom) return;
+    free(bloom->memory);
+    free(bloom);
+}
+
+
+unsigned char *__bloom_block__(BloomFilter *bloom, unsigned long long *hash) {
+    // Callers pass the hash of their own table, remixing keeps the filter independent of the bucket index bits.
+    unsigned long long h = hash_integer(*hash);
+    *hash = h;
+    return bloom->blocks + ((h >> 32) & (bloom->n_blocks - 1)) * BLOOM_BLOCK_SIZE;
+}
+
+
+void bloom_add(BloomFilter *bloom, unsigned long long hash) {
+    unsigned char *block = __bloom_block__(bloom, &hash);
+    for (int i = 0; i < BLOOM_HASHES; i++) {
+        unsigned int counter = (unsigned int)(hash >> (7 * i)) & (BLOOM_BLOCK_COUNTERS - 1);
+        unsigned char *byte = &block[counter >> 1];
+        int shift = (counter & 1) * 4;
+        if (((*byte >> shift) & 0x0F) < BLOOM_COUNTER_MAX) *byte = *byte + (1 << shift);
+    }
+}
+
+
+void bloom_remove(BloomFilter *bloom, unsigned long long hash) {
+    unsigned char *block = __bloom_block__(bloom, &hash);
+    for (int i = 0; i < BLOOM_HASHES; i++) {
+        unsigned int counter = (unsigned int)(hash >> (7 * i)) & (BLOOM_BLOCK_COUNTERS - 1);
+        unsigned char *byte = &block[counter >> 1];
+        int shift = (counter & 1) * 4;
+        unsigned int value = (*byte >> shift) & 0x0F;
+        // A saturated counter has lost its exact count, it stays set until the owner rebuilds the filter.
+        if (value > 0 && value < BLOOM_COUNTER_MAX) *byte = *byte - (1 << shift);
+    }
+}
+
+
+int bloom_check(BloomFilter *bloom, unsigned long long hash) {
+    unsigned char *block = __bloom_block__(bloom, &hash);
+    for (int i = 0; i < BLOOM_HASHES; i++) {
+        unsigned int counter = (unsigned int)(hash >> (7 * i)) & (BLOOM_BLOCK_COUNTERS - 1);
+        if (((block[counter >> 1] >> ((counter & 1) * 4)) & 0x0F) == 0) return 0;
+    }
+    return 1;
+}
+
+
+void bloom_view(BloomFilter *bloom) {
+    printf("BloomFilter Information: blocks = %llu, bytes = %llu, skipped = %llu, false_positives = %llu\n", bloom->n_blocks, bloom->n_blocks * BLOOM_BLOCK_SIZE, bloom->skipped, bloom->false_positives);
+}
@@ -0,0 +1,85 @@
+#ifndef _BLOOM_H_
+#define _BLOOM_H_
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+#include "hash.h"
+
+
+#define BLOOM_BLOCK_SIZE 64                 // One cache line per lookup, every probe of a key lands in the same block.
+#define BLOOM_BLOCK_COUNTERS (BLOOM_BLOCK_SIZE * 2)     // 4-bit counters, two per byte.
+#define BLOOM_COUNTERS_PER_ELEMENT 8        // About 3% false positives with `BLOOM_HASHES` probes.
+#define BLOOM_HASHES 4
+#define BLOOM_COUNTER_MAX 15                // A saturated counter is never decremented again (no false negatives).
+
+
+typedef struct {
+    unsigned char *blocks;      // Aligned to `BLOOM_BLOCK_SIZE`.
+    void *memory;               // The allocation returned by `malloc`.
+    unsigned long long n_blocks;    // Always a power of two.
+    unsigned long long skipped;     // Lookups answered by the filter alone (the main table was never touched).
+    unsigned long long false_positives;     // Lookups the filter let through that missed the main table.
+} BloomFilter;
+
+
+/**
+ * @brief Create a counting blocked Bloom filter.
+ * @param n_elements The number of elements the filter is sized for.
+ * @return The pointer of filter (`NULL` for failure).
+**/
+BloomFilter *bloom_create(unsigned long long n_elements);
+
+
+/**
+ * @brief Free the memory of filter.
+ * @param bloom The pointer of filter.
+**/
+void bloom_destroy(BloomFilter *bloom);
+
+
+/**
+ * @brief Add an element by its hash value.
+ * @param bloom The pointer of filter.
+ * @param hash The hash value of element.
+**/
+void bloom_add(BloomFilter *bloom, unsigned long long hash);
+
+
+/**
+ * @brief Remove an element added before by its hash value.
+ * @param bloom The pointer of filter.
+ * @param hash The hash value of element.
+**/
+void bloom_remove(BloomFilter *bloom, unsigned long long hash);
+
+
+/**
+ * @brief Test an element by its hash value (the counters `skipped` and `false_positives` are left to the caller).
+ * @param bloom The pointer of filter.
+ * @param hash The hash value of element.
+ * @return `0` for definitely absent, `1` for possibly present.
+**/
+int bloom_check(BloomFilter *bloom, unsigned long long hash);
+
+
+/**
+ * @brief Print the size and the counters of filter.
+ * @param bloom The pointer of filter.
+**/
+void bloom_view(BloomFilter *bloom);
+
+
+/**
+ * @brief Remix a hash value and locate its block.
+ * @param bloom The pointer of filter.
+ * @param hash The hash value of element (on return, the bits selecting the counters inside the block).
+ * @return The first byte of block.
+**/
+unsigned char *__bloom_block__(BloomFilter *bloom, unsigned long long *hash);
+
+
+#endif
@@ -0,0 +1,303 @@
+#include "concurrent_hashmap.h"
+
+
+ConcurrentHashMap *concurrent_hashmap_create(int n_shards) {
+    unsigned long long shards = 1;
+    if (n_shards <= 0) n_shards = CONCURRENT_HASHMAP_SHARDS;
+    while (shards < (unsigned long long)n_shards) shards = shards * 2;
+
+    ConcurrentHashMap *map = (ConcurrentHashMap *)calloc(1, sizeof(ConcurrentHashMap));
+    if (!map) return NULL;
+    map->shards = (_ConcurrentShard *)calloc(shards, sizeof(_ConcurrentShard));
+    if (!map->shards) {
+        free(map);
+        return NULL;
+    }
+    map->n_shards = shards;
+    map->epoch = 1;
+
+    for (unsigned long long i = 0; i < shards; i++) {
+        _ConcurrentShard *shard = &map->shards[i];
+        shard->reclaim_threshold = CONCURRENT_HASHMAP_RECLAIM_BATCH;
+        shard->table = (_ConcurrentTable *)calloc(1, sizeof(_ConcurrentTable));
+        if (shard->table) {
+            shard->table->bucket = 8;
+            shard->table->slots = (_ConcurrentNode **)calloc(shard->table->bucket, sizeof(_ConcurrentNode *));
+        }
+        if (!shard->table || !shard->table->slots || mutex_create(&shard->lock, 1) != 0) {
+            if (shard->table) free(shard->table->slots);
+            free(shard->table);
+            shard->table = NULL;
+            map->n_shards = i;
+            concurrent_hashmap_destroy(map);
+            return NULL;
+        }
+    }
+    return map;
+}
+
+
+_ConcurrentReader *__concurrent_hashmap_enter__(ConcurrentHashMap *map) {
+    unsigned long long index = hash_integer(thread_id()) & (CONCURRENT_HASHMAP_READERS - 1);
+    while (1) {
+        unsigned long long epoch = atomic_get(&map->epoch);
+        unsigned long long idle = 0;
+        _ConcurrentReader *reader = &map->readers[index];
+        if (atomic_get_relaxed(&reader->epoch) == 0 && atomic_cas(&reader->epoch, &idle, epoch)) {
+            // Order the slot publication before every pointer the reader loads afterwards.
+            atomic_fence();
+            return reader;
+        }
+        index = (index + 1) & (CONCURRENT_HASHMAP_READERS - 1);
+        atomic_pause();
+    }
+}
+
+
+void __concurrent_hashmap_leave__(_ConcurrentReader *reader) {
+    atomic_set(&reader->epoch, 0ULL);
+}
+
+
+_ConcurrentNode *__concurrent_hashmap_node__(char *key, char *value, unsigned long long hash) {
+    unsigned long long key_length = strlen(key);
+    unsigned long long value_length = strlen(value);
+    _ConcurrentNode *node = (_ConcurrentNode *)malloc(sizeof(_ConcurrentNode) + key_length + value_length + 2);
+    if (!node) return NULL;
+    node->next = NULL;
+    node->retired = NULL;
+    node->retire_epoch = 0;
+    node->hash = hash;
+    node->key = (char *)(node + 1);
+    node->value = node->key + key_length + 1;
+    memcpy(node->key, key, key_length + 1);
+    memcpy(node->value, value, value_length + 1);
+    return node;
+}
+
+
+void __concurrent_hashmap_retire__(ConcurrentHashMap *map, _ConcurrentShard *shard, _ConcurrentNode *node) {
+    atomic_fence();
+    node->retire_epoch = atomic_get(&map->epoch);
+    node->retired = shard->retired_nodes;
+    shard->retired_nodes = node;
+    shard->n_retired++;
+    if (shard->n_retired >= shard->reclaim_threshold) __concurrent_hashmap_reclaim__(map, shard);
+}
+
+
+void __concurrent_hashmap_reclaim__(ConcurrentHashMap *map, _ConcurrentShard *shard) {
+    // Readers entering from now on see the new epoch, and they can no longer reach anything retired before it.
+    unsigned long long oldest = atomic_add(&map->epoch, 1ULL) + 1;
+    atomic_fence();
+    for (int i = 0; i < CONCURRENT_HASHMAP_READERS; i++) {
+        unsigned long long epoch = atomic_get(&map->readers[i].epoch);
+        if (epoch != 0 && epoch < oldest) oldest = epoch;
+    }
+
+    _ConcurrentNode **link = &shard->retired_nodes;
+    while (*link) {
+        _ConcurrentNode *node = *link;
+        if (node->retire_epoch < oldest) {
+            *link = node->retired;
+            free(node);
+            shard->n_retired--;
+        } else link = &node->retired;
+    }
+
+    _ConcurrentTable **table_link = &shard->retired_tables;
+    while (*table_link) {
+        _ConcurrentTable *table = *table_link;
+        if (table->retire_epoch < oldest) {
+            *table_link = table->retired;
+            free(table->slots);
+            free(table);
+        } else table_link = &table->retired;
+    }
+    shard->reclaim_threshold = shard->n_retired + CONCURRENT_HASHMAP_RECLAIM_BATCH;
+}
+
+
+int __concurrent_hashmap_expand__(ConcurrentHashMap *map, _ConcurrentShard *shard) {
+    _ConcurrentTable *old_table = shard->table;
+    _ConcurrentTable *table = (_ConcurrentTable *)calloc(1, sizeof(_ConcurrentTable));
+    if (!table) return 1;
+    table->bucket = old_table->bucket * 2;
+    table->slots = (_ConcurrentNode **)calloc(table->bucket, sizeof(_ConcurrentNode *));
+    if (!table->slots) {
+        free(table);
+        return 1;
+    }
+
+    // Readers may still walk the old chains, so the nodes are copied instead of relinked.
+    for (unsigned long long i = 0; i < old_table->bucket; i++) {
+        for (_ConcurrentNode *node = old_table->slots[i]; node; node = node->next) {
+            _ConcurrentNode *copy = __concurrent_hashmap_node__(node->key, node->value, node->hash);
+            if (!copy) {
+                for (unsigned long long j = 0; j < table->bucket; j++) {
+                    _ConcurrentNode *temp = table->slots[j];
+                    while (temp) {
+                        _ConcurrentNode *next = temp->next;
+                        free(temp);
+                        temp = next;
+                    }
+                }
+                free(table->slots);
+                free(table);
+                return 1;
+            }
+            unsigned long long index = copy->hash & (table->bucket - 1);
+            copy->next = table->slots[index];
+            table->slots[index] = copy;
+        }
+    }
+    atomic_set(&shard->table, table);
+    atomic_fence();
+
+    // Retire the whole old table at once and run a single reclamation pass afterwards.
+    unsigned long long epoch = atomic_get(&map->epoch);
+    for (unsigned long long i = 0; i < old_table->bucket; i++) {
+        for (_ConcurrentNode *node = old_table->slots[i]; node; node = node->next) {
+            node->retire_epoch = epoch;
+            node->retired = shard->retired_nodes;
+            shard->retired_nodes = node;
+            shard->n_retired++;
+        }
+    }
+    old_table->retire_epoch = epoch;
+    old_table->retired = shard->retired_tables;
+    shard->retired_tables = old_table;
+    if (shard->n_retired >= shard->reclaim_threshold) __concurrent_hashmap_reclaim__(map, shard);
+    return 0;
+}
+
+
+int concurrent_hashmap_put(ConcurrentHashMap *map, char *key, char *value) {
+    if (!map || !key || !value) return 1;
+    unsigned long long hash = hash_string(key);
+    _ConcurrentShard *shard = &map->shards[(hash >> 32) & (map->n_shards - 1)];
+
+    // Allocate outside of the lock to keep the critical section short.
+    _ConcurrentNode *node = __concurrent_hashmap_node__(key, value, hash);
+    if (!node) return 1;
+
+    mutex_lock(&shard->lock);
+    if (shard->count >= shard->table->bucket * 3 / 4) __concurrent_hashmap_expand__(map, shard);
+
+    _ConcurrentTable *table = shard->table;
+    _ConcurrentNode **link = &table->slots[hash & (table->bucket - 1)];
+    _ConcurrentNode *current = *link;
+    while (current) {
+        if (current->hash == hash && strcmp(current->key, key) == 0) {
+            // Nodes are immutable, an update publishes a replacement in the same position.
+            node->next = current->next;
+            atomic_set(link, node);
+            __concurrent_hashmap_retire__(map, shard, current);
+            mutex_unlock(&shard->lock);
+            return 0;
+        }
+        link = &current->next;
+        current = *link;
+    }
+
+    node->next = table->slots[hash & (table->bucket - 1)];
+    atomic_set(&table->slots[hash & (table->bucket - 1)], node);
+    shard->count++;
+    mutex_unlock(&shard->lock);
+    return 0;
+}
+
+
+int concurrent_hashmap_get(ConcurrentHashMap *map, char *key, char *buffer, int size) {
+    if (!map || !key) return -1;
+    unsigned long long hash = hash_string(key);
+    _ConcurrentShard *shard = &map->shards[(hash >> 32) & (map->n_shards - 1)];
+    int length = -1;
+
+    _ConcurrentReader *reader = __concurrent_hashmap_enter__(map);
+    _ConcurrentTable *table = atomic_get(&shard->table);
+    _ConcurrentNode *node = atomic_get(&table->slots[hash & (table->bucket - 1)]);
+    while (node) {
+        if (node->hash == hash && strcmp(node->key, key) == 0) {
+            length = (int)strlen(node->value);
+            // Copy while the epoch still protects the node.
+            if (buffer && size > 0) {
+                int n = length < size - 1 ? length : size - 1;
+                memcpy(buffer, node->value, n);
+                buffer[n] = '\0';
+            }
+            break;
+        }
+        node = atomic_get(&node->next);
+    }
+    __concurrent_hashmap_leave__(reader);
+    return length;
+}
+
+
+int concurrent_hashmap_remove(ConcurrentHashMap *map, char *key) {
+    if (!map || !key) return 1;
+    unsigned long long hash = hash_string(key);
+    _ConcurrentShard *shard = &map->shards[(hash >> 32) & (map->n_shards - 1)];
+
+    mutex_lock(&shard->lock);
+    _ConcurrentTable *table = shard->table;
+    _ConcurrentNode **link = &table->slots[hash & (table->bucket - 1)];
+    _ConcurrentNode *current = *link;
+    while (current) {
+        if (current->hash == hash && strcmp(current->key, key) == 0) {
+            atomic_set(link, current->next);
+            shard->count--;
+            __concurrent_hashmap_retire__(map, shard, current);
+            mutex_unlock(&shard->lock);
+            return 0;
+        }
+        link = &current->next;
+        current = *link;
+    }
+    mutex_unlock(&shard->lock);
+    return 1;   // The key does not exist in the ConcurrentHashMap.
+}
+
+
+unsigned long long concurrent_hashmap_count(ConcurrentHashMap *map) {
+    unsigned long long count = 0;
+    for (unsigned long long i = 0; i < map->n_shards; i++) {
+        mutex_lock(&map->shards[i].lock);
+        count = count + map->shards[i].count;
+        mutex_unlock(&map->shards[i].lock);
+    }
+    return count;
+}
+
+
+void concurrent_hashmap_destroy(ConcurrentHashMap *map) {
+    if (!map) return;
+    for (unsigned long long i = 0; i < map->n_shards; i++) {
+        _ConcurrentShard *shard = &map->shards[i];
+        for (unsigned long long j = 0; j < shard->table->bucket; j++) {
+            _ConcurrentNode *node = shard->table->slots[j];
+            while (node) {
+                _ConcurrentNode *next = node->next;
+                free(node);
+                node = next;
+            }
+        }
+        free(shard->table->slots);
+        free(shard->table);
+        while (shard->retired_nodes) {
+            _ConcurrentNode *next = shard->retired_nodes->retired;
+            free(shard->retired_nodes);
+            shard->retired_nodes = next;
+        }
+        while (shard->retired_tables) {
+            _ConcurrentTable *next = shard->retired_tables->retired;
+            free(shard->retired_tables->slots);
+            free(shard->retired_tables);
+            shard->retired_tables = next;
+        }
+        mutex_destroy(&shard->lock);
+    }
+    free(map->shards);
+    free(map);
+}
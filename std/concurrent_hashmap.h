@@ -0,0 +1,168 @@
+#ifndef _CONCURRENT_HASHMAP_H_
+#define _CONCURRENT_HASHMAP_H_
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+#include "hash.h"
+#include "atomic.h"
+#include "thread.h"
+
+
+#define CONCURRENT_HASHMAP_SHARDS 16            // Default number of independently locked shards.
+#define CONCURRENT_HASHMAP_READERS 128          // Reader epoch slots (more than the expected number of concurrent readers).
+#define CONCURRENT_HASHMAP_RECLAIM_BATCH 64     // Retired objects per shard before a reclamation pass.
+
+
+typedef struct _ConcurrentNode {
+    struct _ConcurrentNode *next;       // Published with release stores, readers traverse without locks.
+    struct _ConcurrentNode *retired;    // The link of the shard's retire list.
+    unsigned long long retire_epoch;
+    unsigned long long hash;
+    char *key;      // Key and value live in the same allocation as the node, and never change after publication.
+    char *value;
+} _ConcurrentNode;
+
+
+typedef struct _ConcurrentTable {
+    struct _ConcurrentTable *retired;
+    unsigned long long retire_epoch;
+    unsigned long long bucket;
+    _ConcurrentNode **slots;
+} _ConcurrentTable;
+
+
+typedef struct {
+    Mutex lock;     // Serializes the writers of one shard only.
+    _ConcurrentTable *table;
+    unsigned long long count;
+    _ConcurrentNode *retired_nodes;
+    _ConcurrentTable *retired_tables;
+    unsigned long long n_retired;
+    unsigned long long reclaim_threshold;   // Grows with the survivors, so a long-lived reader cannot make every retire rescan.
+    char padding[ATOMIC_CACHE_LINE];
+} _ConcurrentShard;
+
+
+typedef struct {
+    unsigned long long epoch;   // `0` for an idle slot, otherwise the global epoch seen when the reader entered.
+    char padding[ATOMIC_CACHE_LINE - sizeof(unsigned long long)];
+} _ConcurrentReader;
+
+
+typedef struct {
+    _ConcurrentShard *shards;
+    unsigned long long n_shards;
+    unsigned long long epoch;
+    _ConcurrentReader readers[CONCURRENT_HASHMAP_READERS];
+} ConcurrentHashMap;
+
+
+/**
+ * @brief Create a thread-safe HashMap whose keys are sharded across independently locked sub-tables.
+ * @param n_shards The number of shards (rounded up to a power of two, `0` for `CONCURRENT_HASHMAP_SHARDS`).
+ * @return The pointer to the new ConcurrentHashMap (`NULL` for failure).
+**/
+ConcurrentHashMap *concurrent_hashmap_create(int n_shards);
+
+
+/**
+ * @brief Insert or update a key-value pair (locks the shard of the key only).
+ * @param map The ConcurrentHashMap.
+ * @param key The string key.
+ * @param value The string value.
+ * @return `0` for success, `1` for failure.
+**/
+int concurrent_hashmap_put(ConcurrentHashMap *map, char *key, char *value);
+
+
+/**
+ * @brief Copy the value of a key without taking any lock.
+ * @param map The ConcurrentHashMap.
+ * @param key The string key.
+ * @param buffer Receive the value (truncated like `snprintf`, `NULL` for a membership test).
+ * @param size The size of buffer.
+ * @return The length of value, `-1` for nonexistence.
+**/
+int concurrent_hashmap_get(ConcurrentHashMap *map, char *key, char *buffer, int size);
+
+
+/**
+ * @brief Remove a key-value pair.
+ * @param map The ConcurrentHashMap.
+ * @param key The string key.
+ * @return 0 --> success; 1 --> failed.
+**/
+int concurrent_hashmap_remove(ConcurrentHashMap *map, char *key);
+
+
+/**
+ * @brief Count the key-value pairs (a snapshot, shards are read one by one).
+ * @param map The ConcurrentHashMap.
+ * @return The number of key-value pairs.
+**/
+unsigned long long concurrent_hashmap_count(ConcurrentHashMap *map);
+
+
+/**
+ * @brief Free the memory of ConcurrentHashMap (no other thread may use it any more).
+ * @param map The ConcurrentHashMap.
+**/
+void concurrent_hashmap_destroy(ConcurrentHashMap *map);
+
+
+/**
+ * @brief Enter a read-side critical section by publishing the current epoch in a free reader slot.
+ * @param map The ConcurrentHashMap.
+ * @return The reader slot to pass to `__concurrent_hashmap_leave__`.
+**/
+_ConcurrentReader *__concurrent_hashmap_enter__(ConcurrentHashMap *map);
+
+
+/**
+ * @brief Leave a read-side critical section.
+ * @param reader The reader slot.
+**/
+void __concurrent_hashmap_leave__(_ConcurrentReader *reader);
+
+
+/**
+ * @brief Allocate a node together with copies of its key and value.
+ * @param key The string key.
+ * @param value The string value.
+ * @param hash The hash value of key.
+ * @return The pointer of node (`NULL` for failure).
+**/
+_ConcurrentNode *__concurrent_hashmap_node__(char *key, char *value, unsigned long long hash);
+
+
+/**
+ * @brief Retire a node unlinked from a shard, it is freed once no reader can still hold it.
+ * @param map The ConcurrentHashMap.
+ * @param shard The locked shard.
+ * @param node The unlinked node.
+**/
+void __concurrent_hashmap_retire__(ConcurrentHashMap *map, _ConcurrentShard *shard, _ConcurrentNode *node);
+
+
+/**
+ * @brief Free the retired objects of a shard that are older than every active reader.
+ * @param map The ConcurrentHashMap.
+ * @param shard The locked shard.
+**/
+void __concurrent_hashmap_reclaim__(ConcurrentHashMap *map, _ConcurrentShard *shard);
+
+
+/**
+ * @brief Double the buckets of a shard by publishing a copied table (old table and nodes are retired).
+ * @param map The ConcurrentHashMap.
+ * @param shard The locked shard.
+ * @return `0` for success, `1` for failure.
+**/
+int __concurrent_hashmap_expand__(ConcurrentHashMap *map, _ConcurrentShard *shard);
+
+
+#endif
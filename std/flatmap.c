@@ -0,0 +1,169 @@
+#include "flatmap.h"
+
+
+unsigned long long __flatmap_find_free__(FlatMap *dict, unsigned long long hash) {
+    unsigned long long n_groups = dict->capacity / FLATMAP_GROUP_WIDTH;
+    unsigned long long group = (hash >> 7) & (n_groups - 1);
+    // Triangular probing over whole groups visits every group once when `n_groups` is a power of two.
+    for (unsigned long long step = 1; ; step++) {
+        unsigned int mask = hash_group_free(dict->ctrl + group * FLATMAP_GROUP_WIDTH);
+        if (mask) return group * FLATMAP_GROUP_WIDTH + hash_ctz(mask);
+        group = (group + step) & (n_groups - 1);
+    }
+}
+
+
+int __flatmap_rehash__(FlatMap *dict, unsigned long long capacity) {
+    signed char *ctrl = (signed char *)malloc(capacity);
+    _FlatMapSlot *slots = (_FlatMapSlot *)malloc(capacity * sizeof(_FlatMapSlot));
+    if (!ctrl || !slots) {
+        free(ctrl);
+        free(slots);
+        return 1;
+    }
+    memset(ctrl, FLATMAP_CTRL_EMPTY, capacity);
+
+    signed char *old_ctrl = dict->ctrl;
+    _FlatMapSlot *old_slots = dict->slots;
+    unsigned long long old_capacity = dict->capacity;
+
+    dict->ctrl = ctrl;
+    dict->slots = slots;
+    dict->capacity = capacity;
+    dict->deleted = 0;
+
+    for (unsigned long long i = 0; i < old_capacity; i++) {
+        if (old_ctrl[i] < 0) continue;
+        // The stored hash makes the move a pure memory operation.
+        unsigned long long index = __flatmap_find_free__(dict, old_slots[i].hash);
+        dict->ctrl[index] = old_ctrl[i];
+        dict->slots[index] = old_slots[i];
+    }
+    free(old_ctrl);
+    free(old_slots);
+    return 0;
+}
+
+
+long long __flatmap_find__(FlatMap *dict, char *key, unsigned long long hash) {
+    unsigned long long n_groups = dict->capacity / FLATMAP_GROUP_WIDTH;
+    unsigned long long group = (hash >> 7) & (n_groups - 1);
+    signed char tag = (signed char)(hash & 0x7F);
+
+    for (unsigned long long step = 1; step <= n_groups; step++) {
+        signed char *ctrl = dict->ctrl + group * FLATMAP_GROUP_WIDTH;
+        unsigned int mask = hash_group_match(ctrl, tag);
+        while (mask) {
+            unsigned long long index = group * FLATMAP_GROUP_WIDTH + hash_ctz(mask);
+            _FlatMapSlot *slot = &dict->slots[index];
+            if (slot->hash == hash && strcmp(slot->key, key) == 0) return (long long)index;
+            mask = mask & (mask - 1);
+        }
+        // A group with an empty slot terminates every probe sequence passing through it.
+        if (hash_group_match(ctrl, FLATMAP_CTRL_EMPTY)) return -1;
+        group = (group + step) & (n_groups - 1);
+    }
+    return -1;
+}
+
+
+FlatMap *flatmap_create() {
+    FlatMap *dict = (FlatMap *)calloc(1, sizeof(FlatMap));
+    if (!dict) return NULL;
+    if (__flatmap_rehash__(dict, FLATMAP_MIN_CAPACITY) != 0) {
+        free(dict);
+        return NULL;
+    }
+    return dict;
+}
+
+
+void flatmap_put(FlatMap *dict, char *key, char *value) {
+    unsigned long long hash = hash_string(key);
+    unsigned long long key_length = strlen(key);
+    unsigned long long value_length = strlen(value);
+    long long index = __flatmap_find__(dict, key, hash);
+
+    // Copy before releasing the old block, `value` may point into it.
+    char *block = (char *)malloc(key_length + value_length + 2);
+    if (!block) return;
+    memcpy(block, key, key_length + 1);
+    memcpy(block + key_length + 1, value, value_length + 1);
+
+    if (index >= 0) {
+        free(dict->slots[index].key);
+        dict->slots[index].key = block;
+        dict->slots[index].value = block + key_length + 1;
+        return;
+    }
+
+    // Keep the load factor (tombstones included) below 7/8 so that every probe meets an empty group.
+    if ((dict->count + dict->deleted + 1) * 8 > dict->capacity * 7) {
+        unsigned long long capacity = dict->capacity;
+        if ((dict->count + 1) * 16 > dict->capacity * 7) capacity = capacity * 2;
+        if (__flatmap_rehash__(dict, capacity) != 0) {
+            free(block);
+            return;
+        }
+    }
+
+    unsigned long long free_index = __flatmap_find_free__(dict, hash);
+    if (dict->ctrl[free_index] == FLATMAP_CTRL_DELETED) dict->deleted--;
+    dict->ctrl[free_index] = (signed char)(hash & 0x7F);
+    dict->slots[free_index].key = block;
+    dict->slots[free_index].value = block + key_length + 1;
+    dict->slots[free_index].hash = hash;
+    dict->count++;
+}
+
+
+char *flatmap_get(FlatMap *dict, char *key) {
+    long long index = __flatmap_find__(dict, key, hash_string(key));
+    return index >= 0 ? dict->slots[index].value : NULL;
+}
+
+
+int flatmap_remove(FlatMap *dict, char *key) {
+    // The dictionary is empty or the key is NULL.
+    if ((dict->count == 0) || (!key)) return 1;
+
+    long long index = __flatmap_find__(dict, key, hash_string(key));
+    if (index < 0) return 1;
+
+    free(dict->slots[index].key);
+    signed char *group = dict->ctrl + (index & ~(long long)(FLATMAP_GROUP_WIDTH - 1));
+    // No probe sequence continues past a group that still has an empty slot, so no tombstone is needed.
+    if (hash_group_match(group, FLATMAP_CTRL_EMPTY)) dict->ctrl[index] = FLATMAP_CTRL_EMPTY;
+    else {
+        dict->ctrl[index] = FLATMAP_CTRL_DELETED;
+        dict->deleted++;
+    }
+    dict->count--;
+
+    if (dict->capacity > FLATMAP_MIN_CAPACITY && dict->count * 4 <= dict->capacity) __flatmap_rehash__(dict, dict->capacity / 2);
+    return 0;
+}
+
+
+void flatmap_destroy(FlatMap *dict) {
+    for (unsigned long long i = 0; i < dict->capacity; i++) if (dict->ctrl[i] >= 0) free(dict->slots[i].key);
+    free(dict->ctrl);
+    free(dict->slots);
+    free(dict);
+}
+
+
+void flatmap_view(FlatMap *dict) {
+    for (unsigned long long g = 0; g < dict->capacity / FLATMAP_GROUP_WIDTH; g++) {
+        printf("group_%llu --> ", g);
+        int first = 1;
+        for (unsigned long long i = g * FLATMAP_GROUP_WIDTH; i < (g + 1) * FLATMAP_GROUP_WIDTH; i++) {
+            if (dict->ctrl[i] < 0) continue;
+            if (!first) printf(", ");
+            first = 0;
+            printf("{\x1b[35m%s\x1b[0m: \x1b[34m%s\x1b[0m}", dict->slots[i].key, dict->slots[i].value);
+        }
+        printf("%s\n", first ? "(null)" : "");
+    }
+    printf("FlatMap Dictionary Information: capacity = %llu, count = %llu, deleted = %llu, load_factor = %.2f%%\n", dict->capacity, dict->count, dict->deleted, 100.0F * dict->count / dict->capacity);
+}
@@ -0,0 +1,111 @@
+#ifndef _FLATMAP_H_
+#define _FLATMAP_H_
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+#include "hash.h"
+
+
+#define FLATMAP_GROUP_WIDTH HASH_GROUP_WIDTH
+#define FLATMAP_MIN_CAPACITY 16
+#define FLATMAP_CTRL_EMPTY ((signed char)-128)     // 0b10000000
+#define FLATMAP_CTRL_DELETED ((signed char)-2)     // 0b11111110
+
+
+typedef struct {
+    char *key;      // The key and value share one allocation: "key\0value\0".
+    char *value;
+    unsigned long long hash;
+} _FlatMapSlot;
+
+
+typedef struct {
+    signed char *ctrl;      // Full slots keep the low 7 bits of the hash, so the sign bit marks empty or deleted.
+    _FlatMapSlot *slots;
+    unsigned long long capacity;
+    unsigned long long count;
+    unsigned long long deleted;
+} FlatMap;
+
+
+/**
+ * @brief Find the first free slot on the probe sequence of a hash value.
+ * @param dict The FlatMap dictionary.
+ * @param hash The hash value of key.
+ * @return The slot index.
+**/
+unsigned long long __flatmap_find_free__(FlatMap *dict, unsigned long long hash);
+
+
+/**
+ * @brief Rebuild the FlatMap with a new capacity, reusing the stored hash values.
+ * @param dict The FlatMap dictionary.
+ * @param capacity The new capacity (power of two).
+ * @return `0` for success, `1` for failure.
+**/
+int __flatmap_rehash__(FlatMap *dict, unsigned long long capacity);
+
+
+/**
+ * @brief Find the slot index of a key.
+ * @param dict The FlatMap dictionary.
+ * @param key The string key.
+ * @param hash The hash value of key.
+ * @return The slot index, `-1` for nonexistence.
+**/
+long long __flatmap_find__(FlatMap *dict, char *key, unsigned long long hash);
+
+
+/**
+ * @brief Create a new FlatMap dictionary (open addressing, drop-in for `hashmap_create`).
+ * @return The pointer to the new FlatMap dictionary.
+**/
+FlatMap *flatmap_create();
+
+
+/**
+ * @brief Insert a key-value pair into the FlatMap dictionary.
+ * @param dict The FlatMap dictionary.
+ * @param key The string key.
+ * @param value The string value.
+**/
+void flatmap_put(FlatMap *dict, char *key, char *value);
+
+
+/**
+ * @brief Get the value in the FlatMap dictionary by key.
+ * @param dict The FlatMap dictionary.
+ * @param key The string key.
+ * @return The string value.
+**/
+char *flatmap_get(FlatMap *dict, char *key);
+
+
+/**
+ * @brief Remove a key-value pair from the FlatMap dictionary.
+ * @param dict The FlatMap dictionary.
+ * @param key The string key.
+ * @return 0 --> success; 1 --> failed.
+**/
+int flatmap_remove(FlatMap *dict, char *key);
+
+
+/**
+ * @brief Free the memory of FlatMap dictionary.
+ * @param dict The FlatMap dictionary.
+**/
+void flatmap_destroy(FlatMap *dict);
+
+
+/**
+ * @brief View the data structure of the FlatMap dictionary.
+ * @param dict The FlatMap dictionary.
+**/
+void flatmap_view(FlatMap *dict);
+
+
+#endif
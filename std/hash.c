@@ -0,0 +1,138 @@
+#include "hash.h"
+
+
+const unsigned long long HASH_SECRET[4] = {0x2d358dccaa6c78a5ULL, 0x8bb84b93962eacc9ULL, 0x4b33a62ed433d4a3ULL, 0x4d5a2da51de1aa47ULL};
+
+
+void __hash_mum__(unsigned long long *a, unsigned long long *b) {
+    #if defined(__SIZEOF_INT128__) && !defined(__TINYC__)
+        __uint128_t r = (__uint128_t)*a * *b;
+        *a = (unsigned long long)r;
+        *b = (unsigned long long)(r >> 64);
+    #else
+        // Schoolbook multiplication on 32-bit halves (`tcc` has no 128-bit integer).
+        unsigned long long ha = *a >> 32, hb = *b >> 32, la = (unsigned int)*a, lb = (unsigned int)*b;
+        unsigned long long rh = ha * hb, rm0 = ha * lb, rm1 = hb * la, rl = la * lb;
+        unsigned long long t = rl + (rm0 << 32);
+        unsigned long long carry = t < rl;
+        unsigned long long lo = t + (rm1 << 32);
+        carry = carry + (lo < t);
+        *a = lo;
+        *b = rh + (rm0 >> 32) + (rm1 >> 32) + carry;
+    #endif
+}
+
+
+unsigned long long __hash_mix__(unsigned long long a, unsigned long long b) {
+    __hash_mum__(&a, &b);
+    return a ^ b;
+}
+
+
+unsigned long long __hash_read8__(const unsigned char *p) {
+    unsigned long long v;
+    memcpy(&v, p, 8);
+    return v;
+}
+
+
+unsigned long long __hash_read4__(const unsigned char *p) {
+    unsigned int v;
+    memcpy(&v, p, 4);
+    return v;
+}
+
+
+unsigned long long hash_bytes(const void *data, unsigned long long length, unsigned long long seed) {
+    const unsigned char *p = (const unsigned char *)data;
+    unsigned long long a, b;
+    seed = seed ^ __hash_mix__(seed ^ HASH_SECRET[0], HASH_SECRET[1]);
+
+    if (length <= 16) {
+        if (length >= 4) {
+            // Two overlapping 4-byte reads from each end cover 4..16 bytes without a loop.
+            unsigned long long shift = (length >> 3) << 2;
+            a = (__hash_read4__(p) << 32) | __hash_read4__(p + shift);
+            b = (__hash_read4__(p + length - 4) << 32) | __hash_read4__(p + length - 4 - shift);
+        } else if (length > 0) {
+            a = ((unsigned long long)p[0] << 16) | ((unsigned long long)p[length >> 1] << 8) | p[length - 1];
+            b = 0;
+        } else {
+            a = 0;
+            b = 0;
+        }
+    } else {
+        unsigned long long i = length;
+        if (i > 48) {
+            // Three independent lanes keep the multiplier busy on long keys.
+            unsigned long long see1 = seed, see2 = seed;
+            do {
+                seed = __hash_mix__(__hash_read8__(p) ^ HASH_SECRET[1], __hash_read8__(p + 8) ^ seed);
+                see1 = __hash_mix__(__hash_read8__(p + 16) ^ HASH_SECRET[2], __hash_read8__(p + 24) ^ see1);
+                see2 = __hash_mix__(__hash_read8__(p + 32) ^ HASH_SECRET[3], __hash_read8__(p + 40) ^ see2);
+                p = p + 48;
+                i = i - 48;
+            } while (i > 48);
+            seed = seed ^ see1 ^ see2;
+        }
+        while (i > 16) {
+            seed = __hash_mix__(__hash_read8__(p) ^ HASH_SECRET[1], __hash_read8__(p + 8) ^ seed);
+            p = p + 16;
+            i = i - 16;
+        }
+        a = __hash_read8__(p + i - 16);
+        b = __hash_read8__(p + i - 8);
+    }
+
+    a = a ^ HASH_SECRET[1];
+    b = b ^ seed;
+    __hash_mum__(&a, &b);
+    return __hash_mix__(a ^ HASH_SECRET[0] ^ length, b ^ HASH_SECRET[1]);
+}
+
+
+unsigned long long hash_string(const char *str) {
+    return hash_bytes(str, strlen(str), 0);
+}
+
+
+unsigned long long hash_integer(unsigned long long x) {
+    return __hash_mix__(x ^ HASH_SECRET[0], HASH_SECRET[1]);
+}
+
+
+unsigned int hash_group_match(const signed char *group, signed char byte) {
+    #if defined(__HASH_SSE2__)
+        __m128i ctrl = _mm_loadu_si128((const __m128i *)group);
+        return (unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(ctrl, _mm_set1_epi8(byte)));
+    #else
+        unsigned int mask = 0;
+        for (int i = 0; i < HASH_GROUP_WIDTH; i++) if (group[i] == byte) mask |= 1U << i;
+        return mask;
+    #endif
+}
+
+
+unsigned int hash_group_free(const signed char *group) {
+    #if defined(__HASH_SSE2__)
+        return (unsigned int)_mm_movemask_epi8(_mm_loadu_si128((const __m128i *)group));
+    #else
+        unsigned int mask = 0;
+        for (int i = 0; i < HASH_GROUP_WIDTH; i++) if (group[i] < 0) mask |= 1U << i;
+        return mask;
+    #endif
+}
+
+
+int hash_ctz(unsigned int mask) {
+    #if defined(__GNUC__) && !defined(__TINYC__)
+        return __builtin_ctz(mask);
+    #else
+        int n = 0;
+        while (!(mask & 1U)) {
+            mask = mask >> 1;
+            n++;
+        }
+        return n;
+    #endif
+}
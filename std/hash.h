@@ -0,0 +1,118 @@
+#ifndef _HASH_H_
+#define _HASH_H_
+
+
+#include <string.h>
+
+
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+    #define __HASH_SSE2__
+    #include <emmintrin.h>
+#endif
+
+
+#define HASH_GROUP_WIDTH 16     // Control bytes probed at once by the open-addressing tables (one SSE2 register).
+
+
+/**
+ * @brief Hint the CPU to start loading a cache line that will be read soon (no-op without compiler support).
+ * @param ptr Any address, an invalid or `NULL` address never faults.
+**/
+#if (defined(__GNUC__) || defined(__clang__)) && !defined(__TINYC__)
+    #define hash_prefetch(ptr) __builtin_prefetch((const void *)(ptr), 0, 3)
+#else
+    #define hash_prefetch(ptr) ((void)(ptr))
+#endif
+
+
+/**
+ * The default secret of the word-at-a-time hash (wyhash style).
+**/
+extern const unsigned long long HASH_SECRET[4];
+
+
+/**
+ * @brief Multiply two 64-bit words into a 128-bit result.
+ * @param a The first word (low 64 bits of the product on return).
+ * @param b The second word (high 64 bits of the product on return).
+**/
+void __hash_mum__(unsigned long long *a, unsigned long long *b);
+
+
+/**
+ * @brief Fold the 128-bit product of two words into 64 bits.
+ * @param a The first word.
+ * @param b The second word.
+ * @return The mixed value.
+**/
+unsigned long long __hash_mix__(unsigned long long a, unsigned long long b);
+
+
+/**
+ * @brief Read 8 bytes (little-endian, unaligned).
+ * @param p The pointer of data.
+ * @return The 64-bit word.
+**/
+unsigned long long __hash_read8__(const unsigned char *p);
+
+
+/**
+ * @brief Read 4 bytes (little-endian, unaligned).
+ * @param p The pointer of data.
+ * @return The 32-bit word.
+**/
+unsigned long long __hash_read4__(const unsigned char *p);
+
+
+/**
+ * @brief Hash a memory block 8 or 16 bytes at a time.
+ * @param data The raw data.
+ * @param length The length of data.
+ * @param seed The seed (`0` for default).
+ * @return The 64-bit hash value.
+**/
+unsigned long long hash_bytes(const void *data, unsigned long long length, unsigned long long seed);
+
+
+/**
+ * @brief Hash a string (`'\0'` excluded).
+ * @param str The string.
+ * @return The 64-bit hash value.
+**/
+unsigned long long hash_string(const char *str);
+
+
+/**
+ * @brief Hash a 64-bit integer with a single multiply-fold.
+ * @param x The integer.
+ * @return The 64-bit hash value.
+**/
+unsigned long long hash_integer(unsigned long long x);
+
+
+/**
+ * @brief Compare a group of control bytes with a byte.
+ * @param group The first control byte of the group.
+ * @param byte The control byte to be matched.
+ * @return A bit mask whose bit `i` is set when `group[i] == byte`.
+**/
+unsigned int hash_group_match(const signed char *group, signed char byte);
+
+
+/**
+ * @brief Find the control bytes with the sign bit set (empty or deleted slots) in a group.
+ * @param group The first control byte of the group.
+ * @return A bit mask whose bit `i` is set when slot `i` is free.
+**/
+unsigned int hash_group_free(const signed char *group);
+
+
+/**
+ * @brief Count the trailing zero bits of a non-zero group mask.
+ * @param mask The group mask.
+ * @return The index of the lowest set bit.
+**/
+int hash_ctz(unsigned int mask);
+
+
+#endif
@@ -1,114 +1,479 @@
 #include "hashmap.h"
 
 
-unsigned int __hash_function_ELF__(char *str, int size) {
-    unsigned int hash = 0;
-    unsigned int x = 0;
-    while (*str) {
-        hash = (hash << 4) + *(str++);
-        if ((x = hash & 0xF0000000L) != 0) hash = hash ^ (x >> 24);
-        hash = hash & (~x);
-    }
-    return hash % size;
-}
-
-
 HashMap *hashmap_create() {
     int BUCKETS = 8;
     HashMap *dict = (HashMap *)malloc(sizeof(HashMap));
     dict->bucket = BUCKETS;
     dict->count = 0;
     dict->table = (Node **)calloc(BUCKETS, sizeof(Node *));
+    dict->arena = NULL;
+    dict->incremental = 0;
+    dict->old_table = NULL;
+    dict->old_bucket = 0;
+    dict->rehash_index = 0;
+    dict->next_table = NULL;
+    dict->next_zeroed = 0;
+    dict->bloom = NULL;
     return dict;
 }
 
 
-void __hashmap_expand__(HashMap *dict) {
+HashMap *hashmap_create_arena() {
+    HashMap *dict = hashmap_create();
+    dict->arena = (_HashMapArena *)calloc(1, sizeof(_HashMapArena));
+    if (!dict->arena) {
+        hashmap_destroy(dict);
+        return NULL;
+    }
+    return dict;
+}
+
+
+void *__hashmap_arena_alloc__(_HashMapArena *arena, unsigned long long size) {
+    size = (size + 7) & ~7ULL;
+    if (arena->cursor == NULL || (unsigned long long)(arena->limit - arena->cursor) < size) {
+        // Only nodes and size-class strings come here, the tail left behind is smaller than one of them.
+        unsigned long long capacity = size > HASHMAP_ARENA_SLAB_SIZE ? size : HASHMAP_ARENA_SLAB_SIZE;
+        _HashMapSlab *slab = (_HashMapSlab *)malloc(sizeof(_HashMapSlab) + 8 + capacity);
+        if (!slab) return NULL;
+        slab->next = arena->slabs;
+        arena->slabs = slab;
+        arena->cursor = (char *)slab + ((sizeof(_HashMapSlab) + 7) & ~7ULL);
+        arena->limit = arena->cursor + capacity;
+    }
+    void *memory = arena->cursor;
+    arena->cursor = arena->cursor + size;
+    return memory;
+}
+
+
+void *__hashmap_arena_block__(_HashMapArena *arena, unsigned long long size) {
+    _HashMapSlab *block = (_HashMapSlab *)malloc(sizeof(_HashMapSlab) + size);
+    if (!block) return NULL;
+    block->prev = NULL;
+    block->next = arena->blocks;
+    if (arena->blocks) arena->blocks->prev = block;
+    arena->blocks = block;
+    return block + 1;
+}
+
+
+void __hashmap_arena_block_free__(_HashMapArena *arena, void *memory) {
+    _HashMapSlab *block = (_HashMapSlab *)memory - 1;
+    if (block->prev) block->prev->next = block->next;
+    else arena->blocks = block->next;
+    if (block->next) block->next->prev = block->prev;
+    free(block);
+}
+
+
+Node *__hashmap_node_alloc__(HashMap *dict) {
+    if (!dict->arena) return (Node *)malloc(sizeof(Node));
+    Node *node = dict->arena->free_nodes;
+    if (node) {
+        dict->arena->free_nodes = node->next;
+        return node;
+    }
+    return (Node *)__hashmap_arena_alloc__(dict->arena, sizeof(Node));
+}
+
+
+void __hashmap_node_free__(HashMap *dict, Node *node) {
+    if (!dict->arena) {
+        free(node);
+        return;
+    }
+    node->next = dict->arena->free_nodes;
+    dict->arena->free_nodes = node;
+}
+
+
+char *__hashmap_strdup__(HashMap *dict, char *str) {
+    if (!dict->arena) return strdup(str);
+    unsigned long long length = strlen(str) + 1;
+    unsigned long long size_class = (length - 1) / HASHMAP_ARENA_CLASS_STEP;
+    char *copy = NULL;
+    if (size_class < HASHMAP_ARENA_CLASSES) {
+        // The size class is recomputed from `strlen` on release, so blocks carry no header.
+        copy = (char *)dict->arena->free_blocks[size_class];
+        if (copy) dict->arena->free_blocks[size_class] = *(void **)copy;
+        else copy = (char *)__hashmap_arena_alloc__(dict->arena, (size_class + 1) * HASHMAP_ARENA_CLASS_STEP);
+    } else copy = (char *)__hashmap_arena_block__(dict->arena, length);
+    if (copy) memcpy(copy, str, length);
+    return copy;
+}
+
+
+void __hashmap_strfree__(HashMap *dict, char *str) {
+    if (!dict->arena) {
+        free(str);
+        return;
+    }
+    unsigned long long size_class = strlen(str) / HASHMAP_ARENA_CLASS_STEP;
+    if (size_class >= HASHMAP_ARENA_CLASSES) {
+        __hashmap_arena_block_free__(dict->arena, str);
+        return;
+    }
+    *(void **)str = dict->arena->free_blocks[size_class];
+    dict->arena->free_blocks[size_class] = str;
+}
+
+
+int __hashmap_bloom_rebuild__(HashMap *dict) {
+    // Sized for the load factor that triggers the next expansion.
+    BloomFilter *bloom = bloom_create(dict->bucket * 3 / 4 + 1);
+    if (!bloom) return 1;
+    for (int t = 0; t < 2; t++) {
+        Node **table = t == 0 ? dict->table : dict->old_table;
+        int buckets = t == 0 ? dict->bucket : dict->rehash_index;
+        for (int i = 0; i < buckets; i++) {
+            for (Node *node = table[i]; node; node = node->next) bloom_add(bloom, node->hash);
+        }
+    }
+    if (dict->bloom) {
+        bloom->skipped = dict->bloom->skipped;
+        bloom->false_positives = dict->bloom->false_positives;
+        bloom_destroy(dict->bloom);
+    }
+    dict->bloom = bloom;
+    return 0;
+}
+
+
+int hashmap_config_bloom(HashMap *dict, int enable) {
+    if (!enable) {
+        bloom_destroy(dict->bloom);
+        dict->bloom = NULL;
+        return 0;
+    }
+    if (dict->bloom) return 0;
+    return __hashmap_bloom_rebuild__(dict);
+}
+
+
+void hashmap_config_incremental(HashMap *dict, int enable) {
+    // Finish a running migration before the mode changes.
+    if (!enable) __hashmap_rehash_step__(dict, dict->old_bucket);
+    dict->incremental = enable;
+}
+
+
+void __hashmap_rehash__(HashMap *dict, int buckets) {
     Node **old_table = dict->table;
     int old_buckets = dict->bucket;
 
-    dict->bucket = dict->bucket * 2;    // Double the expansion factor of the HashMap.
-    dict->count = 0;
-    dict->table = (Node **)calloc(dict->bucket, sizeof(Node *));
+    if (dict->next_table && buckets == old_buckets * 2) {
+        // Zeroed ahead by `__hashmap_prepare_step__`, at most a remainder is cleared here.
+        memset(&dict->next_table[dict->next_zeroed], 0, (size_t)(buckets - dict->next_zeroed) * sizeof(Node *));
+        dict->table = dict->next_table;
+    } else {
+        free(dict->next_table);
+        dict->table = (Node **)calloc(buckets, sizeof(Node *));
+    }
+    dict->next_table = NULL;
+    dict->next_zeroed = 0;
+    dict->bucket = buckets;
+
+    if (dict->incremental) {
+        // Keep the old table, every following operation moves a few of its buckets.
+        dict->old_table = old_table;
+        dict->old_bucket = old_buckets;
+        dict->rehash_index = old_buckets;
+        if (dict->bloom) __hashmap_bloom_rebuild__(dict);
+        return;
+    }
 
     for (int i = 0; i < old_buckets; i++) {
         Node *node = old_table[i];
         while (node) {
             Node *next = node->next;
-            unsigned int hash = __hash_function_ELF__(node->key, dict->bucket);
-            node->next = dict->table[hash];
-            dict->table[hash] = node;
-            dict->count++;
+            unsigned long long index = node->hash & (dict->bucket - 1);
+            node->next = dict->table[index];
+            dict->table[index] = node;
             node = next;
         }
     }
     // Do not free the old nodes, because they are already linked to the new table.
     free(old_table);
+    if (dict->bloom) __hashmap_bloom_rebuild__(dict);
 }
 
 
-void __hashmap_shrink__(HashMap *dict) {
-    int MIN_BUCKETS = 8;
-    if (dict->bucket <= MIN_BUCKETS) return;
-
-    int old_buckets = dict->bucket;
-    Node **old_table = dict->table;
-
-    dict->bucket = dict->bucket / 2;
-    dict->count = 0;
-    dict->table = (Node **)calloc(dict->bucket, sizeof(Node *));
-
-    for (int i = 0; i < old_buckets; i++) {
-        Node *node = old_table[i];
+void __hashmap_rehash_step__(HashMap *dict, int n) {
+    if (!dict->old_table) return;
+    int before = dict->rehash_index;
+    // Bound the scan of empty buckets too, so a sparse old table cannot stall one call.
+    long long empty_visits = (long long)n * 10;
+    // Drained from the top, so the migrated tail can be released while the resize runs.
+    while (n > 0 && dict->rehash_index > 0) {
+        Node *node = dict->old_table[dict->rehash_index - 1];
+        dict->rehash_index--;
+        if (!node) {
+            if (--empty_visits == 0) break;
+            continue;
+        }
         while (node) {
             Node *next = node->next;
-            unsigned int hash = __hash_function_ELF__(node->key, dict->bucket);
-            node->next = dict->table[hash];
-            dict->table[hash] = node;
-            dict->count++;
+            unsigned long long index = node->hash & (dict->bucket - 1);
+            node->next = dict->table[index];
+            dict->table[index] = node;
             node = next;
         }
+        n--;
+    }
+    if (dict->rehash_index == 0) {
+        free(dict->old_table);
+        dict->old_table = NULL;
+        dict->old_bucket = 0;
+        return;
+    }
+    // Shrunk a chunk at a time, no single step hands a whole old table back to the system.
+    int keep = (dict->rehash_index + HASHMAP_TRIM_BUCKETS - 1) / HASHMAP_TRIM_BUCKETS * HASHMAP_TRIM_BUCKETS;
+    if (keep < (before + HASHMAP_TRIM_BUCKETS - 1) / HASHMAP_TRIM_BUCKETS * HASHMAP_TRIM_BUCKETS) {
+        Node **table = (Node **)realloc(dict->old_table, (size_t)keep * sizeof(Node *));
+        if (table) dict->old_table = table;
     }
-    free(old_table);
 }
 
 
-void hashmap_put(HashMap *dict, char *key, char *value) {
+int __hashmap_rehash_pace__(HashMap *dict) {
+    if (!dict->old_table) return 0;
+    int limit = dict->bucket / 4 * 3;
+    // Fast enough to finish before the remaining puts reach the load factor.
+    if (dict->count >= limit) return dict->rehash_index;
+    int n = dict->rehash_index / (limit - dict->count) + 1;
+    return n > HASHMAP_REHASH_STEPS ? n : HASHMAP_REHASH_STEPS;
+}
+
+
+void __hashmap_prepare_step__(HashMap *dict) {
+    int limit = dict->bucket / 4 * 3;
+    // Only started in incremental mode, once a third of the headroom is left.
+    if (!dict->incremental || dict->count >= limit || limit - dict->count > dict->bucket / 4) return;
+    int buckets = dict->bucket * 2;
+    if (!dict->next_table) {
+        dict->next_table = (Node **)malloc((size_t)buckets * sizeof(Node *));
+        dict->next_zeroed = 0;
+        if (!dict->next_table) return;
+    }
+    int n = (buckets - dict->next_zeroed) / (limit - dict->count) + 1;
+    if (n > buckets - dict->next_zeroed) n = buckets - dict->next_zeroed;
+    memset(&dict->next_table[dict->next_zeroed], 0, (size_t)n * sizeof(Node *));
+    dict->next_zeroed = dict->next_zeroed + n;
+}
+
+
+Node **__hashmap_find__(HashMap *dict, char *key, unsigned long long hash, int lookup) {
+    // Only the outcome of a lookup is counted, the find made by an insert or a removal is not.
+    if (dict->bloom && !bloom_check(dict->bloom, hash)) {
+        if (lookup) dict->bloom->skipped++;
+        return NULL;
+    }
+    Node **link = &dict->table[hash & (dict->bucket - 1)];
+    while (*link) {
+        if ((*link)->hash == hash && strcmp((*link)->key, key) == 0) return link;
+        link = &(*link)->next;
+    }
+    if (!dict->old_table) {
+        if (dict->bloom && lookup) dict->bloom->false_positives++;
+        return NULL;
+    }
+    // Buckets from `rehash_index` on are migrated (and released).
+    unsigned long long index = hash & (dict->old_bucket - 1);
+    if (index >= (unsigned long long)dict->rehash_index) {
+        if (dict->bloom && lookup) dict->bloom->false_positives++;
+        return NULL;
+    }
+    link = &dict->old_table[index];
+    while (*link) {
+        if ((*link)->hash == hash && strcmp((*link)->key, key) == 0) return link;
+        link = &(*link)->next;
+    }
+    if (dict->bloom && lookup) dict->bloom->false_positives++;
+    return NULL;
+}
+
+
+void __hashmap_expand__(HashMap *dict) {
+    __hashmap_rehash__(dict, dict->bucket * 2);    // Double the expansion factor of the HashMap.
+}
+
+
+void __hashmap_shrink__(HashMap *dict) {
+    int MIN_BUCKETS = 8;
+    if (dict->bucket <= MIN_BUCKETS) return;
+    __hashmap_rehash__(dict, dict->bucket / 2);
+}
+
+
+Node *__hashmap_upsert__(HashMap *dict, char *key, unsigned long long hash) {
+    __hashmap_rehash_step__(dict, __hashmap_rehash_pace__(dict));
+    __hashmap_prepare_step__(dict);
+
     // Expand the HashMap in order to avoid too many collisions.
     double LOAD_FACTOR = 0.75;
-    if (dict->count > dict->bucket * LOAD_FACTOR) __hashmap_expand__(dict);
-
-    unsigned int hash = __hash_function_ELF__(key, dict->bucket);
-    Node *node = dict->table[hash];
-
-    // Hash collision occurs when different keys are assigned to the same bucket.
-    while (node) {
-        // If the key already exists, update the value.
-        if (strcmp(node->key, key) == 0) {
-            free(node->value);
-            node->value = strdup(value);
-            return;     // Exit right now.
-        }
-        node = node->next;
-    }
+    if (!dict->old_table && dict->count > dict->bucket * LOAD_FACTOR) __hashmap_expand__(dict);
+
+    Node **link = __hashmap_find__(dict, key, hash, 0);
+    if (link) return *link;
 
     // If the key does not exist, create a new node and insert it to the head of the linked list.
-    node = (Node *)malloc(sizeof(Node));
-    node->key = strdup(key);
-    node->value = strdup(value);
-    node->next = dict->table[hash];
-    dict->table[hash] = node;
+    unsigned long long index = hash & (dict->bucket - 1);
+    Node *node = __hashmap_node_alloc__(dict);
+    node->key = __hashmap_strdup__(dict, key);
+    node->pointer = NULL;
+    node->type = HASHMAP_VALUE_POINTER;     // Owns nothing until the caller stores the value.
+    node->hash = hash;
+    node->next = dict->table[index];
+    dict->table[index] = node;
     dict->count++;
+    if (dict->bloom) bloom_add(dict->bloom, hash);
+    return node;
+}
+
+
+void __hashmap_value_free__(HashMap *dict, Node *node) {
+    if (node->type == HASHMAP_VALUE_STRING) __hashmap_strfree__(dict, node->value);
+}
+
+
+void hashmap_put(HashMap *dict, char *key, char *value) {
+    Node *node = __hashmap_upsert__(dict, key, hash_string(key));
+    // Copy first, the new value may be the old string itself.
+    char *copy = __hashmap_strdup__(dict, value);
+    __hashmap_value_free__(dict, node);
+    node->value = copy;
+    node->type = HASHMAP_VALUE_STRING;
+}
+
+
+void __hashmap_put_integer__(HashMap *dict, char *key, long long value) {
+    Node *node = __hashmap_upsert__(dict, key, hash_string(key));
+    __hashmap_value_free__(dict, node);
+    node->integer = value;
+    node->type = HASHMAP_VALUE_INTEGER;
+}
+
+
+void __hashmap_put_double__(HashMap *dict, char *key, double value) {
+    Node *node = __hashmap_upsert__(dict, key, hash_string(key));
+    __hashmap_value_free__(dict, node);
+    node->real = value;
+    node->type = HASHMAP_VALUE_DOUBLE;
+}
+
+
+void __hashmap_put_pointer__(HashMap *dict, char *key, void *value) {
+    Node *node = __hashmap_upsert__(dict, key, hash_string(key));
+    __hashmap_value_free__(dict, node);
+    node->pointer = value;
+    node->type = HASHMAP_VALUE_POINTER;
+}
+
+
+void __hashmap_put_string__(HashMap *dict, char *key, const char *value) {
+    // `hashmap_put` only reads the value.
+    hashmap_put(dict, key, (char *)value);
+}
+
+
+long long hashmap_increment(HashMap *dict, char *key, long long delta) {
+    Node *node = __hashmap_upsert__(dict, key, hash_string(key));
+    if (node->type != HASHMAP_VALUE_INTEGER) {
+        __hashmap_value_free__(dict, node);
+        node->integer = 0;
+        node->type = HASHMAP_VALUE_INTEGER;
+    }
+    node->integer = node->integer + delta;
+    return node->integer;
 }
 
 
 char *hashmap_get(HashMap *dict, char *key) {
-    Node *node = dict->table[__hash_function_ELF__(key, dict->bucket)];
-    while (node) {
-        if (strcmp(node->key, key) == 0) return node->value;
-        node = node->next;
+    __hashmap_rehash_step__(dict, HASHMAP_REHASH_STEPS);
+    Node **link = __hashmap_find__(dict, key, hash_string(key), 1);
+    return link && (*link)->type == HASHMAP_VALUE_STRING ? (*link)->value : NULL;
+}
+
+
+int __hashmap_get_integer__(HashMap *dict, char *key, long long *value) {
+    __hashmap_rehash_step__(dict, HASHMAP_REHASH_STEPS);
+    Node **link = __hashmap_find__(dict, key, hash_string(key), 1);
+    if (!link || (*link)->type != HASHMAP_VALUE_INTEGER) return 1;
+    *value = (*link)->integer;
+    return 0;
+}
+
+
+int __hashmap_get_double__(HashMap *dict, char *key, double *value) {
+    __hashmap_rehash_step__(dict, HASHMAP_REHASH_STEPS);
+    Node **link = __hashmap_find__(dict, key, hash_string(key), 1);
+    if (!link || (*link)->type != HASHMAP_VALUE_DOUBLE) return 1;
+    *value = (*link)->real;
+    return 0;
+}
+
+
+int __hashmap_get_pointer__(HashMap *dict, char *key, void **value) {
+    __hashmap_rehash_step__(dict, HASHMAP_REHASH_STEPS);
+    Node **link = __hashmap_find__(dict, key, hash_string(key), 1);
+    if (!link || (*link)->type != HASHMAP_VALUE_POINTER) return 1;
+    *value = (*link)->pointer;
+    return 0;
+}
+
+
+void __hashmap_prefetch__(HashMap *dict, char **keys, unsigned long long *hashes, int n) {
+    for (int i = 0; i < n; i++) {
+        hashes[i] = hash_string(keys[i]);
+        hash_prefetch(&dict->table[hashes[i] & (dict->bucket - 1)]);
+    }
+}
+
+
+void __hashmap_prefetch_nodes__(HashMap *dict, unsigned long long *hashes, int n) {
+    // Reading a bucket head is a load, `hashmap_get_many` gives it a batch of lookups to hide behind.
+    for (int i = 0; i < n; i++) hash_prefetch(dict->table[hashes[i] & (dict->bucket - 1)]);
+}
+
+
+void hashmap_get_many(HashMap *dict, char **keys, char **values, int n) {
+    unsigned long long hashes[2][HASHMAP_BATCH];
+    if (n > 0) __hashmap_prefetch__(dict, keys, hashes[0], n < HASHMAP_BATCH ? n : HASHMAP_BATCH);
+    for (int base = 0, k = 0; base < n; base = base + HASHMAP_BATCH, k = k ^ 1) {
+        int m = n - base < HASHMAP_BATCH ? n - base : HASHMAP_BATCH;
+        int next = n - base - m < HASHMAP_BATCH ? n - base - m : HASHMAP_BATCH;
+        __hashmap_rehash_step__(dict, HASHMAP_REHASH_STEPS);
+        // The chains of this batch (whose buckets came a batch ago) are requested first, then the buckets of the next batch.
+        __hashmap_prefetch_nodes__(dict, hashes[k], m);
+        if (next > 0) __hashmap_prefetch__(dict, keys + base + m, hashes[k ^ 1], next);
+        for (int i = 0; i < m; i++) {
+            Node **link = __hashmap_find__(dict, keys[base + i], hashes[k][i], 1);
+            values[base + i] = link && (*link)->type == HASHMAP_VALUE_STRING ? (*link)->value : NULL;
+        }
+    }
+}
+
+
+void hashmap_put_many(HashMap *dict, char **keys, char **values, int n) {
+    unsigned long long hashes[HASHMAP_BATCH];
+    for (int base = 0; base < n; base = base + HASHMAP_BATCH) {
+        int m = n - base < HASHMAP_BATCH ? n - base : HASHMAP_BATCH;
+        /**
+         * Inserts prefetch their own batch only, the chain heads are read right after the buckets were requested:
+         * the allocations of an insert already overlap those loads, a batch of distance gains nothing in `bench/bench_batch`.
+        **/
+        __hashmap_prefetch__(dict, keys + base, hashes, m);
+        __hashmap_prefetch_nodes__(dict, hashes, m);
+        for (int i = 0; i < m; i++) {
+            Node *node = __hashmap_upsert__(dict, keys[base + i], hashes[i]);
+            char *copy = __hashmap_strdup__(dict, values[base + i]);
+            __hashmap_value_free__(dict, node);
+            node->value = copy;
+            node->type = HASHMAP_VALUE_STRING;
+        }
     }
-    return NULL;
 }
 
 
@@ -116,56 +481,90 @@ int hashmap_remove(HashMap *dict, char *key) {
     // The dictionary is empty or the key is NULL.
     if ((dict->count == 0) || (!key)) return 1;
 
-    unsigned int hash = __hash_function_ELF__(key, dict->bucket);
-    Node *node = dict->table[hash];
-    Node *prev = NULL;
+    __hashmap_rehash_step__(dict, HASHMAP_REHASH_STEPS);
+    Node **link = __hashmap_find__(dict, key, hash_string(key), 0);
+    if (!link) return 1;   // The key does not exist in the HashMap dictionary.
 
-    while (node) {
-        if (strcmp(node->key, key) == 0) {
-            if (prev) prev->next = node->next;
-            else dict->table[hash] = node->next;
-            free(node->key);
-            free(node->value);
-            free(node);
-            dict->count--;
+    Node *node = *link;
+    *link = node->next;
+    if (dict->bloom) bloom_remove(dict->bloom, node->hash);
+    __hashmap_strfree__(dict, node->key);
+    __hashmap_value_free__(dict, node);
+    __hashmap_node_free__(dict, node);
+    dict->count--;
 
-            double SHRINK_FACTOR = 0.25;
-            if (dict->bucket > 8 && dict->count <= dict->bucket * SHRINK_FACTOR) __hashmap_shrink__(dict);
+    double SHRINK_FACTOR = 0.25;
+    if (!dict->old_table && dict->bucket > 8 && dict->count <= dict->bucket * SHRINK_FACTOR) __hashmap_shrink__(dict);
 
-            return 0;
-        }
-        prev = node;
-        node = node->next;
-    }
-    return 1;   // The key does not exist in the HashMap dictionary.
+    return 0;
 }
 
 
 void hashmap_destroy(HashMap *dict) {
-    for (int i = 0; i < dict->bucket; i++) {
-        Node *node = dict->table[i];
-        while (node) {
-            Node *temp = node;
-            node = node->next;
-            free(temp->key);
-            free(temp->value);
-            free(temp);
+    if (dict->arena) {
+        // Every node and string lives in a slab or a dedicated block, so only those are released.
+        for (int t = 0; t < 2; t++) {
+            _HashMapSlab *slab = t == 0 ? dict->arena->slabs : dict->arena->blocks;
+            while (slab) {
+                _HashMapSlab *next = slab->next;
+                free(slab);
+                slab = next;
+            }
+        }
+        free(dict->arena);
+        free(dict->table);
+        free(dict->old_table);
+        free(dict->next_table);
+        bloom_destroy(dict->bloom);
+        free(dict);
+        return;
+    }
+    for (int t = 0; t < 2; t++) {
+        Node **table = t == 0 ? dict->table : dict->old_table;
+        int buckets = t == 0 ? dict->bucket : dict->rehash_index;
+        for (int i = 0; i < buckets; i++) {
+            Node *node = table[i];
+            while (node) {
+                Node *temp = node;
+                node = node->next;
+                free(temp->key);
+                if (temp->type == HASHMAP_VALUE_STRING) free(temp->value);
+                free(temp);
+            }
         }
     }
     free(dict->table);
+    free(dict->old_table);
+    free(dict->next_table);
+    bloom_destroy(dict->bloom);
     free(dict);
 }
 
 
 void hashmap_view(HashMap *dict) {
-    for (int i = 0; i < dict->bucket; i++) {
-        printf("bucket_%d --> ", i);
-        Node *node = dict->table[i];
+    for (int i = 0; i < dict->bucket + dict->rehash_index; i++) {
+        // The buckets of an unfinished incremental resize are listed after the new table.
+        if (i < dict->bucket) printf("bucket_%d --> ", i);
+        else printf("old_bucket_%d --> ", i - dict->bucket);
+        Node *node = i < dict->bucket ? dict->table[i] : dict->old_table[i - dict->bucket];
         if (!node) {
             printf("(null)\n");
         } else {
             while (node) {
-                printf("{\x1b[35m%s\x1b[0m: \x1b[34m%s\x1b[0m}", node->key, node->value);
+                switch (node->type) {
+                    case HASHMAP_VALUE_STRING:
+                        printf("{\x1b[35m%s\x1b[0m: \x1b[34m%s\x1b[0m}", node->key, node->value);
+                        break;
+                    case HASHMAP_VALUE_INTEGER:
+                        printf("{\x1b[35m%s\x1b[0m: \x1b[34m%lld\x1b[0m}", node->key, node->integer);
+                        break;
+                    case HASHMAP_VALUE_DOUBLE:
+                        printf("{\x1b[35m%s\x1b[0m: \x1b[34m%lf\x1b[0m}", node->key, node->real);
+                        break;
+                    case HASHMAP_VALUE_POINTER:
+                        printf("{\x1b[35m%s\x1b[0m: \x1b[34m%p\x1b[0m}", node->key, node->pointer);
+                        break;
+                }
                 node = node->next;
                 if (node) printf(" --> ");
             }
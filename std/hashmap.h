@@ -7,27 +7,155 @@
 #include <string.h>
 
 
+#include "hash.h"
+#include "bloom.h"
+
+
+#define HASHMAP_REHASH_STEPS 4      // Buckets migrated per operation while an incremental resize is running (more by a put short of headroom).
+#define HASHMAP_TRIM_BUCKETS 8192   // Migrated old buckets released together while an incremental resize is running.
+#define HASHMAP_BATCH 16            // Keys hashed and prefetched together by the `_many` functions.
+#define HASHMAP_ARENA_SLAB_SIZE (1 << 20)     // Bytes requested from `malloc` per slab.
+#define HASHMAP_ARENA_CLASS_STEP 16
+#define HASHMAP_ARENA_CLASSES 16    // Strings up to `16 * 16` bytes are recycled through size-class freelists.
+
+
+/**
+ * @brief Store a typed value (stored inline, never parsed from a string).
+ * @param dict The HashMap dictionary.
+ * @param key The string key.
+ * @param value The value: integers (`char` to `unsigned long long`) as `long long`, `float`/`double` as `double`,
+ * `char *` and `const char *` are copied like `hashmap_put`, a `void *` is stored without being owned
+ * (cast any other pointer to `void *`, a value of another type fails to compile).
+**/
+#define hashmap_put_value(dict, key, value) _Generic((value), \
+    _Bool: __hashmap_put_integer__, \
+    char: __hashmap_put_integer__, \
+    signed char: __hashmap_put_integer__, \
+    unsigned char: __hashmap_put_integer__, \
+    short: __hashmap_put_integer__, \
+    unsigned short: __hashmap_put_integer__, \
+    int: __hashmap_put_integer__, \
+    unsigned int: __hashmap_put_integer__, \
+    long: __hashmap_put_integer__, \
+    unsigned long: __hashmap_put_integer__, \
+    long long: __hashmap_put_integer__, \
+    unsigned long long: __hashmap_put_integer__, \
+    float: __hashmap_put_double__, \
+    double: __hashmap_put_double__, \
+    char *: hashmap_put, \
+    const char *: __hashmap_put_string__, \
+    void *: __hashmap_put_pointer__, \
+    default: __hashmap_type_mismatch__ \
+)(dict, key, value)
+
+
+/**
+ * @brief Read a typed value stored by `hashmap_put_value`.
+ * @param dict The HashMap dictionary.
+ * @param key The string key.
+ * @param value Receive the value (`long long *`, `double *` or `void **`).
+ * @return `0` for success, `1` for nonexistence or a value of another type.
+**/
+#define hashmap_get_value(dict, key, value) _Generic((value), \
+    long long *: __hashmap_get_integer__, \
+    double *: __hashmap_get_double__, \
+    void **: __hashmap_get_pointer__ \
+)(dict, key, value)
+
+
+typedef enum {
+    HASHMAP_VALUE_STRING,
+    HASHMAP_VALUE_INTEGER,
+    HASHMAP_VALUE_DOUBLE,
+    HASHMAP_VALUE_POINTER
+} HashMapValueType;
+
+
 typedef struct Node {
     char *key;
-    char *value;
+    union {
+        char *value;        // Owned copy of a string value.
+        long long integer;
+        double real;
+        void *pointer;      // Not owned, the HashMap never frees it.
+    };
+    unsigned long long hash;    // The full hash of key, so resizing never hashes the key again.
     struct Node *next;
+    HashMapValueType type;
 } Node;
 
 
+typedef struct _HashMapSlab {
+    struct _HashMapSlab *next;
+    struct _HashMapSlab *prev;  // Only linked for a dedicated block, which is freed on its own.
+} _HashMapSlab;
+
+
+typedef struct {
+    _HashMapSlab *slabs;
+    _HashMapSlab *blocks;   // Dedicated blocks of the strings too long for a size class.
+    char *cursor;
+    char *limit;
+    Node *free_nodes;
+    void *free_blocks[HASHMAP_ARENA_CLASSES];
+} _HashMapArena;
+
+
 typedef struct {
     Node **table;
-    int bucket;
+    int bucket;     // Always a power of two, the bucket index is `hash & (bucket - 1)`.
     int count;
+    _HashMapArena *arena;   // `NULL` for `malloc` per node and string.
+    int incremental;        // `1` for spreading every resize over the following operations.
+    Node **old_table;       // The table being drained by an incremental resize (`NULL` otherwise).
+    int old_bucket;
+    int rehash_index;       // The old buckets below it are still to migrate, the ones above are released.
+    Node **next_table;      // The table of the next expansion, zeroed ahead in incremental mode (`NULL` otherwise).
+    int next_zeroed;        // The zeroed prefix of `next_table`.
+    BloomFilter *bloom;     // Checked before the buckets (`NULL` when disabled).
 } HashMap;
 
 
 /**
- * @brief ELF function in Unix HashMap.
- * @param str The dictionary key.
- * @param size The HashMap bucket.
- * @return The hash value.
+ * @brief Move every node to a table with a new number of buckets.
+ * @param dict The HashMap dictionary.
+ * @param buckets The new number of buckets (power of two).
+**/
+void __hashmap_rehash__(HashMap *dict, int buckets);
+
+
+/**
+ * @brief Migrate a bounded number of buckets of an incremental resize.
+ * @param dict The HashMap dictionary.
+ * @param n The number of non-empty buckets to migrate.
 **/
-unsigned int __hash_function_ELF__(char *str, int size);
+void __hashmap_rehash_step__(HashMap *dict, int n);
+
+
+/**
+ * @brief Determine how many buckets a put migrates, so an incremental resize ends before the next expansion is due.
+ * @param dict The HashMap dictionary.
+ * @return The number of non-empty buckets to migrate.
+**/
+int __hashmap_rehash_pace__(HashMap *dict);
+
+
+/**
+ * @brief Zero a share of the table of the next expansion, so that expansion does not clear a whole table in one put.
+ * @param dict The HashMap dictionary.
+**/
+void __hashmap_prepare_step__(HashMap *dict);
+
+
+/**
+ * @brief Find the link pointing to the node of a key (both tables are searched during an incremental resize).
+ * @param dict The HashMap dictionary.
+ * @param key The string key.
+ * @param hash The hash value of key.
+ * @param lookup `1` for a get, whose outcome goes into the counters of the Bloom filter, `0` for the find of an insert or a removal.
+ * @return The address of the pointer to the node, `NULL` for nonexistence.
+**/
+Node **__hashmap_find__(HashMap *dict, char *key, unsigned long long hash, int lookup);
 
 
 /**
@@ -51,6 +179,97 @@ void __hashmap_shrink__(HashMap *dict);
 HashMap *hashmap_create();
 
 
+/**
+ * @brief Create a new HashMap dictionary whose nodes and strings are bump-allocated from large slabs (a string longer than the size classes gets a block of its own).
+ * @return The pointer to the new HashMap dictionary.
+**/
+HashMap *hashmap_create_arena();
+
+
+/**
+ * @brief Bump-allocate memory from the arena.
+ * @param arena The arena of HashMap.
+ * @param size The number of bytes.
+ * @return The pointer of memory (`NULL` for failure).
+**/
+void *__hashmap_arena_alloc__(_HashMapArena *arena, unsigned long long size);
+
+
+/**
+ * @brief Allocate a dedicated block for a string too long for a size class, the current slab keeps bump-allocating.
+ * @param arena The arena of HashMap.
+ * @param size The number of bytes.
+ * @return The pointer of memory (`NULL` for failure).
+**/
+void *__hashmap_arena_block__(_HashMapArena *arena, unsigned long long size);
+
+
+/**
+ * @brief Free a dedicated block of `__hashmap_arena_block__`.
+ * @param arena The arena of HashMap.
+ * @param memory The pointer of memory.
+**/
+void __hashmap_arena_block_free__(_HashMapArena *arena, void *memory);
+
+
+/**
+ * @brief Allocate a node (from the freelist in arena mode).
+ * @param dict The HashMap dictionary.
+ * @return The pointer of node.
+**/
+Node *__hashmap_node_alloc__(HashMap *dict);
+
+
+/**
+ * @brief Release a node (to the freelist in arena mode).
+ * @param dict The HashMap dictionary.
+ * @param node The pointer of node.
+**/
+void __hashmap_node_free__(HashMap *dict, Node *node);
+
+
+/**
+ * @brief Copy a string (from the size-class freelists in arena mode).
+ * @param dict The HashMap dictionary.
+ * @param str The string.
+ * @return The copied string.
+**/
+char *__hashmap_strdup__(HashMap *dict, char *str);
+
+
+/**
+ * @brief Release a string copied by `__hashmap_strdup__`.
+ * @param dict The HashMap dictionary.
+ * @param str The string.
+**/
+void __hashmap_strfree__(HashMap *dict, char *str);
+
+
+/**
+ * @brief Enable or disable incremental resizing (like Redis `dict`, no single `put` pays for a whole rehash).
+ * @param dict The HashMap dictionary.
+ * @param enable `1` for incremental resizing, `0` for default resizing in one call.
+**/
+void hashmap_config_incremental(HashMap *dict, int enable);
+
+
+/**
+ * @brief Enable or disable a counting Bloom filter in front of the buckets, so most lookups of missing keys never walk a chain.
+ * @param dict The HashMap dictionary.
+ * @param enable `1` for enabling, `0` for disabling.
+ * @return `0` for success, `1` for failure.
+**/
+int hashmap_config_bloom(HashMap *dict, int enable);
+
+
+/**
+ * @brief Rebuild the Bloom filter for the current number of buckets (the counters `skipped` and `false_positives` are kept).
+ * @param dict The HashMap dictionary.
+ * @return `0` for success, `1` for failure (the old filter stays valid).
+**/
+int __hashmap_bloom_rebuild__(HashMap *dict);
+
+
 /**
  * @brief Insert a key-value pair into the HashMap dictionary.
  * @param dict The HashMap dictionary.
@@ -64,11 +283,150 @@ void hashmap_put(HashMap *dict, char *key, char *value);
  * @brief Get the value in the HashMap dictionary by key.
  * @param dict The HashMap dictionary.
  * @param key The string key.
- * @return The string value.
+ * @return The string value (`NULL` for nonexistence or a typed value).
 **/
 char *hashmap_get(HashMap *dict, char *key);
 
 
+/**
+ * @brief Add to an integer value with a single lookup (a missing key or a value of another type starts from `0`).
+ * @param dict The HashMap dictionary.
+ * @param key The string key.
+ * @param delta The increment.
+ * @return The new integer value.
+**/
+long long hashmap_increment(HashMap *dict, char *key, long long delta);
+
+
+/**
+ * @brief Get the values of many keys, overlapping the cache misses of a batch.
+ * @param dict The HashMap dictionary.
+ * @param keys The string keys.
+ * @param values Receive the string value of every key (`NULL` for nonexistence or a typed value).
+ * @param n The number of keys.
+**/
+void hashmap_get_many(HashMap *dict, char **keys, char **values, int n);
+
+
+/**
+ * @brief Insert many key-value pairs, overlapping the cache misses of a batch.
+ * @param dict The HashMap dictionary.
+ * @param keys The string keys.
+ * @param values The string values.
+ * @param n The number of pairs.
+**/
+void hashmap_put_many(HashMap *dict, char **keys, char **values, int n);
+
+
+/**
+ * @brief Hash a batch of keys and prefetch their buckets.
+ * @param dict The HashMap dictionary.
+ * @param keys The string keys.
+ * @param hashes Receive the hash value of every key.
+ * @param n The number of keys (at most `HASHMAP_BATCH`).
+**/
+void __hashmap_prefetch__(HashMap *dict, char **keys, unsigned long long *hashes, int n);
+
+
+/**
+ * @brief Prefetch the first node of the chain of every key in a batch whose buckets were prefetched (a batch earlier for `hashmap_get_many`).
+ * @param dict The HashMap dictionary.
+ * @param hashes The hash value of every key.
+ * @param n The number of keys (at most `HASHMAP_BATCH`).
+**/
+void __hashmap_prefetch_nodes__(HashMap *dict, unsigned long long *hashes, int n);
+
+
+/**
+ * @brief Find the node of a key, a new node is inserted when the key does not exist.
+ * @param dict The HashMap dictionary.
+ * @param key The string key.
+ * @param hash The hash value of key.
+ * @return The node (a new node holds a `NULL` pointer value).
+**/
+Node *__hashmap_upsert__(HashMap *dict, char *key, unsigned long long hash);
+
+
+/**
+ * @brief Release the value of a node if the HashMap owns it.
+ * @param dict The HashMap dictionary.
+ * @param node The pointer of node.
+**/
+void __hashmap_value_free__(HashMap *dict, Node *node);
+
+
+/**
+ * @brief Store an integer value inline.
+ * @param dict The HashMap dictionary.
+ * @param key The string key.
+ * @param value The integer value.
+**/
+void __hashmap_put_integer__(HashMap *dict, char *key, long long value);
+
+
+/**
+ * @brief Store a floating-point value inline.
+ * @param dict The HashMap dictionary.
+ * @param key The string key.
+ * @param value The floating-point value.
+**/
+void __hashmap_put_double__(HashMap *dict, char *key, double value);
+
+
+/**
+ * @brief Store a pointer without copying the memory it points to.
+ * @param dict The HashMap dictionary.
+ * @param key The string key.
+ * @param value The pointer value.
+**/
+void __hashmap_put_pointer__(HashMap *dict, char *key, void *value);
+
+
+/**
+ * @brief Store a copy of a read-only string like `hashmap_put`.
+ * @param dict The HashMap dictionary.
+ * @param key The string key.
+ * @param value The string value.
+**/
+void __hashmap_put_string__(HashMap *dict, char *key, const char *value);
+
+
+/**
+ * @brief Never defined, a value of a type `hashmap_put_value` cannot store selects it, so the call fails to compile.
+**/
+void __hashmap_type_mismatch__(void);
+
+
+/**
+ * @brief Read an integer value.
+ * @param dict The HashMap dictionary.
+ * @param key The string key.
+ * @param value Receive the integer value.
+ * @return `0` for success, `1` for failure.
+**/
+int __hashmap_get_integer__(HashMap *dict, char *key, long long *value);
+
+
+/**
+ * @brief Read a floating-point value.
+ * @param dict The HashMap dictionary.
+ * @param key The string key.
+ * @param value Receive the floating-point value.
+ * @return `0` for success, `1` for failure.
+**/
+int __hashmap_get_double__(HashMap *dict, char *key, double *value);
+
+
+/**
+ * @brief Read a pointer value.
+ * @param dict The HashMap dictionary.
+ * @param key The string key.
+ * @param value Receive the pointer value.
+ * @return `0` for success, `1` for failure.
+**/
+int __hashmap_get_pointer__(HashMap *dict, char *key, void **value);
+
+
 /**
  * @brief Remove a key-value pair from the HashMap dictionary.
  * @param dict The HashMap dictionary.
@@ -1,10 +1,12 @@
 #include "log.h"
+#include "log_sink.h"
 
 
 struct {
     void *ctx;
     int level;
     int mode;
+    int precision;
     _LogLockFunc lock;
     _LogCallback callback[MAX_CALLBACKS];
 } _LogLock;
@@ -19,6 +21,16 @@ void log_config_write(FILE *f) {
 }
 
 
+void log_config_sink(LogSink *sink) {
+    log_add_callback(__log_callback_sink__, sink);
+}
+
+
+void log_config_precision(int precision) {
+    _LogLock.precision = precision;
+}
+
+
 void log_setting(int mode) {
     _LogLock.mode = mode;
 }
@@ -71,8 +83,8 @@ void __log_print__(int level, char *file, int line, char *fmt, ...) {
 
 void __log_init_event__(LogEvent *event, void *ctx) {
     if (!event->time) {
-        time_t now = time(NULL);
-        event->time = localtime(&now);
+        event->timestamp = log_time_now(_LogLock.precision);
+        event->time = log_time_local(event->timestamp);
     }
     event->ctx = ctx;
 }
@@ -89,8 +101,8 @@ void __log_unlock__() {
 
 
 void __log_callback_stdout__(LogEvent *event) {
-    char buffer[32];
-    buffer[strftime(buffer, sizeof(buffer), "%Y-%m-%d %H:%M:%S", event->time)] = '\0';
+    char buffer[LOG_TIME_LENGTH];
+    log_time_format(buffer, event->timestamp, _LogLock.precision);
     fprintf(event->ctx, "%s %s%-7s \x1b[90m%s:%d:\x1b[0m ", buffer, COLOURS[event->level], TIPS[event->level], event->file, event->line);
     vfprintf(event->ctx, event->fmt, event->argument_pointer);
     fprintf(event->ctx, "\n");
@@ -99,10 +111,39 @@ void __log_callback_stdout__(LogEvent *event) {
 
 
 void __log_callback_write__(LogEvent *event) {
-    char buffer[32];
-    buffer[strftime(buffer, sizeof(buffer), "%Y-%m-%d %H:%M:%S", event->time)] = '\0';
+    char buffer[LOG_TIME_LENGTH];
+    log_time_format(buffer, event->timestamp, _LogLock.precision);
     fprintf(event->ctx, "%s %-7s %s:%d: ", buffer, TIPS[event->level], event->file, event->line);
     vfprintf(event->ctx, event->fmt, event->argument_pointer);
     fprintf(event->ctx, "\n");
     fflush(event->ctx);
 }
+
+
+void __log_callback_sink__(LogEvent *event) {
+    char buffer[LOG_TIME_LENGTH];
+    log_time_format(buffer, event->timestamp, _LogLock.precision);
+    char line[LOG_LINE_LENGTH];
+    char *text = line;
+    int size = sizeof(line);
+    while (1) {
+        int n = snprintf(text, size, "%s %-7s %s:%d: ", buffer, TIPS[event->level], event->file, event->line);
+        if (n < 0) break;
+        va_list args;
+        va_copy(args, event->argument_pointer);
+        int m = n < size ? vsnprintf(text + n, size - n, event->fmt, args) : vsnprintf(NULL, 0, event->fmt, args);
+        va_end(args);
+        if (m < 0) break;
+        // Room for the newline is needed as well.
+        if (n + m + 1 < size) {
+            text[n + m] = '\n';
+            log_sink_write((LogSink *)event->ctx, text, n + m + 1, event->level);
+            break;
+        }
+        if (text != line) break;
+        size = n + m + 2;
+        text = (char *)malloc(size);
+        if (!text) break;
+    }
+    if (text != line) free(text);
+}
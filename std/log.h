@@ -7,11 +7,15 @@
 #include <stdarg.h>
 
 
+#include "log_time.h"
+
+
 extern const char *TIPS[6];
 enum {LOG_TRACE, LOG_DEBUG, LOG_INFO, LOG_WARNING, LOG_ERROR, LOG_FATAL};
 
 
 #define MAX_CALLBACKS 64
+#define LOG_LINE_LENGTH 1024     // Bytes a line for `log_config_sink` is formatted into on the stack, a longer line goes to the heap.
 
 
 #define log_trace(...) __log_print__(LOG_TRACE, __FILE__, __LINE__, __VA_ARGS__)
@@ -22,11 +26,15 @@ enum {LOG_TRACE, LOG_DEBUG, LOG_INFO, LOG_WARNING, LOG_ERROR, LOG_FATAL};
 #define log_fatal(...) __log_print__(LOG_FATAL, __FILE__, __LINE__, __VA_ARGS__)
 
 
+typedef struct LogSink LogSink;     // Only taken by pointer, `log_sink.h` declares it with the `log_sink_*` functions.
+
+
 typedef struct {
     va_list argument_pointer;
     char *fmt;
     char *file;
     struct tm *time;
+    long long timestamp;    // Nanoseconds since the epoch.
     void *ctx;
     int line;
     int level;
@@ -50,6 +58,20 @@ typedef struct {
 void log_config_write(FILE *f);
 
 
+/**
+ * @brief Configure the log written to a buffered sink (go to the `log_sink.h` declaration to see the flush policy).
+ * @param sink The pointer of sink, closed by the caller after logging.
+**/
+void log_config_sink(LogSink *sink);
+
+
+/**
+ * @brief Configure the precision of the timestamps.
+ * @param precision `LOG_TIME_SECOND` (default), `LOG_TIME_MILLISECOND` or `LOG_TIME_MICROSECOND`.
+**/
+void log_config_precision(int precision);
+
+
 /**
  * @brief Set the log mode.
  * @param mode `1` for not printing, `0` for default printing.
@@ -141,4 +163,11 @@ void __log_callback_stdout__(LogEvent *event);
 void __log_callback_write__(LogEvent *event);
 
 
+/**
+ * @brief Write to a buffered sink callback function.
+ * @param event The event of log.
+**/
+void __log_callback_sink__(LogEvent *event);
+
+
 #endif
@@ -0,0 +1,282 @@
+#include "log_sink.h"
+
+
+LogSink *log_sink_open(const char *path, int capacity) {
+    #if defined(__OS_UNIX__)
+        int fd = open(path, O_WRONLY | O_CREAT | O_APPEND, 0644);
+    #elif defined(__OS_WINDOWS__)
+        int fd = _open(path, _O_WRONLY | _O_CREAT | _O_APPEND | _O_BINARY, _S_IREAD | _S_IWRITE);
+    #endif
+    if (fd < 0) return NULL;
+    LogSink *sink = log_sink_create(fd, capacity);
+    char *name = (char *)malloc(strlen(path) + 1);
+    if (!sink || !name) {
+        if (sink) log_sink_close(sink);
+        free(name);
+        #if defined(__OS_UNIX__)
+            close(fd);
+        #elif defined(__OS_WINDOWS__)
+            _close(fd);
+        #endif
+        return NULL;
+    }
+    strcpy(name, path);
+    sink->path = name;
+    sink->owner = 1;
+    return sink;
+}
+
+
+LogSink *log_sink_create(int fd, int capacity) {
+    if (fd < 0 || capacity < 0) return NULL;
+    if (capacity == 0) capacity = LOG_SINK_CAPACITY;
+    LogSink *sink = (LogSink *)calloc(1, sizeof(LogSink));
+    if (!sink) return NULL;
+    sink->buffer = (char *)malloc(capacity);
+    if (!sink->buffer || mutex_create(&sink->lock, 1) != 0) {
+        free(sink->buffer);
+        free(sink);
+        return NULL;
+    }
+    sink->fd = fd;
+    sink->capacity = capacity;
+    struct stat information;
+    if (fstat(fd, &information) == 0) sink->file_size = (long long)information.st_size;
+    log_sink_config_flush(sink, 0, LOG_SINK_FLUSH_INTERVAL, LOG_SINK_FLUSH_LEVEL);
+    return sink;
+}
+
+
+void log_sink_config_flush(LogSink *sink, int size, double interval, int level) {
+    mutex_lock(&sink->lock);
+    sink->flush_size = (size <= 0 || size > sink->capacity) ? sink->capacity : size;
+    sink->flush_interval = interval > 0 ? (long long)(interval * 1e9) : 0;
+    sink->flush_level = level;
+    mutex_unlock(&sink->lock);
+}
+
+
+int log_sink_config_rotate(LogSink *sink, long long size, int interval, int n_files, int preallocate) {
+    if (!sink->path || size < 0 || interval < 0 || n_files < 1 || n_files > LOG_SINK_MAX_FILES) return 1;
+    mutex_lock(&sink->lock);
+    sink->rotate_size = size;
+    sink->rotate_interval = interval;
+    if (interval) sink->rotate_time = __log_sink_boundary__((long long)time(NULL), interval);
+    sink->n_files = n_files;
+    sink->preallocate = preallocate;
+    __log_sink_preallocate__(sink);
+    mutex_unlock(&sink->lock);
+    return 0;
+}
+
+
+int log_sink_write(LogSink *sink, const char *data, int length, int level) {
+    int status = 0;
+    mutex_lock(&sink->lock);
+    long long now = sink->flush_interval ? __log_sink_clock__() : 0;
+    if (sink->length == 0) sink->oldest = now;
+    if (length > sink->capacity - sink->length) status = __log_sink_output__(sink, data, length);
+    else {
+        memcpy(sink->buffer + sink->length, data, length);
+        sink->length = sink->length + length;
+        if (sink->length >= sink->flush_size || level >= sink->flush_level || (sink->flush_interval && now - sink->oldest >= sink->flush_interval)) {
+            status = __log_sink_output__(sink, NULL, 0);
+        }
+    }
+    mutex_unlock(&sink->lock);
+    return status;
+}
+
+
+int log_sink_poll(LogSink *sink) {
+    int status = 0;
+    mutex_lock(&sink->lock);
+    if (sink->length > 0 && sink->flush_interval && __log_sink_clock__() - sink->oldest >= sink->flush_interval) {
+        status = __log_sink_output__(sink, NULL, 0);
+    }
+    mutex_unlock(&sink->lock);
+    return status;
+}
+
+
+int log_sink_flush(LogSink *sink) {
+    mutex_lock(&sink->lock);
+    int status = __log_sink_output__(sink, NULL, 0);
+    mutex_unlock(&sink->lock);
+    return status;
+}
+
+
+void log_sink_close(LogSink *sink) {
+    if (!sink) return;
+    log_sink_flush(sink);
+    if (sink->owner) {
+        #if defined(__OS_UNIX__)
+            close(sink->fd);
+        #elif defined(__OS_WINDOWS__)
+            _close(sink->fd);
+        #endif
+    }
+    mutex_destroy(&sink->lock);
+    free(sink->path);
+    free(sink->buffer);
+    free(sink);
+}
+
+
+int __log_sink_output__(LogSink *sink, const char *data, int length) {
+    int status = 0;
+    if (sink->n_files && sink->length + length > 0) __log_sink_rotate__(sink, (long long)sink->length + length);
+    #if defined(__OS_UNIX__)
+        // Only the parts with bytes, so a write that makes no progress is an error.
+        struct iovec io[2];
+        struct iovec *p = io;
+        int n_io = 0;
+        if (sink->length > 0) io[n_io++] = (struct iovec) {sink->buffer, (size_t)sink->length};
+        if (length > 0) io[n_io++] = (struct iovec) {(void *)data, (size_t)length};
+        while (n_io > 0) {
+            ssize_t n = writev(sink->fd, p, n_io);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) {
+                sink->error = n < 0 ? errno : EIO;
+                status = 1;
+                break;
+            }
+            sink->n_writes++;
+            sink->n_bytes = sink->n_bytes + n;
+            sink->file_size = sink->file_size + n;
+            // A partial write resumes from the first byte not written.
+            while (n_io > 0 && (size_t)n >= p->iov_len) {
+                n = n - (ssize_t)p->iov_len;
+                p++;
+                n_io--;
+            }
+            if (n_io > 0) {
+                p->iov_base = (char *)p->iov_base + n;
+                p->iov_len = p->iov_len - (size_t)n;
+            }
+        }
+    #elif defined(__OS_WINDOWS__)
+        const char *parts[2] = {sink->buffer, data};
+        int sizes[2] = {sink->length, length};
+        for (int i = 0; i < 2 && !status; i++) {
+            const char *p = parts[i];
+            int remaining = sizes[i];
+            while (remaining > 0) {
+                int n = _write(sink->fd, p, (unsigned int)remaining);
+                if (n <= 0) {
+                    sink->error = n < 0 ? errno : EIO;
+                    status = 1;
+                    break;
+                }
+                sink->n_writes++;
+                sink->n_bytes = sink->n_bytes + n;
+                sink->file_size = sink->file_size + n;
+                p = p + n;
+                remaining = remaining - n;
+            }
+        }
+    #endif
+    sink->length = 0;
+    return status;
+}
+
+
+int __log_sink_rotate__(LogSink *sink, long long length) {
+    long long now = sink->rotate_interval ? (long long)time(NULL) : 0;
+    int due = sink->rotate_size && sink->file_size + length > sink->rotate_size;
+    if (sink->rotate_interval && now >= sink->rotate_time) {
+        sink->rotate_time = __log_sink_boundary__(now, sink->rotate_interval);
+        due = 1;
+    }
+    // An empty file is kept, a single line larger than `rotate_size` gets a file of its own.
+    if (!due || sink->file_size == 0) return 0;
+
+    int size = (int)strlen(sink->path) + 16;
+    char *from = (char *)malloc(size);
+    char *to = (char *)malloc(size);
+    if (!from || !to) {
+        free(from);
+        free(to);
+        return 1;
+    }
+    #if defined(__OS_UNIX__)
+        // The reserved blocks past the end of the file are given back.
+        struct stat information;
+        if (sink->preallocate && fstat(sink->fd, &information) == 0 && ftruncate(sink->fd, information.st_size) != 0) sink->preallocate = 0;
+    #elif defined(__OS_WINDOWS__)
+        // An open file cannot be renamed.
+        _close(sink->fd);
+    #endif
+
+    snprintf(to, size, "%s.%d", sink->path, sink->n_files);
+    remove(to);
+    for (int i = sink->n_files - 1; i >= 1; i--) {
+        snprintf(from, size, "%s.%d", sink->path, i);
+        snprintf(to, size, "%s.%d", sink->path, i + 1);
+        rename(from, to);
+    }
+    snprintf(to, size, "%s.1", sink->path);
+    rename(sink->path, to);
+
+    int status = 0;
+    #if defined(__OS_UNIX__)
+        int fd = open(sink->path, O_WRONLY | O_CREAT | O_APPEND, 0644);
+        if (fd < 0) {
+            // Carry on with the renamed file.
+            sink->error = errno;
+            status = 1;
+        } else {
+            close(sink->fd);
+            sink->fd = fd;
+        }
+    #elif defined(__OS_WINDOWS__)
+        int fd = _open(sink->path, _O_WRONLY | _O_CREAT | _O_APPEND | _O_BINARY, _S_IREAD | _S_IWRITE);
+        if (fd < 0) {
+            sink->error = errno;
+            status = 1;
+            fd = _open(to, _O_WRONLY | _O_CREAT | _O_APPEND | _O_BINARY, _S_IREAD | _S_IWRITE);
+        }
+        sink->fd = fd;
+    #endif
+    free(from);
+    free(to);
+    if (status) return 1;
+    sink->file_size = 0;
+    sink->n_rotations++;
+    __log_sink_preallocate__(sink);
+    return 0;
+}
+
+
+long long __log_sink_boundary__(long long now, long long interval) {
+    // Counted in the local time, so `86400` rolls over at local midnight, the offset is taken again at every rollover.
+    long long offset = log_time_offset(now * 1000000000LL);
+    long long local = now + offset;
+    long long start = local - ((local % interval) + interval) % interval;
+    return start + interval - offset;
+}
+
+
+void __log_sink_preallocate__(LogSink *sink) {
+    #if defined(__linux__) && defined(FALLOC_FL_KEEP_SIZE)
+        // The size is kept, so the appends still go right after the written bytes, a file system without `fallocate` is not asked again.
+        if (sink->preallocate && sink->rotate_size > sink->file_size && fallocate(sink->fd, FALLOC_FL_KEEP_SIZE, 0, sink->rotate_size) != 0) sink->preallocate = 0;
+    #endif
+}
+
+
+long long __log_sink_clock__() {
+    #if defined(__OS_UNIX__)
+        struct timespec t;
+        // The coarse clock is read without a system call, a tick (a few milliseconds) is precise enough for flushing.
+        #if defined(CLOCK_MONOTONIC_COARSE)
+            clock_gettime(CLOCK_MONOTONIC_COARSE, &t);
+        #else
+            clock_gettime(CLOCK_MONOTONIC, &t);
+        #endif
+        return (long long)t.tv_sec * 1000000000LL + t.tv_nsec;
+    #elif defined(__OS_WINDOWS__)
+        return (long long)GetTickCount64() * 1000000LL;
+    #endif
+}
@@ -0,0 +1,199 @@
+#ifndef _LOG_SINK_H_
+#define _LOG_SINK_H_
+
+
+#include "thread.h"
+#include "log_time.h"
+
+
+#include <time.h>
+#include <stdio.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+#if defined(__OS_WINDOWS__)
+    #include <io.h>
+    #include <fcntl.h>
+    #include <sys/stat.h>
+#elif defined(__OS_UNIX__)
+    #include <fcntl.h>
+    #include <unistd.h>
+    #include <sys/uio.h>
+    #include <sys/stat.h>
+#endif
+
+
+#define LOG_SINK_CAPACITY 65536     // Default bytes buffered before they are written.
+#define LOG_SINK_FLUSH_INTERVAL 1.0     // Default most seconds a line waits in the buffer.
+#define LOG_SINK_FLUSH_LEVEL 4      // Default level written at once (`LOG_ERROR` and above).
+#define LOG_SINK_MAX_FILES 1000     // Most rotated files kept by `log_sink_config_rotate`.
+
+
+/**
+ * A log file written with `write` (`writev` on Unix) from a large in-memory buffer instead of one `fflush` per line.
+ * The buffer goes out when it reaches `flush_size` bytes, when its oldest line is `flush_interval` old, or with a line of `flush_level`.
+**/
+typedef struct LogSink {
+    int fd;
+    int owner;      // `1` when `log_sink_close` closes `fd`.
+    char *buffer;
+    int capacity;
+    int length;
+    int flush_size;
+    int flush_level;
+    long long flush_interval;   // Nanoseconds, `0` for no limit.
+    long long oldest;   // When the first byte of `buffer` came in (monotonic nanoseconds).
+    long long n_writes;     // System calls made.
+    long long n_bytes;      // Bytes written.
+    int error;      // `errno` of the last failed write, the lost buffer is not retried.
+    char *path;     // `NULL` for a sink of `log_sink_create`, which cannot rotate.
+    long long file_size;    // Bytes in the current file.
+    long long rotate_size;  // `0` for no limit.
+    long long rotate_interval;  // Seconds, `0` for no limit.
+    long long rotate_time;  // The second since the epoch the current file rolls over at.
+    int n_files;        // Rotated files kept, `path.1` is the newest.
+    int preallocate;    // `1` to reserve `rotate_size` bytes of every new file.
+    long long n_rotations;
+    Mutex lock;
+} LogSink;
+
+
+/**
+ * @brief Open (or create) a log file for appending and buffer it.
+ * @param path The path of log file.
+ * @param capacity The bytes of buffer (`0` for `LOG_SINK_CAPACITY`).
+ * @return The pointer of sink (`NULL` for failure).
+ * @example
+ * @code
+LogSink *sink = log_sink_open("app.log", 0);
+log_sink_config_flush(sink, 0, 0.5, LOG_WARNING);
+log_config_sink(sink);
+log_info("Hello %s", "world");
+log_sink_close(sink);
+ * @endcode
+**/
+LogSink *log_sink_open(const char *path, int capacity);
+
+
+/**
+ * @brief Buffer a file descriptor opened by the caller (the caller closes it after `log_sink_close`).
+ * Opened with `O_APPEND`, every write lands whole at the end of the file even with other processes appending to it.
+ * @param fd The file descriptor.
+ * @param capacity The bytes of buffer (`0` for `LOG_SINK_CAPACITY`).
+ * @return The pointer of sink (`NULL` for failure).
+**/
+LogSink *log_sink_create(int fd, int capacity);
+
+
+/**
+ * @brief Configure when the buffer is written.
+ * The interval is checked on every line, and by the idle writer thread of `async_log_init_ring`, call `log_sink_flush` otherwise.
+ * @param sink The pointer of sink.
+ * @param size The bytes buffered before a write (`0` for the whole buffer, `1` for a write per line).
+ * @param interval The most seconds a line waits (`0` for no limit).
+ * @param level A line of this level or above is written at once with everything before it (`6` for never).
+**/
+void log_sink_config_flush(LogSink *sink, int size, double interval, int level);
+
+
+/**
+ * @brief Roll the file of `log_sink_open` over by size or time, `app.log` is renamed to `app.log.1` (`app.log.1` to `app.log.2` and so on) and a new `app.log` is opened.
+ * The check is made before every write of the buffer, so a file only exceeds `size` by a single line larger than `size`,
+ * and a time rollover happens at the first write after the boundary (nothing is renamed while nothing is logged).
+ * The rollover runs on the thread writing the buffer, with the sink lock held. With `async_log_init_ring` that is only the writer thread,
+ * so the logging threads never wait for the renaming. With `log_config_sink` or the `async_log_init` pool it is a logging thread,
+ * which stalls for the renaming, and so does every thread logging into the sink meanwhile.
+ * @param sink The pointer of sink.
+ * @param size The most bytes of a file (`0` for no limit).
+ * @param interval The seconds between rollovers, on multiples of `interval` since local midnight (`86400` at midnight, `3600` on the hour, `0` for no limit).
+ * @param n_files The rotated files kept (at least `1`, at most `LOG_SINK_MAX_FILES`), the oldest one is deleted.
+ * @param preallocate `1` to reserve `size` bytes of every new file with `fallocate` (Linux only), the appends then allocate no blocks.
+ * @return `0` for success, `1` for a sink of `log_sink_create` or an invalid argument.
+ * @example
+ * @code
+LogSink *sink = log_sink_open("app.log", 0);
+log_sink_config_rotate(sink, 64 << 20, 86400, 7, 1);
+ * @endcode
+**/
+int log_sink_config_rotate(LogSink *sink, long long size, int interval, int n_files, int preallocate);
+
+
+/**
+ * @brief Append a line to the sink, a line larger than the free buffer goes out in the same system call as the buffer.
+ * @param sink The pointer of sink.
+ * @param data The bytes.
+ * @param length The number of bytes.
+ * @param level The level of log.
+ * @return `0` for success, `1` for a failed write.
+**/
+int log_sink_write(LogSink *sink, const char *data, int length, int level);
+
+
+/**
+ * @brief Write the buffer if its oldest line has waited the flush interval.
+ * @param sink The pointer of sink.
+ * @return `0` for success, `1` for a failed write.
+**/
+int log_sink_poll(LogSink *sink);
+
+
+/**
+ * @brief Write the buffer now.
+ * @param sink The pointer of sink.
+ * @return `0` for success, `1` for a failed write.
+**/
+int log_sink_flush(LogSink *sink);
+
+
+/**
+ * @brief Flush the sink, close the file it owns and free it.
+ * @param sink The pointer of sink.
+**/
+void log_sink_close(LogSink *sink);
+
+
+/**
+ * @brief Write the buffer followed by extra bytes and empty the buffer (the sink lock is held).
+ * @param sink The pointer of sink.
+ * @param data The extra bytes (`NULL` for none).
+ * @param length The number of extra bytes.
+ * @return `0` for success, `1` for a failed write.
+**/
+int __log_sink_output__(LogSink *sink, const char *data, int length);
+
+
+/**
+ * @brief Roll the file over if it is due (the sink lock is held).
+ * @param sink The pointer of sink.
+ * @param length The bytes about to be written.
+ * @return `0` for success, `1` for a failed rollover (the current file is kept).
+**/
+int __log_sink_rotate__(LogSink *sink, long long length);
+
+
+/**
+ * @brief Get the next rollover, the boundaries are multiples of the interval in the local time.
+ * @param now Seconds since the epoch.
+ * @param interval The seconds between rollovers.
+ * @return Seconds since the epoch.
+**/
+long long __log_sink_boundary__(long long now, long long interval);
+
+
+/**
+ * @brief Reserve `rotate_size` bytes of the current file without changing its size (the sink lock is held).
+ * @param sink The pointer of sink.
+**/
+void __log_sink_preallocate__(LogSink *sink);
+
+
+/**
+ * @brief Get the coarse monotonic clock time.
+ * @return Nanoseconds.
+**/
+long long __log_sink_clock__();
+
+
+#endif
@@ -0,0 +1,102 @@
+#include "log_time.h"
+
+
+#if defined(LOG_TIME_TLS)
+    static LOG_TIME_TLS LogTimeCache __log_time_thread_cache__;
+#else
+    static LogTimeCache __log_time_shared_cache__;
+#endif
+
+
+long long log_time_now(int precision) {
+    #if defined(__OS_UNIX__)
+        struct timespec t;
+        // The coarse clock is read from the vDSO without looking at the hardware counter.
+        #if defined(CLOCK_REALTIME_COARSE)
+            clock_gettime(precision == LOG_TIME_MICROSECOND ? CLOCK_REALTIME : CLOCK_REALTIME_COARSE, &t);
+        #else
+            clock_gettime(CLOCK_REALTIME, &t);
+        #endif
+        return (long long)t.tv_sec * 1000000000LL + t.tv_nsec;
+    #elif defined(__OS_WINDOWS__)
+        // 100-nanosecond intervals since 1601-01-01, updated every clock tick whatever the precision.
+        FILETIME t;
+        GetSystemTimeAsFileTime(&t);
+        unsigned long long ticks = ((unsigned long long)t.dwHighDateTime << 32) | t.dwLowDateTime;
+        return (long long)(ticks - 116444736000000000ULL) * 100;
+    #endif
+}
+
+
+struct tm *log_time_local(long long time) {
+    return &__log_time_cache__(time / 1000000000LL)->local;
+}
+
+
+long long log_time_offset(long long time) {
+    long long second = time / 1000000000LL;
+    struct tm *local = log_time_local(time);
+    // Days since the epoch of the local date (`tm_gmtoff` is missing on Windows).
+    long long year = local->tm_year + 1900LL - (local->tm_mon < 2);
+    long long era = (year >= 0 ? year : year - 399) / 400;
+    long long day_of_era = year - era * 400;
+    long long month = local->tm_mon < 2 ? local->tm_mon + 10 : local->tm_mon - 2;
+    long long day_of_year = (153 * month + 2) / 5 + local->tm_mday - 1;
+    long long days = era * 146097 + (day_of_era * 365 + day_of_era / 4 - day_of_era / 100 + day_of_year) - 719468;
+    return days * 86400 + local->tm_hour * 3600LL + local->tm_min * 60LL + local->tm_sec - second;
+}
+
+
+int log_time_format(char *buffer, long long time, int precision) {
+    long long second = time / 1000000000LL;
+    #if defined(LOG_TIME_TLS)
+        LogTimeCache *cache = __log_time_cache__(second);
+    #else
+        // No cache is shared between threads, the date is formatted on the stack.
+        LogTimeCache local;
+        LogTimeCache *cache = &local;
+        __log_time_refresh__(cache, second);
+    #endif
+
+    int length = cache->length;
+    memcpy(buffer, cache->date, length);
+    int digits = precision == LOG_TIME_MILLISECOND ? 3 : (precision == LOG_TIME_MICROSECOND ? 6 : 0);
+    if (digits) {
+        int fraction = (int)(time % 1000000000LL / (digits == 3 ? 1000000 : 1000));
+        buffer[length] = '.';
+        for (int i = digits; i > 0; i--) {
+            buffer[length + i] = (char)('0' + fraction % 10);
+            fraction = fraction / 10;
+        }
+        length = length + digits + 1;
+    }
+    buffer[length] = '\0';
+    return length;
+}
+
+
+LogTimeCache *__log_time_cache__(long long second) {
+    #if defined(LOG_TIME_TLS)
+        LogTimeCache *cache = &__log_time_thread_cache__;
+        if (!cache->ready || cache->second != second) __log_time_refresh__(cache, second);
+    #else
+        // Like `localtime`, the result is shared by all threads.
+        LogTimeCache *cache = &__log_time_shared_cache__;
+        __log_time_refresh__(cache, second);
+    #endif
+    return cache;
+}
+
+
+void __log_time_refresh__(LogTimeCache *cache, long long second) {
+    time_t t = (time_t)second;
+    #if defined(__OS_UNIX__)
+        localtime_r(&t, &cache->local);
+    #elif defined(__OS_WINDOWS__)
+        // The CRT keeps the result of `localtime` per thread.
+        cache->local = *localtime(&t);
+    #endif
+    cache->length = (int)strftime(cache->date, sizeof(cache->date), "%Y-%m-%d %H:%M:%S", &cache->local);
+    cache->second = second;
+    cache->ready = 1;
+}
@@ -0,0 +1,102 @@
+#ifndef _LOG_TIME_H_
+#define _LOG_TIME_H_
+
+
+#if !defined(__OS_WINDOWS__) && !defined(__OS_UNIX__)
+    #if defined(_WIN32) || defined(__WIN32__) || defined(__WINDOWS__)
+        #define __OS_WINDOWS__
+    #elif defined(__linux__) || defined(__APPLE__)
+        #define __OS_UNIX__
+        #define _GNU_SOURCE
+    #else
+        #error "Unsupported platforms."
+    #endif
+#endif
+
+
+#if defined(__OS_WINDOWS__)
+    #include <windows.h>
+#endif
+
+
+#include <time.h>
+#include <string.h>
+
+
+#define LOG_TIME_LENGTH 32      // Bytes of a formatted timestamp with the terminating null.
+
+
+/**
+ * The precision of the timestamp of a log line.
+**/
+enum {LOG_TIME_SECOND, LOG_TIME_MILLISECOND, LOG_TIME_MICROSECOND};
+
+
+#if (defined(__GNUC__) || defined(__clang__)) && !defined(__TINYC__)
+    #define LOG_TIME_TLS __thread
+#endif
+
+
+/**
+ * The local time of one second and its date text, a thread converts and formats each second once.
+**/
+typedef struct {
+    int ready;
+    long long second;   // Seconds since the epoch.
+    struct tm local;
+    char date[LOG_TIME_LENGTH];     // `%Y-%m-%d %H:%M:%S`.
+    int length;
+} LogTimeCache;
+
+
+/**
+ * @brief Get the wall clock time for a log line.
+ * @param precision `LOG_TIME_SECOND`, `LOG_TIME_MILLISECOND` (both read `CLOCK_REALTIME_COARSE` where available, a few milliseconds of resolution) or `LOG_TIME_MICROSECOND` (`CLOCK_REALTIME`), Windows reads the system time of one clock tick.
+ * @return Nanoseconds since the epoch.
+**/
+long long log_time_now(int precision);
+
+
+/**
+ * @brief Convert a timestamp to the local time, `localtime` is only called when the second changes.
+ * @param time Nanoseconds since the epoch.
+ * @return The local time (valid in the calling thread until its next call).
+**/
+struct tm *log_time_local(long long time);
+
+
+/**
+ * @brief Get the offset of the local time zone from UTC at a moment (daylight saving time included), from the cached local time.
+ * @param time Nanoseconds since the epoch.
+ * @return Seconds east of UTC (`28800` for UTC+8).
+**/
+long long log_time_offset(long long time);
+
+
+/**
+ * @brief Format a timestamp as `2026-10-17 08:00:00` with `.123` or `.123456` appended, the date part is cached per thread and second.
+ * @param buffer The output buffer (at least `LOG_TIME_LENGTH` bytes).
+ * @param time Nanoseconds since the epoch.
+ * @param precision `LOG_TIME_SECOND`, `LOG_TIME_MILLISECOND` or `LOG_TIME_MICROSECOND`.
+ * @return The length of the text.
+**/
+int log_time_format(char *buffer, long long time, int precision);
+
+
+/**
+ * @brief Get the cache of the calling thread holding a second.
+ * @param second Seconds since the epoch.
+ * @return The cache (a shared one refreshed on every call without `LOG_TIME_TLS`).
+**/
+LogTimeCache *__log_time_cache__(long long second);
+
+
+/**
+ * @brief Convert and format a second into a cache.
+ * @param cache The cache.
+ * @param second Seconds since the epoch.
+**/
+void __log_time_refresh__(LogTimeCache *cache, long long second);
+
+
+#endif
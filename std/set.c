@@ -1,4 +1,23 @@
 #include "set.h"
+#include "threadpool.h"
+
+
+// A parallel scan shared by the caller and its pool helpers, released by whoever drops the last reference.
+typedef struct {
+    Set *source;
+    Set *other;
+    int keep;
+    unsigned char *selected;
+    unsigned long long n_slots;
+    unsigned long long chunk;
+    unsigned long long n_chunks;
+    unsigned long long next;        // The next chunk to claim.
+    unsigned long long finished;
+    unsigned long long n_selected;
+    int refs;
+    Mutex lock;                     // Guards every counter above.
+    ThreadCondition done;           // Signaled once every chunk is finished.
+} _SetAlgebraJob;
 
 
 Set *set_create() {
@@ -20,35 +39,79 @@ void set_destroy(Set *set) {
     for (unsigned long long i = 0; i < set->capacity; i++) {
         if (set->buckets[i].type == SET_SLOT_STRING) free(set->buckets[i].value.s);
     }
+    for (unsigned long long i = 0; i < set->rehash_index; i++) {
+        if (set->old_buckets[i].type == SET_SLOT_STRING) free(set->old_buckets[i].value.s);
+    }
     free(set->buckets);
+    free(set->old_buckets);
+    free(set->next_buckets);
+    bloom_destroy(set->bloom);
     free(set);
 }
 
 
+int __set_bloom_rebuild__(Set *set) {
+    // Sized for the load factor that triggers the next resize.
+    BloomFilter *bloom = bloom_create(set->capacity * 3 / 4 + 1);
+    if (bloom == NULL) return 1;
+    for (unsigned long long i = 0; i < set->capacity + set->rehash_index; i++) {
+        _SetSlot *slot = i < set->capacity ? &set->buckets[i] : &set->old_buckets[i - set->capacity];
+        if (slot->type > SET_SLOT_REMOVE) bloom_add(bloom, slot->hash);
+    }
+    if (set->bloom) {
+        bloom->skipped = set->bloom->skipped;
+        bloom->false_positives = set->bloom->false_positives;
+        bloom_destroy(set->bloom);
+    }
+    set->bloom = bloom;
+    return 0;
+}
+
+
+int set_config_bloom(Set *set, int enable) {
+    if (!enable) {
+        bloom_destroy(set->bloom);
+        set->bloom = NULL;
+        return 0;
+    }
+    if (set->bloom) return 0;
+    return __set_bloom_rebuild__(set);
+}
+
+
+void set_config_incremental(Set *set, int enable) {
+    // Finish a running migration before the mode changes.
+    if (!enable) __set_rehash_step__(set, set->old_capacity);
+    set->incremental = enable;
+}
+
+
 void set_view(Set *set) {
     if (set->count == 0) printf("{}_0\n");
     else {
         printf("{");
         int first = 1;
-        for (unsigned long long i = 0; i < set->capacity; i++) {
-            if (set->buckets[i].type <= SET_SLOT_REMOVE) continue;
+        for (unsigned long long i = 0; i < set->capacity + set->rehash_index; i++) {
+            // The slots of an unfinished incremental resize follow the new slots.
+            _SetSlot *slot = i < set->capacity ? &set->buckets[i] : &set->old_buckets[i - set->capacity];
+            if (slot->type <= SET_SLOT_REMOVE) continue;
             if (!first) printf(", ");
             first = 0;
-            switch (set->buckets[i].type) {
+            switch (slot->type) {
                 case SET_SLOT_INT:
-                    printf("%d", set->buckets[i].value.i);
+                    printf("%d", slot->value.i);
                     break;
                 case SET_SLOT_LONG:
-                    printf("%ld", set->buckets[i].value.l);
+                    printf("%ld", slot->value.l);
                     break;
                 case SET_SLOT_FLOAT:
-                    printf("%f", set->buckets[i].value.f);
+                    printf("%f", slot->value.f);
                     break;
                 case SET_SLOT_DOUBLE:
-                    printf("%lf", set->buckets[i].value.d);
+                    printf("%lf", slot->value.d);
                     break;
                 case SET_SLOT_STRING:
-                    printf("\"%s\"", set->buckets[i].value.s);
+                    printf("\"%s\"", slot->value.s);
                     break;
                 default:
                     break;
@@ -59,24 +122,22 @@ void set_view(Set *set) {
 }
 
 
-unsigned int __hash_fnv_1a__(void *data, unsigned long long length) {
-    unsigned int hash = 2166136261U;
-    unsigned char *p = (unsigned char *)data;
-    for (unsigned long long i = 0; i < length; i++) hash = (hash ^ p[i]) * 16777619U;
-    return hash;
+unsigned int __set_fold_hash__(unsigned long long hash) {
+    return (unsigned int)(hash ^ (hash >> 32));
 }
 
 
 unsigned int __set_get_hash__(_SetSlotState type, void *value) {
-    if (type == SET_SLOT_INT) return __hash_fnv_1a__(value, sizeof(int));
-    if (type == SET_SLOT_LONG) return __hash_fnv_1a__(value, sizeof(long));
+    // Fold the 64-bit hash, so the low bits used by the mask depend on every input bit.
+    if (type == SET_SLOT_INT) return __set_fold_hash__(hash_integer((unsigned long long)*(int *)value));
+    if (type == SET_SLOT_LONG) return __set_fold_hash__(hash_integer((unsigned long long)*(long *)value));
     if (type == SET_SLOT_FLOAT) {
         float f = *(float *)value;
         // NaN.
         if (f != f) return 0x7FC00000;
         // +0.0F or -0.0F.
         if (f == 0.0F) f = 0.0F;
-        return __hash_fnv_1a__(&f, sizeof(float));
+        return __set_fold_hash__(hash_bytes(&f, sizeof(float), 0));
     }
     if (type == SET_SLOT_DOUBLE) {
         double d = *(double *)value;
@@ -84,9 +145,9 @@ unsigned int __set_get_hash__(_SetSlotState type, void *value) {
         if (d != d) return 0x7FC00000;
         // +0.0 or -0.0.
         if (d == 0.0) d = 0.0;
-        return __hash_fnv_1a__(&d, sizeof(double));
+        return __set_fold_hash__(hash_bytes(&d, sizeof(double), 0));
     }
-    if (type == SET_SLOT_STRING) return __hash_fnv_1a__(value, strlen((char *)value));
+    if (type == SET_SLOT_STRING) return __set_fold_hash__(hash_string((char *)value));
     return 0;
 }
 
@@ -120,26 +181,112 @@ int __set_slot_equal__(_SetSlot *slot, _SetSlotState type, void *value) {
 }
 
 
-int __set_resize__(Set *set) {
-    unsigned long long new_capacity = set->capacity * 2;
-    _SetSlot *new_buckets = (_SetSlot *)calloc(new_capacity, sizeof(_SetSlot));
+int __set_rehash__(Set *set, unsigned long long capacity) {
+    _SetSlot *new_buckets = NULL;
+    if (set->next_buckets != NULL && capacity == set->capacity * 2) {
+        // Zeroed ahead by `__set_prepare_step__`, at most a remainder is cleared here.
+        memset(&set->next_buckets[set->next_zeroed], 0, (capacity - set->next_zeroed) * sizeof(_SetSlot));
+        new_buckets = set->next_buckets;
+    } else {
+        free(set->next_buckets);
+        new_buckets = (_SetSlot *)calloc(capacity, sizeof(_SetSlot));
+    }
+    set->next_buckets = NULL;
+    set->next_zeroed = 0;
     if (new_buckets == NULL) return 1;
 
     _SetSlot *old_buckets = set->buckets;
     unsigned long long old_capacity = set->capacity;
-    set->used = set->count;
-    set->capacity = new_capacity;
+    set->used = 0;
+    set->capacity = capacity;
     set->buckets = new_buckets;
+    set->old_buckets = old_buckets;
+    set->old_capacity = old_capacity;
+    set->rehash_index = old_capacity;
+
+    // Without the incremental mode the whole migration happens right now.
+    if (!set->incremental) __set_rehash_step__(set, old_capacity);
+    if (set->bloom) __set_bloom_rebuild__(set);
+    return 0;
+}
+
 
-    for (unsigned long long i = 0; i < old_capacity; i++) {
-        _SetSlot *slot = &old_buckets[i];
+void __set_rehash_step__(Set *set, unsigned long long n) {
+    if (set->old_buckets == NULL) return;
+    unsigned long long before = set->rehash_index;
+    unsigned long long end = n < set->rehash_index ? set->rehash_index - n : 0;
+
+    // Drained from the top, so the migrated tail can be released while the resize runs.
+    for (; set->rehash_index > end; set->rehash_index--) {
+        _SetSlot *slot = &set->old_buckets[set->rehash_index - 1];
         if (slot->type <= SET_SLOT_REMOVE) continue;
+        // The element cannot be in the new slots yet, so any free slot will do.
         unsigned long long idx = slot->hash & (set->capacity - 1);
-        while (set->buckets[idx].type != SET_SLOT_EMPTY) idx = (idx + 1) & (set->capacity - 1);
+        while (set->buckets[idx].type > SET_SLOT_REMOVE) idx = (idx + 1) & (set->capacity - 1);
+        if (set->buckets[idx].type == SET_SLOT_EMPTY) set->used++;
         set->buckets[idx] = *slot;
     }
-    free(old_buckets);
-    return 0;
+
+    if (set->rehash_index == 0) {
+        free(set->old_buckets);
+        set->old_buckets = NULL;
+        set->old_capacity = 0;
+        return;
+    }
+    // Shrunk a chunk at a time, no single step hands a whole old array back to the system.
+    unsigned long long keep = (set->rehash_index + SET_TRIM_SLOTS - 1) / SET_TRIM_SLOTS * SET_TRIM_SLOTS;
+    if (keep < (before + SET_TRIM_SLOTS - 1) / SET_TRIM_SLOTS * SET_TRIM_SLOTS) {
+        _SetSlot *slots = (_SetSlot *)realloc(set->old_buckets, keep * sizeof(_SetSlot));
+        if (slots != NULL) set->old_buckets = slots;
+    }
+}
+
+
+unsigned long long __set_rehash_pace__(Set *set) {
+    if (set->old_buckets == NULL) return 0;
+    unsigned long long limit = set->capacity / 4 * 3;
+    unsigned long long live = set->count < set->rehash_index ? set->count : set->rehash_index;
+    // Fast enough to finish before the remaining puts and old elements together reach the load factor.
+    if (set->used + live >= limit) return set->rehash_index;
+    unsigned long long n = set->rehash_index / (limit - set->used - live) + 1;
+    return n > SET_REHASH_STEPS ? n : SET_REHASH_STEPS;
+}
+
+
+void __set_prepare_step__(Set *set) {
+    unsigned long long limit = set->capacity / 4 * 3;
+    // Only started in incremental mode, once a third of the headroom is left.
+    if (!set->incremental || set->used >= limit || limit - set->used > set->capacity / 4) return;
+    unsigned long long capacity = set->capacity * 2;
+    if (set->next_buckets == NULL) {
+        set->next_buckets = (_SetSlot *)malloc(capacity * sizeof(_SetSlot));
+        set->next_zeroed = 0;
+        if (set->next_buckets == NULL) return;
+    }
+    unsigned long long n = (capacity - set->next_zeroed) / (limit - set->used) + 1;
+    if (n > capacity - set->next_zeroed) n = capacity - set->next_zeroed;
+    memset(&set->next_buckets[set->next_zeroed], 0, n * sizeof(_SetSlot));
+    set->next_zeroed = set->next_zeroed + n;
+}
+
+
+int __set_resize__(Set *set) {
+    return __set_rehash__(set, set->capacity * 2);
+}
+
+
+_SetSlot *__set_find_old_slot__(Set *set, _SetSlotState type, void *value, unsigned int hash) {
+    if (set->old_buckets == NULL) return NULL;
+    // The slots from `rehash_index` on are migrated (and released), a probe reaching them wraps to slot 0 early.
+    unsigned long long idx = hash & (set->old_capacity - 1);
+    if (idx >= set->rehash_index) idx = 0;
+    for (unsigned long long n = 0; n < set->rehash_index; n++) {
+        _SetSlot *slot = &set->old_buckets[idx];
+        if (slot->type == SET_SLOT_EMPTY) return NULL;
+        if (slot->type > SET_SLOT_REMOVE && __set_slot_equal__(slot, type, value)) return slot;
+        idx = idx + 1 < set->rehash_index ? idx + 1 : 0;
+    }
+    return NULL;
 }
 
 
@@ -159,6 +306,14 @@ _SetSlot *__set_find_slot__(Set *set, _SetSlotState type, void *value, unsigned
 
 
 void __set_put__(Set *set, _SetSlotState type, void *value) {
+    __set_put_hashed__(set, type, value, __set_get_hash__(type, value));
+}
+
+
+void __set_put_hashed__(Set *set, _SetSlotState type, void *value, unsigned int hash) {
+    // Paced so that a running resize has always finished by the time the next one is due.
+    __set_rehash_step__(set, __set_rehash_pace__(set));
+    __set_prepare_step__(set);
     if (set->used >= set->capacity * 0.75) {
         int status = __set_resize__(set);
         if (status == 1) {
@@ -167,7 +322,7 @@ void __set_put__(Set *set, _SetSlotState type, void *value) {
             exit(EXIT_FAILURE);
         }
     }
-    unsigned int hash = __set_get_hash__(type, value);
+    if (__set_find_old_slot__(set, type, value, hash) != NULL) return;
     _SetSlot *slot = __set_find_slot__(set, type, value, hash);
     if (slot->type == type && __set_slot_equal__(slot, type, value)) return;
     if (slot->type == SET_SLOT_EMPTY) set->used++;
@@ -179,37 +334,27 @@ void __set_put__(Set *set, _SetSlotState type, void *value) {
     else if (type == SET_SLOT_DOUBLE) slot->value.d = *(double *)value;
     else if (type == SET_SLOT_STRING) slot->value.s = strdup((char *)value);
     set->count++;
+    if (set->bloom) bloom_add(set->bloom, hash);
 }
 
 
 void __set_shrink__(Set *set) {
     // if (set->capacity <= 16) return;
     unsigned long long new_capacity = set->capacity / 2;
-    if (set->count >= new_capacity * 0.75) return;
-    _SetSlot *new_buckets = (_SetSlot *)calloc(new_capacity, sizeof(_SetSlot));
-    if (new_buckets == NULL) return;
-
-    _SetSlot *old_buckets = set->buckets;
-    unsigned long long old_capacity = set->capacity;
-    set->used = set->count;
-    set->capacity = new_capacity;
-    set->buckets = new_buckets;
-
-    for (unsigned long long i = 0; i < old_capacity; i++) {
-        _SetSlot *slot = &old_buckets[i];
-        if (slot->type <= SET_SLOT_REMOVE) continue;
-        unsigned long long idx = slot->hash & (set->capacity - 1);
-        while (set->buckets[idx].type != SET_SLOT_EMPTY) idx = (idx + 1) & (set->capacity - 1);
-        set->buckets[idx] = *slot;
-    }
-    free(old_buckets);
+    if (set->old_buckets != NULL || set->count >= new_capacity * 0.75) return;
+    __set_rehash__(set, new_capacity);
 }
 
 
 void __set_del__(Set *set, _SetSlotState type, void *value) {
+    __set_rehash_step__(set, SET_REHASH_STEPS);
     unsigned int hash = __set_get_hash__(type, value);
+    // A removal is not a lookup, the filter counters are left alone.
+    if (set->bloom && !bloom_check(set->bloom, hash)) return;
     _SetSlot *slot = __set_find_slot__(set, type, value, hash);
-    if (slot->type > SET_SLOT_REMOVE && __set_slot_equal__(slot, type, value)) {
+    if (!(slot->type > SET_SLOT_REMOVE && __set_slot_equal__(slot, type, value))) slot = __set_find_old_slot__(set, type, value, hash);
+    if (slot != NULL && slot->type > SET_SLOT_REMOVE) {
+        if (set->bloom) bloom_remove(set->bloom, hash);
         if (slot->type == SET_SLOT_STRING) free(slot->value.s);
         slot->type = SET_SLOT_REMOVE;
         set->count--;
@@ -218,6 +363,249 @@ void __set_del__(Set *set, _SetSlotState type, void *value) {
 }
 
 
+void *__set_array_at__(_SetSlotState type, void *values, int i) {
+    if (type == SET_SLOT_INT) return (int *)values + i;
+    if (type == SET_SLOT_LONG) return (long *)values + i;
+    if (type == SET_SLOT_FLOAT) return (float *)values + i;
+    if (type == SET_SLOT_DOUBLE) return (double *)values + i;
+    return ((char **)values)[i];
+}
+
+
+void __set_add_many__(Set *set, _SetSlotState type, void *values, int n) {
+    unsigned int hashes[SET_BATCH];
+    for (int base = 0; base < n; base = base + SET_BATCH) {
+        int m = n - base < SET_BATCH ? n - base : SET_BATCH;
+        // Hash the whole batch and start loading every home slot before the first one is probed.
+        for (int i = 0; i < m; i++) {
+            hashes[i] = __set_get_hash__(type, __set_array_at__(type, values, base + i));
+            hash_prefetch(&set->buckets[hashes[i] & (set->capacity - 1)]);
+        }
+        for (int i = 0; i < m; i++) __set_put_hashed__(set, type, __set_array_at__(type, values, base + i), hashes[i]);
+    }
+}
+
+
+int __set_contains_many__(Set *set, _SetSlotState type, void *values, int n, int *results) {
+    unsigned int hashes[SET_BATCH];
+    int found = 0;
+    for (int base = 0; base < n; base = base + SET_BATCH) {
+        int m = n - base < SET_BATCH ? n - base : SET_BATCH;
+        for (int i = 0; i < m; i++) {
+            hashes[i] = __set_get_hash__(type, __set_array_at__(type, values, base + i));
+            hash_prefetch(&set->buckets[hashes[i] & (set->capacity - 1)]);
+        }
+        for (int i = 0; i < m; i++) {
+            int exist = __set_contains_hashed__(set, type, __set_array_at__(type, values, base + i), hashes[i]);
+            if (results) results[base + i] = exist;
+            found = found + exist;
+        }
+    }
+    return found;
+}
+
+
+void *__set_slot_value__(_SetSlot *slot) {
+    return slot->type == SET_SLOT_STRING ? (void *)slot->value.s : (void *)&slot->value;
+}
+
+
+int __set_lookup__(Set *set, _SetSlot *slot) {
+    // The filter counters are not touched, several threads may run lookups at once.
+    if (set->bloom && !bloom_check(set->bloom, slot->hash)) return 0;
+    void *value = __set_slot_value__(slot);
+    _SetSlot *found = __set_find_slot__(set, slot->type, value, slot->hash);
+    if (found->type > SET_SLOT_REMOVE && __set_slot_equal__(found, slot->type, value)) return 1;
+    return __set_find_old_slot__(set, slot->type, value, slot->hash) != NULL;
+}
+
+
+int __set_reserve__(Set *set, unsigned long long n) {
+    unsigned long long capacity = set->capacity;
+    while (n >= capacity * 0.75) capacity = capacity * 2;
+    if (capacity == set->capacity) return 0;
+    return __set_rehash__(set, capacity);
+}
+
+
+_SetSlot *__set_slot_at__(Set *set, unsigned long long index) {
+    return index < set->capacity ? &set->buckets[index] : &set->old_buckets[index - set->capacity];
+}
+
+
+unsigned long long __set_algebra_scan__(Set *source, Set *other, int keep, unsigned char *selected, unsigned long long begin, unsigned long long end) {
+    unsigned long long n_selected = 0;
+    for (unsigned long long i = begin; i < end; i++) {
+        _SetSlot *slot = __set_slot_at__(source, i);
+        if (slot->type <= SET_SLOT_REMOVE) continue;
+        if (__set_lookup__(other, slot) == keep) {
+            selected[i] = 1;
+            n_selected++;
+        }
+    }
+    return n_selected;
+}
+
+
+void __set_algebra_help__(void *args) {
+    _SetAlgebraJob *job = (_SetAlgebraJob *)args;
+    mutex_lock(&job->lock);
+    while (job->next < job->n_chunks) {
+        unsigned long long begin = job->next * job->chunk;
+        unsigned long long end = begin + job->chunk < job->n_slots ? begin + job->chunk : job->n_slots;
+        job->next++;
+        mutex_unlock(&job->lock);
+        unsigned long long n = __set_algebra_scan__(job->source, job->other, job->keep, job->selected, begin, end);
+        mutex_lock(&job->lock);
+        job->n_selected = job->n_selected + n;
+        if (++job->finished == job->n_chunks) condition_signal(&job->done);
+    }
+    int last = --job->refs == 0;
+    mutex_unlock(&job->lock);
+    if (last) {
+        condition_destroy(&job->done);
+        mutex_destroy(&job->lock);
+        free(job);
+    }
+}
+
+
+unsigned long long __set_algebra_select__(Set *source, Set *other, int keep, unsigned char *selected, ThreadPool *pool) {
+    // Nothing is migrated, both operands are scanned as they are (new slots, then old slots).
+    unsigned long long n_slots = source->capacity + source->rehash_index;
+    if (pool == NULL || n_slots < SET_PARALLEL_THRESHOLD) return __set_algebra_scan__(source, other, keep, selected, 0, n_slots);
+
+    _SetAlgebraJob *job = (_SetAlgebraJob *)calloc(1, sizeof(_SetAlgebraJob));
+    if (job == NULL) return __set_algebra_scan__(source, other, keep, selected, 0, n_slots);
+    if (mutex_create(&job->lock, 1) != 0) {
+        free(job);
+        return __set_algebra_scan__(source, other, keep, selected, 0, n_slots);
+    }
+    if (condition_init(&job->done) != 0) {
+        mutex_destroy(&job->lock);
+        free(job);
+        return __set_algebra_scan__(source, other, keep, selected, 0, n_slots);
+    }
+    job->source = source;
+    job->other = other;
+    job->keep = keep;
+    job->selected = selected;
+    job->n_slots = n_slots;
+    job->n_chunks = (unsigned long long)(pool->n_workers + 1) * SET_PARALLEL_CHUNKS;
+    job->chunk = (n_slots + job->n_chunks - 1) / job->n_chunks;
+    job->n_chunks = (n_slots + job->chunk - 1) / job->chunk;
+    job->refs = pool->n_workers + 2;    // One per helper, two for the caller (it helps, then waits).
+
+    // Helpers are never waited for, one that starts late finds no chunk left and only drops its reference.
+    int n_helpers = 0;
+    while (n_helpers < pool->n_workers && threadpool_add(pool, __set_algebra_help__, job, 0, NULL) == 0) n_helpers++;
+    if (n_helpers < pool->n_workers) {
+        mutex_lock(&job->lock);
+        job->refs = job->refs - (pool->n_workers - n_helpers);
+        mutex_unlock(&job->lock);
+    }
+
+    // The caller scans too, then waits only for the chunks other threads have already claimed.
+    __set_algebra_help__(job);
+    mutex_lock(&job->lock);
+    while (job->finished < job->n_chunks) condition_wait(&job->done, &job->lock);
+    unsigned long long n_selected = job->n_selected;
+    int last = --job->refs == 0;
+    mutex_unlock(&job->lock);
+    if (last) {
+        condition_destroy(&job->done);
+        mutex_destroy(&job->lock);
+        free(job);
+    }
+    return n_selected;
+}
+
+
+void __set_add_selected__(Set *set, Set *source, unsigned char *selected) {
+    for (unsigned long long i = 0; i < source->capacity + source->rehash_index; i++) {
+        _SetSlot *slot = __set_slot_at__(source, i);
+        if (slot->type <= SET_SLOT_REMOVE || (selected && !selected[i])) continue;
+        // The slot hash is reused, no element is hashed again.
+        __set_put_hashed__(set, slot->type, __set_slot_value__(slot), slot->hash);
+    }
+}
+
+
+Set *set_union(Set *a, Set *b, ThreadPool *pool) {
+    Set *large = a->count >= b->count ? a : b;
+    Set *small = a->count >= b->count ? b : a;
+    unsigned char *selected = (unsigned char *)calloc(small->capacity + small->rehash_index, 1);
+    Set *set = set_create();
+    if (selected == NULL || set == NULL) {
+        free(selected);
+        if (set) set_destroy(set);
+        return NULL;
+    }
+    unsigned long long n = __set_algebra_select__(small, large, 0, selected, pool);
+    if (__set_reserve__(set, large->count + n) != 0) {
+        free(selected);
+        set_destroy(set);
+        return NULL;
+    }
+    __set_add_selected__(set, large, NULL);
+    __set_add_selected__(set, small, selected);
+    free(selected);
+    return set;
+}
+
+
+Set *set_intersection(Set *a, Set *b, ThreadPool *pool) {
+    Set *large = a->count >= b->count ? a : b;
+    Set *small = a->count >= b->count ? b : a;
+    unsigned char *selected = (unsigned char *)calloc(small->capacity + small->rehash_index, 1);
+    Set *set = set_create();
+    if (selected == NULL || set == NULL) {
+        free(selected);
+        if (set) set_destroy(set);
+        return NULL;
+    }
+    unsigned long long n = __set_algebra_select__(small, large, 1, selected, pool);
+    if (__set_reserve__(set, n) != 0) {
+        free(selected);
+        set_destroy(set);
+        return NULL;
+    }
+    __set_add_selected__(set, small, selected);
+    free(selected);
+    return set;
+}
+
+
+Set *set_difference(Set *a, Set *b, ThreadPool *pool) {
+    unsigned char *selected = (unsigned char *)calloc(a->capacity + a->rehash_index, 1);
+    Set *set = set_create();
+    if (selected == NULL || set == NULL) {
+        free(selected);
+        if (set) set_destroy(set);
+        return NULL;
+    }
+    unsigned long long n = __set_algebra_select__(a, b, 0, selected, pool);
+    if (__set_reserve__(set, n) != 0) {
+        free(selected);
+        set_destroy(set);
+        return NULL;
+    }
+    __set_add_selected__(set, a, selected);
+    free(selected);
+    return set;
+}
+
+
+int set_is_subset(Set *a, Set *b, ThreadPool *pool) {
+    if (a->count > b->count) return 0;
+    unsigned char *selected = (unsigned char *)calloc(a->capacity + a->rehash_index, 1);
+    if (selected == NULL) return 0;
+    unsigned long long missing = __set_algebra_select__(a, b, 0, selected, pool);
+    free(selected);
+    return missing == 0;
+}
+
+
 void __set_add_int__(Set *set, int value) {
     __set_put__(set, SET_SLOT_INT, &value);
 }
@@ -269,9 +657,21 @@ void __set_del_string__(Set *set, char *value) {
 
 
 int __set_contains__(Set *set, _SetSlotState type, void *value) {
-    unsigned int hash = __set_get_hash__(type, value);
+    return __set_contains_hashed__(set, type, value, __set_get_hash__(type, value));
+}
+
+
+int __set_contains_hashed__(Set *set, _SetSlotState type, void *value, unsigned int hash) {
+    __set_rehash_step__(set, SET_REHASH_STEPS);
+    if (set->bloom && !bloom_check(set->bloom, hash)) {
+        set->bloom->skipped++;
+        return 0;
+    }
     _SetSlot *slot = __set_find_slot__(set, type, value, hash);
-    return slot->type > SET_SLOT_REMOVE && __set_slot_equal__(slot, type, value);
+    if (slot->type > SET_SLOT_REMOVE && __set_slot_equal__(slot, type, value)) return 1;
+    if (__set_find_old_slot__(set, type, value, hash) != NULL) return 1;
+    if (set->bloom) set->bloom->false_positives++;
+    return 0;
 }
 
 
@@ -297,4 +697,54 @@ int __set_contains_double__(Set *set, double value) {
 
 int __set_contains_string__(Set *set, char *value) {
     return __set_contains__(set, SET_SLOT_STRING, value);
+}
+
+
+void __set_add_many_int__(Set *set, int *values, int n) {
+    __set_add_many__(set, SET_SLOT_INT, values, n);
+}
+
+
+void __set_add_many_long__(Set *set, long *values, int n) {
+    __set_add_many__(set, SET_SLOT_LONG, values, n);
+}
+
+
+void __set_add_many_float__(Set *set, float *values, int n) {
+    __set_add_many__(set, SET_SLOT_FLOAT, values, n);
+}
+
+
+void __set_add_many_double__(Set *set, double *values, int n) {
+    __set_add_many__(set, SET_SLOT_DOUBLE, values, n);
+}
+
+
+void __set_add_many_string__(Set *set, char **values, int n) {
+    __set_add_many__(set, SET_SLOT_STRING, values, n);
+}
+
+
+int __set_contains_many_int__(Set *set, int *values, int n, int *results) {
+    return __set_contains_many__(set, SET_SLOT_INT, values, n, results);
+}
+
+
+int __set_contains_many_long__(Set *set, long *values, int n, int *results) {
+    return __set_contains_many__(set, SET_SLOT_LONG, values, n, results);
+}
+
+
+int __set_contains_many_float__(Set *set, float *values, int n, int *results) {
+    return __set_contains_many__(set, SET_SLOT_FLOAT, values, n, results);
+}
+
+
+int __set_contains_many_double__(Set *set, double *values, int n, int *results) {
+    return __set_contains_many__(set, SET_SLOT_DOUBLE, values, n, results);
+}
+
+
+int __set_contains_many_string__(Set *set, char **values, int n, int *results) {
+    return __set_contains_many__(set, SET_SLOT_STRING, values, n, results);
 }
\ No newline at end of file
@@ -7,24 +7,50 @@
 #include <string.h>
 
 
+#include "hash.h"
+#include "bloom.h"
+#include "typed_set.h"
+
+
+typedef struct ThreadPool ThreadPool;   // Only taken by pointer, `threadpool.h` is included by `set.c`.
+
+
+/**
+ * A typed set (`IntSet`, `LongSet`, `DoubleSet` or `StrSet` from `typed_set.h`) is routed by the type of `set`,
+ * a mixed-type `Set` by the type of `value`. A value the set cannot hold exactly (`set_add(intset, 3.5)`) fails to compile.
+**/
 #define set_add(set, value) do { \
-    _Generic((value), \
-        int: __set_add_int__, \
-        long: __set_add_long__, \
-        float: __set_add_float__, \
-        double: __set_add_double__, \
-        char *: __set_add_string__ \
+    _Generic((set), \
+        IntSet *: _Generic((value), __SET_INT_VALUE__(intset_add)), \
+        LongSet *: _Generic((value), __SET_LONG_VALUE__(longset_add)), \
+        DoubleSet *: _Generic((value), __SET_DOUBLE_VALUE__(doubleset_add)), \
+        StrSet *: _Generic((value), char *: strset_add, default: __set_type_mismatch__), \
+        default: _Generic((value), \
+            int: __set_add_int__, \
+            long: __set_add_long__, \
+            float: __set_add_float__, \
+            double: __set_add_double__, \
+            char *: __set_add_string__, \
+            default: __set_type_mismatch__ \
+        ) \
     )(set, value); \
 } while (0)
 
 
 #define set_remove(set, value) do { \
-    _Generic((value), \
-        int: __set_del_int__, \
-        long: __set_del_long__, \
-        float: __set_del_float__, \
-        double: __set_del_double__, \
-        char *: __set_del_string__ \
+    _Generic((set), \
+        IntSet *: _Generic((value), __SET_INT_VALUE__(intset_remove)), \
+        LongSet *: _Generic((value), __SET_LONG_VALUE__(longset_remove)), \
+        DoubleSet *: _Generic((value), __SET_DOUBLE_VALUE__(doubleset_remove)), \
+        StrSet *: _Generic((value), char *: strset_remove, default: __set_type_mismatch__), \
+        default: _Generic((value), \
+            int: __set_del_int__, \
+            long: __set_del_long__, \
+            float: __set_del_float__, \
+            double: __set_del_double__, \
+            char *: __set_del_string__, \
+            default: __set_type_mismatch__ \
+        ) \
     )(set, value); \
 } while (0)
 
@@ -35,15 +61,74 @@
  * @param value The value of data.
  * @return `1` for existence, `0` for nonexistence.
 **/
-#define set_contains(set, value) _Generic((value), \
-    int: __set_contains_int__, \
-    long: __set_contains_long__, \
-    float: __set_contains_float__, \
-    double: __set_contains_double__, \
-    char *: __set_contains_string__ \
+#define set_contains(set, value) _Generic((set), \
+    IntSet *: _Generic((value), __SET_INT_VALUE__(intset_contains)), \
+    LongSet *: _Generic((value), __SET_LONG_VALUE__(longset_contains)), \
+    DoubleSet *: _Generic((value), __SET_DOUBLE_VALUE__(doubleset_contains)), \
+    StrSet *: _Generic((value), char *: strset_contains, default: __set_type_mismatch__), \
+    default: _Generic((value), \
+        int: __set_contains_int__, \
+        long: __set_contains_long__, \
+        float: __set_contains_float__, \
+        double: __set_contains_double__, \
+        char *: __set_contains_string__, \
+        default: __set_type_mismatch__ \
+    ) \
 )(set, value)
 
 
+/**
+ * @brief Add the elements of an array (hashed and prefetched in batches of `SET_BATCH`).
+ * @param set The pointer of set.
+ * @param values The array (`int *`, `long *`, `float *`, `double *` or `char **`, `long long *` for a `LongSet`), the element type of a typed set.
+ * @param n The number of elements.
+**/
+#define set_add_many(set, values, n) _Generic((set), \
+    IntSet *: _Generic((values), int *: intset_add_many, default: __set_type_mismatch__), \
+    LongSet *: _Generic((values), long long *: longset_add_many, default: __set_type_mismatch__), \
+    DoubleSet *: _Generic((values), double *: doubleset_add_many, default: __set_type_mismatch__), \
+    StrSet *: _Generic((values), char **: strset_add_many, default: __set_type_mismatch__), \
+    default: _Generic((values), \
+        int *: __set_add_many_int__, \
+        long *: __set_add_many_long__, \
+        float *: __set_add_many_float__, \
+        double *: __set_add_many_double__, \
+        char **: __set_add_many_string__, \
+        default: __set_type_mismatch__ \
+    ) \
+)(set, values, n)
+
+
+/**
+ * @brief Determine whether each element of an array exists (hashed and prefetched in batches of `SET_BATCH`).
+ * @param set The pointer of set.
+ * @param values The array (`int *`, `long *`, `float *`, `double *` or `char **`, `long long *` for a `LongSet`), the element type of a typed set.
+ * @param n The number of elements.
+ * @param results Receive `1` or `0` for every element (`NULL` for counting only).
+ * @return The number of existing elements.
+**/
+#define set_contains_many(set, values, n, results) _Generic((set), \
+    IntSet *: _Generic((values), int *: intset_contains_many, default: __set_type_mismatch__), \
+    LongSet *: _Generic((values), long long *: longset_contains_many, default: __set_type_mismatch__), \
+    DoubleSet *: _Generic((values), double *: doubleset_contains_many, default: __set_type_mismatch__), \
+    StrSet *: _Generic((values), char **: strset_contains_many, default: __set_type_mismatch__), \
+    default: _Generic((values), \
+        int *: __set_contains_many_int__, \
+        long *: __set_contains_many_long__, \
+        float *: __set_contains_many_float__, \
+        double *: __set_contains_many_double__, \
+        char **: __set_contains_many_string__, \
+        default: __set_type_mismatch__ \
+    ) \
+)(set, values, n, results)
+
+
+// The values a typed set takes without losing anything, the others reach `__set_type_mismatch__`.
+#define __SET_INT_VALUE__(func) char: func, signed char: func, unsigned char: func, short: func, unsigned short: func, int: func, default: __set_type_mismatch__
+#define __SET_LONG_VALUE__(func) char: func, signed char: func, unsigned char: func, short: func, unsigned short: func, int: func, unsigned int: func, long: func, long long: func, default: __set_type_mismatch__
+#define __SET_DOUBLE_VALUE__(func) int: func, float: func, double: func, default: __set_type_mismatch__
+
+
 typedef enum {
     SET_SLOT_EMPTY,
     SET_SLOT_REMOVE,
@@ -68,11 +153,25 @@ typedef struct {
 } _SetSlot;
 
 
+#define SET_REHASH_STEPS 16     // Old slots migrated per operation while an incremental resize is running (more by a put short of headroom).
+#define SET_TRIM_SLOTS 4096     // Migrated old slots released together while an incremental resize is running.
+#define SET_BATCH 16            // Elements hashed and prefetched together by the `_many` functions.
+#define SET_PARALLEL_THRESHOLD 65536    // Slots scanned before a set algebra operation is split across a ThreadPool.
+#define SET_PARALLEL_CHUNKS 4           // Chunks per participant, so that uneven chunks still balance.
+
+
 typedef struct {
     _SetSlot *buckets;
     unsigned long long capacity;
     unsigned long long count;
     unsigned long long used;
+    int incremental;                    // `1` for spreading every resize over the following operations.
+    _SetSlot *old_buckets;              // The slots being drained by an incremental resize (`NULL` otherwise).
+    unsigned long long old_capacity;
+    unsigned long long rehash_index;    // The old slots below it are still to migrate, the ones above are released.
+    _SetSlot *next_buckets;             // The slots of the next expansion, zeroed ahead in incremental mode (`NULL` otherwise).
+    unsigned long long next_zeroed;     // The zeroed prefix of `next_buckets`.
+    BloomFilter *bloom;                 // Checked before the slots (`NULL` when disabled).
 } Set;
 
 
@@ -97,12 +196,76 @@ void set_view(Set *set);
 
 
 /**
- * @brief Use the FNV-1a function to calculate the hash value.
- * @param data The raw data.
- * @param length The length of data.
+ * @brief Create the union of two sets (the smaller operand is scanned).
+ * @param a The pointer of set.
+ * @param b The pointer of set.
+ * @param pool Large operands are scanned in chunks on this ThreadPool (`NULL` for the calling thread only).
+ * @return The pointer of a new set (`NULL` for failure).
+**/
+Set *set_union(Set *a, Set *b, ThreadPool *pool);
+
+
+/**
+ * @brief Create the intersection of two sets (the smaller operand is scanned).
+ * @param a The pointer of set.
+ * @param b The pointer of set.
+ * @param pool Large operands are scanned in chunks on this ThreadPool (`NULL` for the calling thread only).
+ * @return The pointer of a new set (`NULL` for failure).
+**/
+Set *set_intersection(Set *a, Set *b, ThreadPool *pool);
+
+
+/**
+ * @brief Create the set of elements in `a` but not in `b` (`a` is scanned).
+ * @param a The pointer of set.
+ * @param b The pointer of set.
+ * @param pool Large operands are scanned in chunks on this ThreadPool (`NULL` for the calling thread only).
+ * @return The pointer of a new set (`NULL` for failure).
+**/
+Set *set_difference(Set *a, Set *b, ThreadPool *pool);
+
+
+/**
+ * @brief Determine whether every element of `a` exists in `b`.
+ * @param a The pointer of set.
+ * @param b The pointer of set.
+ * @param pool Large operands are scanned in chunks on this ThreadPool (`NULL` for the calling thread only).
+ * @return `1` for subset, `0` otherwise.
+**/
+int set_is_subset(Set *a, Set *b, ThreadPool *pool);
+
+
+/**
+ * @brief Enable or disable incremental resizing (no single operation pays for a whole rehash).
+ * @param set The pointer of set.
+ * @param enable `1` for incremental resizing, `0` for default resizing in one call.
+**/
+void set_config_incremental(Set *set, int enable);
+
+
+/**
+ * @brief Enable or disable a counting Bloom filter in front of the slots, so most lookups of missing elements never probe.
+ * @param set The pointer of set.
+ * @param enable `1` for enabling, `0` for disabling.
+ * @return `0` for success, `1` for failure.
+**/
+int set_config_bloom(Set *set, int enable);
+
+
+/**
+ * @brief Rebuild the Bloom filter for the current capacity (the counters `skipped` and `false_positives` are kept).
+ * @param set The pointer of set.
+ * @return `0` for success, `1` for failure (the old filter stays valid).
+**/
+int __set_bloom_rebuild__(Set *set);
+
+
+/**
+ * @brief Fold a 64-bit hash value into the 32-bit slot hash.
+ * @param hash The 64-bit hash value.
  * @return The hash value.
 **/
-unsigned int __hash_fnv_1a__(void *data, unsigned long long length);
+unsigned int __set_fold_hash__(unsigned long long hash);
 
 
 /**
@@ -124,6 +287,49 @@ unsigned int __set_get_hash__(_SetSlotState type, void *value);
 int __set_slot_equal__(_SetSlot *slot, _SetSlotState type, void *value);
 
 
+/**
+ * @brief Move every element to a slot array with a new capacity (only started in incremental mode).
+ * @param set The pointer of set.
+ * @param capacity The new capacity (power of two).
+ * @return `0` for success, `1` for failure.
+**/
+int __set_rehash__(Set *set, unsigned long long capacity);
+
+
+/**
+ * @brief Migrate a bounded number of old slots of an incremental resize.
+ * @param set The pointer of set.
+ * @param n The number of old slots to visit.
+**/
+void __set_rehash_step__(Set *set, unsigned long long n);
+
+
+/**
+ * @brief Determine how many old slots a put migrates, so an incremental resize ends before the next one is due.
+ * @param set The pointer of set.
+ * @return The number of old slots to visit.
+**/
+unsigned long long __set_rehash_pace__(Set *set);
+
+
+/**
+ * @brief Zero a share of the slots of the next expansion, so that expansion does not clear a whole array in one put.
+ * @param set The pointer of set.
+**/
+void __set_prepare_step__(Set *set);
+
+
+/**
+ * @brief Find an element in the old slots of an unfinished incremental resize.
+ * @param set The pointer of set.
+ * @param type The type of entity element.
+ * @param value The data value.
+ * @param hash The input hash value.
+ * @return The pointer of old slot, `NULL` for nonexistence.
+**/
+_SetSlot *__set_find_old_slot__(Set *set, _SetSlotState type, void *value, unsigned int hash);
+
+
 /**
  * @brief Expand the capacity of set.
  * @param set The pointer of set.
@@ -152,6 +358,16 @@ _SetSlot *__set_find_slot__(Set *set, _SetSlotState type, void *value, unsigned
 void __set_put__(Set *set, _SetSlotState type, void *value);
 
 
+/**
+ * @brief Put an element whose hash value is already known into the set.
+ * @param set The pointer of set.
+ * @param type The type of entity element.
+ * @param value The data value.
+ * @param hash The hash value of data.
+**/
+void __set_put_hashed__(Set *set, _SetSlotState type, void *value, unsigned int hash);
+
+
 /**
  * @brief If the number of elements in the set is small, execute capacity reduction.
  * @param set The pointer of set.
@@ -178,6 +394,125 @@ void __set_del__(Set *set, _SetSlotState type, void *value);
 int __set_contains__(Set *set, _SetSlotState type, void *value);
 
 
+/**
+ * @brief Determine whether an element whose hash value is already known exists.
+ * @param set The pointer of set.
+ * @param type The type of set slot.
+ * @param value The value of data.
+ * @param hash The hash value of data.
+ * @return `1` for existence, `0` for nonexistence.
+**/
+int __set_contains_hashed__(Set *set, _SetSlotState type, void *value, unsigned int hash);
+
+
+/**
+ * @brief Get the address of the i-th element of an array in the form `__set_get_hash__` expects.
+ * @param type The type of array element.
+ * @param values The array.
+ * @param i The index.
+ * @return The pointer to the element (the string itself for `SET_SLOT_STRING`).
+**/
+void *__set_array_at__(_SetSlotState type, void *values, int i);
+
+
+/**
+ * @brief Add the elements of an array.
+ * @param set The pointer of set.
+ * @param type The type of array element.
+ * @param values The array.
+ * @param n The number of elements.
+**/
+void __set_add_many__(Set *set, _SetSlotState type, void *values, int n);
+
+
+/**
+ * @brief Determine whether each element of an array exists.
+ * @param set The pointer of set.
+ * @param type The type of array element.
+ * @param values The array.
+ * @param n The number of elements.
+ * @param results Receive `1` or `0` for every element (`NULL` for counting only).
+ * @return The number of existing elements.
+**/
+int __set_contains_many__(Set *set, _SetSlotState type, void *values, int n, int *results);
+
+
+/**
+ * @brief Get the value pointer of a slot in the form `__set_find_slot__` expects.
+ * @param slot The pointer of set slot.
+ * @return The pointer to the element (the string itself for `SET_SLOT_STRING`).
+**/
+void *__set_slot_value__(_SetSlot *slot);
+
+
+/**
+ * @brief Determine whether the element of a slot exists in a set without migrating anything (safe for concurrent readers).
+ * @param set The pointer of set.
+ * @param slot The slot of another set.
+ * @return `1` for existence, `0` for nonexistence.
+**/
+int __set_lookup__(Set *set, _SetSlot *slot);
+
+
+/**
+ * @brief Grow the capacity so that a number of elements fits without any further resize.
+ * @param set The pointer of set.
+ * @param n The number of elements.
+ * @return `0` for success, `1` for failure.
+**/
+int __set_reserve__(Set *set, unsigned long long n);
+
+
+/**
+ * @brief Get a slot by its index in the new slots followed by the old slots of an unfinished incremental resize.
+ * @param set The pointer of set.
+ * @param index The index, below `capacity + rehash_index`.
+ * @return The pointer of set slot.
+**/
+_SetSlot *__set_slot_at__(Set *set, unsigned long long index);
+
+
+/**
+ * @brief Flag the elements in a range of slots of `source` found (or missing) in `other`.
+ * @param source The scanned set.
+ * @param other The probed set.
+ * @param keep `1` selects the elements found in `other`, `0` selects the missing ones.
+ * @param selected Receive one flag per slot of `source`.
+ * @param begin The first slot index (see `__set_slot_at__`).
+ * @param end The slot index after the last one.
+ * @return The number of selected elements in the range.
+**/
+unsigned long long __set_algebra_scan__(Set *source, Set *other, int keep, unsigned char *selected, unsigned long long begin, unsigned long long end);
+
+
+/**
+ * @brief Claim and scan chunks of a parallel set algebra job until none is left, then drop one reference to the job.
+ * @param args The pointer of the job, released by whoever drops the last reference.
+**/
+void __set_algebra_help__(void *args);
+
+
+/**
+ * @brief Flag the elements of `source` found (or missing) in `other`, in parallel for large operands.
+ * @param source The scanned set, only read (the old slots of an unfinished incremental resize are scanned too).
+ * @param other The probed set, only read.
+ * @param keep `1` selects the elements found in `other`, `0` selects the missing ones.
+ * @param selected Receive one flag per slot of `source`, `capacity + rehash_index` of them.
+ * @param pool The ThreadPool, may be the one running the caller (`NULL` for the calling thread only).
+ * @return The number of selected elements.
+**/
+unsigned long long __set_algebra_select__(Set *source, Set *other, int keep, unsigned char *selected, ThreadPool *pool);
+
+
+/**
+ * @brief Add the selected elements of a set into another set.
+ * @param set The destination set.
+ * @param source The source set.
+ * @param selected One flag per slot of `source`, old slots included (`NULL` for every element).
+**/
+void __set_add_selected__(Set *set, Set *source, unsigned char *selected);
+
+
 void __set_add_int__(Set *set, int value);
 
 
@@ -223,4 +558,36 @@ int __set_contains_double__(Set *set, double value);
 int __set_contains_string__(Set *set, char *value);
 
 
+void __set_add_many_int__(Set *set, int *values, int n);
+
+void __set_add_many_long__(Set *set, long *values, int n);
+
+void __set_add_many_float__(Set *set, float *values, int n);
+
+void __set_add_many_double__(Set *set, double *values, int n);
+
+void __set_add_many_string__(Set *set, char **values, int n);
+
+
+int __set_contains_many_int__(Set *set, int *values, int n, int *results);
+
+
+int __set_contains_many_long__(Set *set, long *values, int n, int *results);
+
+
+int __set_contains_many_float__(Set *set, float *values, int n, int *results);
+
+
+int __set_contains_many_double__(Set *set, double *values, int n, int *results);
+
+
+int __set_contains_many_string__(Set *set, char **values, int n, int *results);
+
+
+/**
+ * @brief Never defined, a value or an array of a type the set cannot hold selects it in `set_add` and friends, so the call fails to compile.
+**/
+void __set_type_mismatch__(void);
+
+
 #endif
\ No newline at end of file
@@ -0,0 +1,242 @@
+#include "task_graph.h"
+
+
+TaskGraph *task_graph_create() {
+    TaskGraph *graph = (TaskGraph *)calloc(1, sizeof(TaskGraph));
+    if (!graph) return NULL;
+    graph->nodes = (TaskGraphNode *)calloc(TASK_GRAPH_MIN_CAPACITY, sizeof(TaskGraphNode));
+    if (!graph->nodes) {
+        free(graph);
+        return NULL;
+    }
+    graph->capacity = TASK_GRAPH_MIN_CAPACITY;
+    return graph;
+}
+
+
+int task_graph_add_node(TaskGraph *graph, void (*func)(void *args), void *args) {
+    if (graph == NULL || func == NULL) return -1;
+
+    if (graph->n_nodes == graph->capacity) {
+        TaskGraphNode *nodes = (TaskGraphNode *)realloc(graph->nodes, 2 * graph->capacity * sizeof(TaskGraphNode));
+        if (!nodes) return -1;
+        graph->nodes = nodes;
+        graph->capacity = 2 * graph->capacity;
+    }
+
+    TaskGraphNode *node = &graph->nodes[graph->n_nodes];
+    memset(node, 0, sizeof(TaskGraphNode));
+    node->func = func;
+    node->args = args;
+    node->via = -1;
+    return graph->n_nodes++;
+}
+
+
+int task_graph_add_edge(TaskGraph *graph, int from, int to) {
+    if (graph == NULL || from < 0 || from >= graph->n_nodes || to < 0 || to >= graph->n_nodes || from == to) return 1;
+
+    TaskGraphNode *node = &graph->nodes[from];
+    if (node->n_successors == node->capacity) {
+        int capacity = node->capacity ? 2 * node->capacity : TASK_GRAPH_MIN_SUCCESSORS;
+        int *successors = (int *)realloc(node->successors, capacity * sizeof(int));
+        if (!successors) return 1;
+        node->successors = successors;
+        node->capacity = capacity;
+    }
+    node->successors[node->n_successors++] = to;
+    graph->nodes[to].n_predecessors++;
+    return 0;
+}
+
+
+int task_graph_run(TaskGraph *graph, ThreadPool *pool) {
+    if (graph == NULL || pool == NULL) return 1;
+    if (__task_graph_sort__(graph) != 0) return 1;
+
+    graph->pool = pool;
+    graph->n_cancelled = 0;
+    for (int i = 0; i < graph->n_nodes; i++) {
+        TaskGraphNode *node = &graph->nodes[i];
+        node->graph = graph;
+        node->pending = node->n_predecessors;
+        node->cancelled = 0;
+        node->state = TASK_GRAPH_NODE_PENDING;
+        node->start = 0;
+        node->finish = 0;
+    }
+    atomic_set(&graph->remaining, graph->n_nodes);
+    graph->origin = os_time();
+
+    for (int i = 0; i < graph->n_nodes; i++) {
+        TaskGraphNode *node = &graph->nodes[i];
+        if (node->n_predecessors > 0) continue;
+        if (__threadpool_add_helping__(pool, __task_graph_execute__, node, __task_graph_release__) == 0) continue;
+        // The pool is shutting down, the root and everything after it are cancelled here.
+        atomic_set(&node->state, TASK_GRAPH_NODE_CANCELLED);
+        atomic_add(&graph->n_cancelled, 1);
+        __task_graph_complete__(node);
+        __task_graph_leave__(graph);
+    }
+
+    // Same as `future_wait`, the caller runs queued tasks (of this graph or not) before it parks.
+    while (atomic_get(&graph->remaining) > 0) {
+        if (__threadpool_help__(pool) == 0) continue;
+        __threadpool_lock__(pool);
+        __threadpool_park__(pool, &pool->completed, __task_graph_ready__, graph);
+        mutex_unlock(&pool->queue_lock);
+    }
+
+    graph->elapsed = os_time() - graph->origin;
+    __task_graph_critical_path__(graph);
+    return atomic_get(&graph->n_cancelled) ? 1 : 0;
+}
+
+
+void task_graph_view(TaskGraph *graph) {
+    printf("TaskGraph Information: nodes = %d, elapsed = %.6f s, critical_path = %.6f s, cancelled = %d\n", graph->n_nodes, graph->elapsed, graph->critical_path, graph->n_cancelled);
+    for (int i = 0; i < graph->n_nodes; i++) {
+        TaskGraphNode *node = &graph->nodes[i];
+        const char *state = node->state == TASK_GRAPH_NODE_DONE ? "done" : node->state == TASK_GRAPH_NODE_CANCELLED ? "cancelled" : "pending";
+        printf("%c node [%d] %s: start = %.6f s, finish = %.6f s, run = %.6f s, successors = %d\n", node->critical ? '*' : ' ', i, state, node->start, node->finish, node->finish - node->start, node->n_successors);
+    }
+}
+
+
+void task_graph_destroy(TaskGraph *graph) {
+    if (!graph) return;
+    for (int i = 0; i < graph->n_nodes; i++) free(graph->nodes[i].successors);
+    free(graph->nodes);
+    free(graph->order);
+    free(graph);
+}
+
+
+int __task_graph_sort__(TaskGraph *graph) {
+    int *order = (int *)realloc(graph->order, (graph->n_nodes ? graph->n_nodes : 1) * sizeof(int));
+    if (!order) return 1;
+    graph->order = order;
+
+    // Kahn's algorithm, `pending` is free until the run starts.
+    int n = 0;
+    for (int i = 0; i < graph->n_nodes; i++) {
+        graph->nodes[i].pending = graph->nodes[i].n_predecessors;
+        if (graph->nodes[i].pending == 0) order[n++] = i;
+    }
+    for (int head = 0; head < n; head++) {
+        TaskGraphNode *node = &graph->nodes[order[head]];
+        for (int i = 0; i < node->n_successors; i++) {
+            if (--graph->nodes[node->successors[i]].pending == 0) order[n++] = node->successors[i];
+        }
+    }
+    return n == graph->n_nodes ? 0 : 1;
+}
+
+
+void __task_graph_execute__(void *args) {
+    TaskGraphNode *node = (TaskGraphNode *)args;
+    TaskGraph *graph = node->graph;
+
+    // Only the first node is counted by `__task_graph_release__`, that keeps the graph alive until the cleanup is done with it.
+    for (int first = 1; node; first = 0) {
+        node->start = os_time() - graph->origin;
+        node->func(node->args);
+        node->finish = os_time() - graph->origin;
+        atomic_set(&node->state, TASK_GRAPH_NODE_DONE);
+
+        // The successor made ready last runs right here while its inputs are still in cache, the others are queued
+        // (on the deque of this worker in stealing mode).
+        TaskGraphNode *next = __task_graph_complete__(node);
+        if (!first) __task_graph_leave__(graph);
+        node = next;
+    }
+}
+
+
+void __task_graph_release__(void *args) {
+    TaskGraphNode *node = (TaskGraphNode *)args;
+    TaskGraph *graph = node->graph;
+
+    if (atomic_get(&node->state) == TASK_GRAPH_NODE_PENDING) {
+        atomic_set(&node->state, TASK_GRAPH_NODE_CANCELLED);
+        atomic_add(&graph->n_cancelled, 1);
+        __task_graph_complete__(node);
+    }
+    __task_graph_leave__(graph);
+}
+
+
+TaskGraphNode *__task_graph_complete__(TaskGraphNode *node) {
+    TaskGraph *graph = node->graph;
+    TaskGraphNode *next = NULL;
+    TaskGraphNode *cancelled = NULL;
+    TaskGraphNode *current = node;
+
+    while (current) {
+        int failed = atomic_get(&current->state) == TASK_GRAPH_NODE_CANCELLED;
+        for (int i = 0; i < current->n_successors; i++) {
+            TaskGraphNode *successor = &graph->nodes[current->successors[i]];
+            if (failed) atomic_set(&successor->cancelled, 1);
+            if (atomic_sub(&successor->pending, 1) != 1) continue;
+
+            if (!atomic_get(&successor->cancelled)) {
+                if (next == NULL) {
+                    next = successor;
+                    continue;
+                }
+                if (__threadpool_add_helping__(graph->pool, __task_graph_execute__, successor, __task_graph_release__) == 0) continue;
+            }
+            atomic_set(&successor->state, TASK_GRAPH_NODE_CANCELLED);
+            atomic_add(&graph->n_cancelled, 1);
+            successor->link = cancelled;
+            cancelled = successor;
+        }
+
+        // Cancelled nodes are finished here, an explicit stack keeps a long cancelled chain off the call stack.
+        if (current != node) __task_graph_leave__(graph);
+        current = cancelled;
+        if (cancelled) cancelled = cancelled->link;
+    }
+    return next;
+}
+
+
+void __task_graph_leave__(TaskGraph *graph) {
+    ThreadPool *pool = graph->pool;
+    if (atomic_sub(&graph->remaining, 1) == 1) __threadpool_wake__(pool, &pool->completed, 1 << 30);
+}
+
+
+int __task_graph_ready__(ThreadPool *pool, void *arg) {
+    (void)pool;
+    return atomic_get(&((TaskGraph *)arg)->remaining) == 0;
+}
+
+
+void __task_graph_critical_path__(TaskGraph *graph) {
+    for (int i = 0; i < graph->n_nodes; i++) {
+        graph->nodes[i].path = 0;
+        graph->nodes[i].via = -1;
+        graph->nodes[i].critical = 0;
+    }
+
+    int tail = -1;
+    graph->critical_path = 0;
+    for (int k = 0; k < graph->n_nodes; k++) {
+        TaskGraphNode *node = &graph->nodes[graph->order[k]];
+        // `path` holds the best chain of the predecessors until the node itself is added.
+        node->path = node->path + (node->finish - node->start);
+        if (tail < 0 || node->path > graph->critical_path) {
+            tail = graph->order[k];
+            graph->critical_path = node->path;
+        }
+        for (int i = 0; i < node->n_successors; i++) {
+            TaskGraphNode *successor = &graph->nodes[node->successors[i]];
+            if (successor->via < 0 || node->path > successor->path) {
+                successor->path = node->path;
+                successor->via = graph->order[k];
+            }
+        }
+    }
+    for (int i = tail; i >= 0; i = graph->nodes[i].via) graph->nodes[i].critical = 1;
+}
@@ -0,0 +1,163 @@
+#ifndef _TASK_GRAPH_H_
+#define _TASK_GRAPH_H_
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+#include "os.h"
+#include "atomic.h"
+#include "threadpool.h"
+
+
+#define TASK_GRAPH_MIN_CAPACITY 16      // Initial slots of the node array.
+#define TASK_GRAPH_MIN_SUCCESSORS 4     // Initial slots of the successor array of a node.
+
+
+#define TASK_GRAPH_NODE_PENDING 0
+#define TASK_GRAPH_NODE_DONE 1
+#define TASK_GRAPH_NODE_CANCELLED 2     // Dropped by `threadpool_destroy`, or a predecessor was.
+
+
+typedef struct TaskGraphNode {
+    void (*func)(void *args);
+    void *args;
+    int *successors;    // Node ids, edges are stored on the predecessor only.
+    int n_successors;
+    int capacity;
+    int n_predecessors;
+    int pending;        // Predecessors not finished yet in the current run, the node is ready at `0`.
+    int cancelled;      // Set by a cancelled predecessor before it counts `pending` down.
+    int state;          // `TASK_GRAPH_NODE_PENDING`, `TASK_GRAPH_NODE_DONE` or `TASK_GRAPH_NODE_CANCELLED`.
+    double start;       // Seconds since the run started.
+    double finish;
+    double path;        // The longest chain of run times ending with this node.
+    int via;            // The predecessor of this node on that chain, `-1` for none.
+    int critical;       // `1` when the node lies on the critical path of the last run.
+    struct TaskGraphNode *link;     // Cancelled nodes whose successors are not counted down yet.
+    struct TaskGraph *graph;
+} TaskGraphNode;
+
+
+typedef struct TaskGraph {
+    TaskGraphNode *nodes;
+    int n_nodes;
+    int capacity;
+    int *order;         // A topological order of nodes, rebuilt by every run.
+    ThreadPool *pool;
+    int remaining;      // Nodes of the current run not finished yet.
+    int n_cancelled;
+    double origin;      // `os_time` when the run started.
+    double elapsed;     // Wall time of the last run in seconds.
+    double critical_path;   // The sum of run times along the longest dependency chain of the last run.
+} TaskGraph;
+
+
+/**
+ * @brief Create an empty task graph.
+ * @return The pointer of graph (`NULL` for failure).
+**/
+TaskGraph *task_graph_create();
+
+
+/**
+ * @brief Add a node, it runs `func(args)` once all of its predecessors have finished.
+ * @param graph The pointer of graph.
+ * @param func The pointer of task function like `void func(void *args)`.
+ * @param args The arguments of task function.
+ * @return The id of node, `-1` for failure.
+**/
+int task_graph_add_node(TaskGraph *graph, void (*func)(void *args), void *args);
+
+
+/**
+ * @brief Add a dependency, the node `to` runs after the node `from` has finished.
+ * @param graph The pointer of graph.
+ * @param from The id of predecessor.
+ * @param to The id of successor.
+ * @return `0` for success, `1` for failure.
+**/
+int task_graph_add_edge(TaskGraph *graph, int from, int to);
+
+
+/**
+ * @brief Run every node of the graph on a thread pool, the caller runs queued tasks until the graph is finished.
+ * A finished node runs its first ready successor on the same thread, the other ready ones go through `threadpool_add`:
+ * into the deque of the running worker with `threadpool_config_stealing`, into the shared queue of the pool otherwise.
+ * @param graph The pointer of graph (nodes and edges must not be added during the run).
+ * @param pool The pointer of thread pool.
+ * @return `0` for success, `1` for a cycle (nothing runs) or cancelled nodes.
+**/
+int task_graph_run(TaskGraph *graph, ThreadPool *pool);
+
+
+/**
+ * @brief Print the per-node timings and the critical path of the last run.
+ * @param graph The pointer of graph.
+**/
+void task_graph_view(TaskGraph *graph);
+
+
+/**
+ * @brief Free the memory of graph.
+ * @param graph The pointer of graph.
+**/
+void task_graph_destroy(TaskGraph *graph);
+
+
+/**
+ * @brief Build the topological order of nodes.
+ * @param graph The pointer of graph.
+ * @return `0` for success, `1` for a cycle or failure.
+**/
+int __task_graph_sort__(TaskGraph *graph);
+
+
+/**
+ * @brief The task function of a node: run it, then keep running the first successor it makes ready on the same thread.
+ * @param args The pointer of node.
+**/
+void __task_graph_execute__(void *args);
+
+
+/**
+ * @brief The cleanup of a node task: cancel the node if the pool dropped it, then count it as finished.
+ * @param args The pointer of node.
+**/
+void __task_graph_release__(void *args);
+
+
+/**
+ * @brief Count down the successors of a finished or cancelled node, queue the ready ones and cancel along cancelled nodes.
+ * @param node The pointer of node.
+ * @return A ready successor left for the caller to run, `NULL` for none.
+**/
+TaskGraphNode *__task_graph_complete__(TaskGraphNode *node);
+
+
+/**
+ * @brief Count a node as finished, waking up the thread in `task_graph_run` after the last one.
+ * @param graph The pointer of graph.
+**/
+void __task_graph_leave__(TaskGraph *graph);
+
+
+/**
+ * @brief Determine whether every node of the current run has finished.
+ * @param pool The pointer of thread pool.
+ * @param arg The pointer of graph.
+ * @return `1` for finished, `0` otherwise.
+**/
+int __task_graph_ready__(ThreadPool *pool, void *arg);
+
+
+/**
+ * @brief Compute the longest chain of run times and mark its nodes.
+ * @param graph The pointer of graph.
+**/
+void __task_graph_critical_path__(TaskGraph *graph);
+
+
+#endif
@@ -83,6 +83,86 @@ void thread_exit() {
 }
 
 
+unsigned long long thread_id() {
+    #if defined(__OS_UNIX__)
+        return (unsigned long long)pthread_self();
+    #elif defined(__OS_WINDOWS__)
+        return (unsigned long long)GetCurrentThreadId();
+    #endif
+}
+
+
+void thread_yield() {
+    #if defined(__OS_UNIX__)
+        sched_yield();
+    #elif defined(__OS_WINDOWS__)
+        SwitchToThread();
+    #endif
+}
+
+
+int thread_affinity(Thread *thread, int cpu) {
+    if (cpu < 0) return 1;
+    #if defined(__linux__)
+        if (cpu >= CPU_SETSIZE) return 1;
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cpu, &set);
+        return pthread_setaffinity_np(*thread, sizeof(cpu_set_t), &set) == 0 ? 0 : 1;
+    #elif defined(__OS_WINDOWS__)
+        if (cpu >= 8 * (int)sizeof(DWORD_PTR)) return 1;
+        return SetThreadAffinityMask(*thread, (DWORD_PTR)1 << cpu) != 0 ? 0 : 1;
+    #else
+        // macOS only takes affinity hints between threads, not CPU numbers.
+        return 1;
+    #endif
+}
+
+
+int thread_cpu() {
+    #if defined(__linux__)
+        return sched_getcpu();
+    #elif defined(__OS_WINDOWS__)
+        return (int)GetCurrentProcessorNumber();
+    #else
+        return -1;
+    #endif
+}
+
+
+int thread_cpu_count() {
+    #if defined(__OS_UNIX__)
+        long count = sysconf(_SC_NPROCESSORS_ONLN);
+        return count > 0 ? (int)count : 1;
+    #elif defined(__OS_WINDOWS__)
+        SYSTEM_INFO info;
+        GetSystemInfo(&info);
+        return info.dwNumberOfProcessors > 0 ? (int)info.dwNumberOfProcessors : 1;
+    #endif
+}
+
+
+int thread_numa_node(int cpu) {
+    if (cpu < 0) return -1;
+    #if defined(__linux__)
+        // Every node directory links the CPUs it holds, a kernel without NUMA support has no `node0` at all.
+        char path[96];
+        for (int node = 0; ; node++) {
+            snprintf(path, sizeof(path), "/sys/devices/system/node/node%d", node);
+            if (access(path, F_OK) != 0) return node == 0 ? 0 : -1;
+            snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpu%d", node, cpu);
+            if (access(path, F_OK) == 0) return node;
+        }
+    #elif defined(__OS_WINDOWS__)
+        UCHAR node;
+        if (cpu > 255 || !GetNumaProcessorNode((UCHAR)cpu, &node) || node == 0xFF) return -1;
+        return node;
+    #else
+        return 0;
+    #endif
+}
+
+
 int mutex_create(Mutex *mutex, int type) {
     #if defined(__OS_UNIX__)
         pthread_mutexattr_t t;
@@ -190,6 +270,21 @@ int condition_wait(ThreadCondition *condition, Mutex *mutex) {
 }
 
 
+int condition_timedwait(ThreadCondition *condition, Mutex *mutex, double timeout) {
+    #if defined(__OS_UNIX__)
+        // `pthread_cond_timedwait` takes an absolute time on the realtime clock.
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        long long nanoseconds = deadline.tv_nsec + (long long)(timeout * 1e9);
+        deadline.tv_sec = deadline.tv_sec + nanoseconds / 1000000000LL;
+        deadline.tv_nsec = nanoseconds % 1000000000LL;
+        return pthread_cond_timedwait(condition, mutex, &deadline) == 0 ? 0 : 1;
+    #elif defined(__OS_WINDOWS__)
+        return __condition_timedwait_win32__(condition, mutex, (DWORD)(timeout * 1000));
+    #endif
+}
+
+
 int condition_signal(ThreadCondition *condition) {
     #if defined(__OS_UNIX__)
         return pthread_cond_signal(condition) == 0 ? 0 : 1;
@@ -216,6 +311,78 @@ int condition_broadcast(ThreadCondition *condition) {
 }
 
 
+int event_init(ThreadEvent *event) {
+    event->signaled = 0;
+    #if defined(__OS_WINDOWS__)
+        event->event = CreateEvent(NULL, FALSE, FALSE, NULL);
+        return event->event != NULL ? 0 : 1;
+    #elif defined(THREAD_EVENT_FUTEX)
+        return 0;
+    #else
+        if (mutex_create(&event->mutex, 1) != 0) return 1;
+        if (condition_init(&event->condition) != 0) {
+            mutex_destroy(&event->mutex);
+            return 1;
+        }
+        return 0;
+    #endif
+}
+
+
+void event_destroy(ThreadEvent *event) {
+    #if defined(__OS_WINDOWS__)
+        CloseHandle(event->event);
+    #elif !defined(THREAD_EVENT_FUTEX)
+        condition_destroy(&event->condition);
+        mutex_destroy(&event->mutex);
+    #else
+        (void)event;
+    #endif
+}
+
+
+int event_wait(ThreadEvent *event, double timeout) {
+    #if defined(__OS_WINDOWS__)
+        return WaitForSingleObject(event->event, timeout > 0 ? (DWORD)(timeout * 1000) : INFINITE) == WAIT_OBJECT_0 ? 0 : 1;
+    #elif defined(THREAD_EVENT_FUTEX)
+        struct timespec t;
+        t.tv_sec = (time_t)timeout;
+        t.tv_nsec = (long)((timeout - (double)t.tv_sec) * 1e9);
+        // The kernel sleeps only while the word is still `0`, a set racing with the call makes it return at once.
+        while (__atomic_exchange_n(&event->signaled, 0, __ATOMIC_ACQUIRE) == 0) {
+            long status = syscall(SYS_futex, &event->signaled, FUTEX_WAIT_PRIVATE, 0, timeout > 0 ? &t : NULL, NULL, 0);
+            if (status != 0 && errno == ETIMEDOUT) return __atomic_exchange_n(&event->signaled, 0, __ATOMIC_ACQUIRE) ? 0 : 1;
+        }
+        return 0;
+    #else
+        int status = 0;
+        mutex_lock(&event->mutex);
+        while (!event->signaled && status == 0) status = timeout > 0 ? condition_timedwait(&event->condition, &event->mutex, timeout) : condition_wait(&event->condition, &event->mutex);
+        status = event->signaled ? 0 : 1;
+        event->signaled = 0;
+        mutex_unlock(&event->mutex);
+        return status;
+    #endif
+}
+
+
+int event_set(ThreadEvent *event) {
+    #if defined(__OS_WINDOWS__)
+        return SetEvent(event->event) != 0 ? 0 : 1;
+    #elif defined(THREAD_EVENT_FUTEX)
+        // Only the set that flips the word issues the system call.
+        if (__atomic_exchange_n(&event->signaled, 1, __ATOMIC_RELEASE) == 0) syscall(SYS_futex, &event->signaled, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+        return 0;
+    #else
+        mutex_lock(&event->mutex);
+        event->signaled = 1;
+        condition_signal(&event->condition);
+        mutex_unlock(&event->mutex);
+        return 0;
+    #endif
+}
+
+
 #if defined(__OS_WINDOWS__)
     int __condition_timedwait_win32__(ThreadCondition *condition, Mutex *mutex, DWORD timeout) {
         EnterCriticalSection(&condition->cs);
@@ -21,7 +21,21 @@
     #include <windows.h>
     #include <process.h>
 #elif defined(__OS_UNIX__)
+    #include <time.h>
+    #include <stdio.h>
+    #include <sched.h>
+    #include <errno.h>
+    #include <unistd.h>
     #include <pthread.h>
+    #if defined(__linux__)
+        #include <sys/syscall.h>
+        #include <linux/futex.h>
+    #endif
+#endif
+
+
+#if defined(__linux__) && (defined(__GNUC__) || defined(__clang__)) && !defined(__TINYC__)
+    #define THREAD_EVENT_FUTEX
 #endif
 
 
@@ -44,6 +58,20 @@
 #endif
 
 
+/**
+ * A wake-up flag for one waiting thread: a futex word on Linux, an auto-reset event on Windows, a mutex and a condition elsewhere.
+**/
+typedef struct {
+    int signaled;
+    #if defined(__OS_WINDOWS__)
+        HANDLE event;
+    #elif !defined(THREAD_EVENT_FUTEX)
+        Mutex mutex;
+        ThreadCondition condition;
+    #endif
+} ThreadEvent;
+
+
 typedef int (*_ThreadFunction)(void *);
 
 
@@ -94,6 +122,50 @@ int thread_detach(Thread *thread);
 void thread_exit();
 
 
+/**
+ * @brief Get the identifier of the current thread.
+ * @return The thread identifier (unique among running threads).
+**/
+unsigned long long thread_id();
+
+
+/**
+ * @brief Give up the CPU to another ready thread (returns at once when there is none).
+**/
+void thread_yield();
+
+
+/**
+ * @brief Pin the thread to one CPU (Linux and Windows only).
+ * @param thread The pointer of thread.
+ * @param cpu The index of CPU.
+ * @return `0` for success, `1` for failure or an unsupported platform.
+**/
+int thread_affinity(Thread *thread, int cpu);
+
+
+/**
+ * @brief Get the CPU the current thread is running on.
+ * @return The index of CPU, `-1` for unknown.
+**/
+int thread_cpu();
+
+
+/**
+ * @brief Get the number of online CPUs.
+ * @return The number of CPUs (at least `1`).
+**/
+int thread_cpu_count();
+
+
+/**
+ * @brief Get the NUMA node of a CPU.
+ * @param cpu The index of CPU.
+ * @return The index of NUMA node (`0` on machines without NUMA), `-1` for unknown.
+**/
+int thread_numa_node(int cpu);
+
+
 /**
  * @brief Create a mutex object.
  * @param mutex The pointer of mutex object.
@@ -157,6 +229,48 @@ void condition_destroy(ThreadCondition *condition);
 int condition_wait(ThreadCondition *condition, Mutex *mutex);
 
 
+/**
+ * @brief Wait for the condition variable at most `timeout` seconds.
+ * @param condition The pointer of condition variable object.
+ * @param mutex The pointer of the associated mutex (should be locked before calling).
+ * @param timeout The most seconds to wait.
+ * @return `0` for success, `1` for timeout or failure.
+**/
+int condition_timedwait(ThreadCondition *condition, Mutex *mutex, double timeout);
+
+
+/**
+ * @brief Initialize the event (not set).
+ * @param event The pointer of event object.
+ * @return `0` for success, `1` for failure.
+**/
+int event_init(ThreadEvent *event);
+
+
+/**
+ * @brief Destroy the event.
+ * @param event The pointer of event object.
+**/
+void event_destroy(ThreadEvent *event);
+
+
+/**
+ * @brief Wait until the event is set and reset it, only one thread may wait on an event.
+ * @param event The pointer of event object.
+ * @param timeout The most seconds to wait, `0` for no limit.
+ * @return `0` for success, `1` for timeout or failure.
+**/
+int event_wait(ThreadEvent *event, double timeout);
+
+
+/**
+ * @brief Set the event, waking up its waiting thread (or the next call of `event_wait`).
+ * @param event The pointer of event object.
+ * @return `0` for success, `1` for failure.
+**/
+int event_set(ThreadEvent *event);
+
+
 /**
  * @brief Signal the condition variable to wake up one waiting thread.
  * @param condition The pointer of condition variable object.
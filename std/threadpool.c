@@ -1,113 +1,604 @@
 #include "threadpool.h"
 
 
+#if defined(THREADPOOL_TLS)
+    static THREADPOOL_TLS _ThreadWorker *__threadpool_current__ = NULL;
+#endif
+
+
 ThreadPool *threadpool_create(int n_workers, int queue_capacity) {
-    if (n_workers <= 0 || queue_capacity <= 0) return NULL;
+    return threadpool_create_elastic(n_workers, n_workers, queue_capacity);
+}
+
 
-    unsigned int pool_size = sizeof(ThreadPool);
-    unsigned int queue_size = queue_capacity * sizeof(ThreadTask);
-    unsigned int thread_size = n_workers * sizeof(Thread);
+ThreadPool *threadpool_create_elastic(int min_workers, int max_workers, int queue_capacity) {
+    if (min_workers <= 0 || max_workers < min_workers || queue_capacity <= 0 || queue_capacity > (1 << 30)) return NULL;
+    int n_workers = max_workers;
 
-    unsigned int queue_offset = (pool_size + 7) & ~7;
-    unsigned int thread_offset = (queue_offset + queue_size + 7) & ~7;
+    int capacity = 1;
+    while (capacity < queue_capacity) capacity = capacity * 2;
+    queue_capacity = capacity;
 
-    unsigned int total_size = thread_offset + thread_size;
+    unsigned long long pool_size = sizeof(ThreadPool);
+    unsigned long long queue_size = (unsigned long long)THREADPOOL_LANES * queue_capacity * sizeof(_ThreadCell);
+    unsigned long long thread_size = n_workers * sizeof(Thread);
+
+    unsigned long long queue_offset = (pool_size + 7) & ~7ULL;
+    unsigned long long thread_offset = (queue_offset + queue_size + 7) & ~7ULL;
+
+    unsigned long long total_size = thread_offset + thread_size;
 
     void *sequence = malloc(total_size);
     if (!sequence) return NULL;
     memset(sequence, 0, total_size);
 
     ThreadPool *pool = (ThreadPool *)sequence;
-    pool->queue = (ThreadTask *)((char *)sequence + queue_offset);
     pool->threads = (Thread *)((char *)sequence + thread_offset);
 
     pool->n_workers = n_workers;
+    pool->min_workers = min_workers;
+    pool->idle_timeout = THREADPOOL_IDLE_TIMEOUT;
+    pool->spawn_wait = THREADPOOL_SPAWN_WAIT;
+    // Polling on the only CPU holds off the very thread about to queue the next task, so there the workers skip it and park at once.
+    int polling = thread_cpu_count() > 1;
+    pool->spin_time = polling ? THREADPOOL_SPIN_TIME : 0;
+    pool->yield_time = polling ? THREADPOOL_YIELD_TIME : 0;
     pool->queue_capacity = queue_capacity;
+    for (int i = 0; i < THREADPOOL_LANES; i++) {
+        _ThreadLane *lane = &pool->lanes[i];
+        lane->cells = (_ThreadCell *)((char *)sequence + queue_offset) + (long long)i * queue_capacity;
+        lane->mask = queue_capacity - 1;
+        for (int j = 0; j < queue_capacity; j++) lane->cells[j].sequence = j;
+    }
+    pool->lanes[THREADPOOL_LANE_NORMAL].aging = THREADPOOL_AGING_NORMAL;
+    pool->lanes[THREADPOOL_LANE_LOW].aging = THREADPOOL_AGING_LOW;
+
+    // The deques of workers are cache-line padded, they are kept out of the packed sequence above.
+    pool->workers = (_ThreadWorker *)calloc(n_workers, sizeof(_ThreadWorker));
+    if (!pool->workers) {
+        free(pool);
+        return NULL;
+    }
+    for (int i = 0; i < n_workers; i++) {
+        pool->workers[i].pool = pool;
+        pool->workers[i].seed = 0x9E3779B97F4A7C15ULL * (unsigned long long)(i + 1);
+        pool->workers[i].cpu = -1;
+        pool->workers[i].node = -1;
+    }
 
     if (mutex_create(&pool->queue_lock, 1) != 0) {
+        free(pool->workers);
         free(pool);
         return NULL;
     }
 
     if (condition_init(&pool->all_idle) != 0) {
         mutex_destroy(&pool->queue_lock);
+        free(pool->workers);
         free(pool);
         return NULL;
     }
 
-    if (condition_init(&pool->notify) != 0) {
+    for (int i = 0; i < n_workers; i++) {
+        if (event_init(&pool->workers[i].event) == 0) continue;
+        for (int j = 0; j < i; j++) event_destroy(&pool->workers[j].event);
         condition_destroy(&pool->all_idle);
         mutex_destroy(&pool->queue_lock);
+        free(pool->workers);
         free(pool);
         return NULL;
     }
 
-    if (condition_init(&pool->not_full) != 0) {
-        condition_destroy(&pool->notify);
+    for (int i = 0; i < THREADPOOL_LANES; i++) {
+        if (condition_init(&pool->lanes[i].not_full.condition) != 0) {
+            for (int j = 0; j < i; j++) condition_destroy(&pool->lanes[j].not_full.condition);
+            for (int j = 0; j < n_workers; j++) event_destroy(&pool->workers[j].event);
+            condition_destroy(&pool->all_idle);
+            mutex_destroy(&pool->queue_lock);
+            free(pool->workers);
+            free(pool);
+            return NULL;
+        }
+    }
+
+    if (condition_init(&pool->completed.condition) != 0) {
+        for (int i = 0; i < THREADPOOL_LANES; i++) condition_destroy(&pool->lanes[i].not_full.condition);
+        for (int i = 0; i < n_workers; i++) event_destroy(&pool->workers[i].event);
         condition_destroy(&pool->all_idle);
         mutex_destroy(&pool->queue_lock);
+        free(pool->workers);
         free(pool);
         return NULL;
     }
 
-    for (int i = 0; i < n_workers; i++) {
-        if (thread_create(&(pool->threads[i]), __threadpool_worker__, (void *)pool) != 0) {
-            mutex_lock(&pool->queue_lock);
-            pool->shutdown = 1;
-            pool->n_workers = i;
-            condition_broadcast(&pool->notify);
+    if (mutex_create(&pool->future_lock, 1) != 0) {
+        condition_destroy(&pool->completed.condition);
+        for (int i = 0; i < THREADPOOL_LANES; i++) condition_destroy(&pool->lanes[i].not_full.condition);
+        for (int i = 0; i < n_workers; i++) event_destroy(&pool->workers[i].event);
+        condition_destroy(&pool->all_idle);
+        mutex_destroy(&pool->queue_lock);
+        free(pool->workers);
+        free(pool);
+        return NULL;
+    }
+
+    // The workers started first already read `n_active` while the others are being started.
+    mutex_lock(&pool->queue_lock);
+    for (int i = 0; i < min_workers; i++) {
+        if (__threadpool_spawn__(pool) != 0) {
+            atomic_set(&pool->shutdown, 1);
             mutex_unlock(&pool->queue_lock);
+            __threadpool_notify__(pool, n_workers);
 
             for (int j = 0; j < i; j++) thread_join(&(pool->threads[j]), NULL);
 
-            condition_destroy(&pool->not_full);
-            condition_destroy(&pool->notify);
+            mutex_destroy(&pool->future_lock);
+            condition_destroy(&pool->completed.condition);
+            for (int j = 0; j < THREADPOOL_LANES; j++) condition_destroy(&pool->lanes[j].not_full.condition);
+            for (int j = 0; j < n_workers; j++) event_destroy(&pool->workers[j].event);
             condition_destroy(&pool->all_idle);
             mutex_destroy(&pool->queue_lock);
+            free(pool->workers);
             free(pool);
             return NULL;
         }
     }
+    mutex_unlock(&pool->queue_lock);
     return pool;
 }
 
 
 int threadpool_add(ThreadPool *pool, void (*func)(void *args), void *args, int block, void (*cleanup)(void *args)) {
-    if (pool == NULL || func == NULL) return 1;
+    return threadpool_add_priority(pool, func, args, block, cleanup, THREADPOOL_LANE_NORMAL);
+}
 
-    mutex_lock(&pool->queue_lock);
 
-    while (pool->queue_length == pool->queue_capacity && !pool->shutdown) {
+int threadpool_add_priority(ThreadPool *pool, void (*func)(void *args), void *args, int block, void (*cleanup)(void *args), int lane) {
+    if (pool == NULL || func == NULL || lane < 0 || lane >= THREADPOOL_LANES) return 1;
+
+    ThreadTask task = {func, args, cleanup};
+
+    // Only normal tasks take the deque, the other lanes keep their place in the deadline order.
+    if (lane == THREADPOOL_LANE_NORMAL && atomic_get_relaxed(&pool->stealing)) {
+        _ThreadWorker *worker = __threadpool_self__(pool);
+        if (worker) {
+            if (atomic_get(&pool->shutdown)) return 1;
+            atomic_add(&pool->n_pending, 1);
+            if (__threadpool_deque_push__(&worker->deque, &task) == 0) {
+                // The hot path of recursive tasks, checked here so the common case of no parked worker costs no call.
+                atomic_fence();
+                if (atomic_get(&pool->n_idle) > 0) __threadpool_notify__(pool, 1);
+                return 0;
+            }
+            // The deque is full, the task goes to the shared queue like any external one.
+            atomic_sub(&pool->n_pending, 1);
+        }
+    }
+
+    if (atomic_get(&pool->shutdown)) return 1;
+
+    // Counted before it becomes visible, so a worker finishing it never drops `n_pending` below zero.
+    atomic_add(&pool->n_pending, 1);
+    // The clock is read for every task once the pool really uses priorities, a pool of normal tasks skips it.
+    if (lane != THREADPOOL_LANE_NORMAL && !atomic_get_relaxed(&pool->timed)) atomic_set(&pool->timed, 1);
+    _ThreadLane *target = &pool->lanes[lane];
+    while (__threadpool_lane_push__(pool, lane, &task) != 0) {
         if (!block) {
-            mutex_unlock(&pool->queue_lock);
+            __threadpool_done__(pool);
             return 2;
         }
-        condition_wait(&pool->not_full, &pool->queue_lock);
+        __threadpool_lock__(pool);
+        __threadpool_park__(pool, &target->not_full, __threadpool_producer_ready__, target);
+        mutex_unlock(&pool->queue_lock);
+
+        if (atomic_get(&pool->shutdown)) {
+            __threadpool_done__(pool);
+            return 1;
+        }
     }
 
-    if (pool->shutdown) {
+    __threadpool_notify__(pool, 1);
+    __threadpool_grow__(pool);
+    return 0;
+}
+
+
+int threadpool_add_batch(ThreadPool *pool, ThreadTask *tasks, int n, int block) {
+    if (pool == NULL || tasks == NULL || n < 0) return 1;
+    for (int i = 0; i < n; i++) if (tasks[i].func == NULL) return 1;
+    if (atomic_get(&pool->shutdown)) {
+        for (int i = 0; i < n; i++) if (tasks[i].cleanup) tasks[i].cleanup(tasks[i].args);
+        return 1;
+    }
+    if (n == 0) return 0;
+
+    int done = 0;
+    _ThreadLane *lane = &pool->lanes[THREADPOOL_LANE_NORMAL];
+    atomic_add(&pool->n_pending, n);
+
+    if (atomic_get_relaxed(&pool->stealing)) {
+        _ThreadWorker *worker = __threadpool_self__(pool);
+        if (worker) {
+            _ThreadDeque *deque = &worker->deque;
+            // Without blocking it is all or nothing, the deque takes the batch only when it surely has room for all of it.
+            long long room = deque->mask + 1 - (atomic_get_relaxed(&deque->bottom) - atomic_get(&deque->top));
+            if (block || room >= n) while (done < n && __threadpool_deque_push__(deque, &tasks[done]) == 0) done++;
+        }
+    }
+
+    if (done == 0 && !block) {
+        if (__threadpool_lane_push_many__(pool, THREADPOOL_LANE_NORMAL, tasks, n, 1) == 0) {
+            atomic_sub(&pool->n_pending, n - 1);
+            __threadpool_done__(pool);
+            return 2;
+        }
+        done = n;
+    }
+
+    while (done < n) {
+        int count = __threadpool_lane_push_many__(pool, THREADPOOL_LANE_NORMAL, tasks + done, n - done, 0);
+        done = done + count;
+        if (count > 0) {
+            // Let the workers start on the part already queued while this producer waits for room.
+            __threadpool_notify__(pool, count);
+            continue;
+        }
+        __threadpool_lock__(pool);
+        __threadpool_park__(pool, &lane->not_full, __threadpool_producer_ready__, lane);
+        mutex_unlock(&pool->queue_lock);
+
+        if (atomic_get(&pool->shutdown)) {
+            for (int i = done; i < n; i++) {
+                if (tasks[i].cleanup) tasks[i].cleanup(tasks[i].args);
+                __threadpool_done__(pool);
+            }
+            return 1;
+        }
+    }
+
+    __threadpool_notify__(pool, n);
+    __threadpool_grow__(pool);
+    return 0;
+}
+
+
+int threadpool_parallel_for(ThreadPool *pool, long long begin, long long end, long long grain, void (*body)(long long begin, long long end, void *ctx), void *ctx) {
+    if (pool == NULL || body == NULL) return 1;
+
+    _ThreadLoop loop;
+    memset(&loop, 0, sizeof(loop));
+    loop.begin = begin;
+    loop.end = end;
+    loop.grain = grain;
+    loop.body = body;
+    loop.ctx = ctx;
+    return __threadpool_loop__(pool, &loop);
+}
+
+
+int threadpool_parallel_reduce(ThreadPool *pool, long long begin, long long end, long long grain, void (*body)(long long begin, long long end, void *ctx, void *partial), void (*combine)(void *result, const void *partial, void *ctx), void *ctx, void *result, const void *identity, unsigned long long size) {
+    if (pool == NULL || body == NULL || combine == NULL || result == NULL || identity == NULL || size == 0) return 1;
+
+    _ThreadLoop loop;
+    memset(&loop, 0, sizeof(loop));
+    loop.begin = begin;
+    loop.end = end;
+    loop.grain = grain;
+    loop.reduce = body;
+    loop.ctx = ctx;
+    loop.identity = identity;
+    loop.size = size;
+    // Padded to whole cache lines, so participants never write the same line.
+    loop.stride = (size + ATOMIC_CACHE_LINE - 1) / ATOMIC_CACHE_LINE * ATOMIC_CACHE_LINE;
+    loop.partials = (char *)malloc((pool->n_workers + 1) * loop.stride);
+    if (!loop.partials) return 1;
+
+    int status = __threadpool_loop__(pool, &loop);
+    if (status == 0) for (int i = 0; i < loop.n_participants; i++) combine(result, loop.partials + i * loop.stride, ctx);
+    free(loop.partials);
+    return status;
+}
+
+
+TaskFuture *threadpool_submit(ThreadPool *pool, void *(*func)(void *args), void *args) {
+    if (pool == NULL || func == NULL) return NULL;
+
+    TaskFuture *future = __threadpool_future_allocate__(pool);
+    if (!future) return NULL;
+    future->func = func;
+    future->args = args;
+
+    // The cleanup settles the future whether the task ran or was discarded.
+    if (__threadpool_add_helping__(pool, __threadpool_future_run__, future, __threadpool_future_finish__) != 0) {
+        __threadpool_future_free__(pool, future);
+        return NULL;
+    }
+    return future;
+}
+
+
+int future_wait(TaskFuture *future) {
+    if (future == NULL) return 1;
+
+    ThreadPool *pool = future->pool;
+    while (atomic_get(&future->state) == TASK_FUTURE_PENDING) {
+        if (__threadpool_help__(pool) == 0) continue;
+        __threadpool_lock__(pool);
+        __threadpool_park__(pool, &pool->completed, __threadpool_future_ready__, future);
+        mutex_unlock(&pool->queue_lock);
+    }
+    return atomic_get(&future->state) == TASK_FUTURE_DONE ? 0 : 1;
+}
+
+
+void *future_get(TaskFuture *future) {
+    if (future_wait(future) != 0) return NULL;
+    return future->result;
+}
+
+
+TaskFuture *future_then(TaskFuture *future, void *(*func)(void *result)) {
+    if (future == NULL || func == NULL) return NULL;
+
+    TaskFuture *next = __threadpool_future_allocate__(future->pool);
+    if (!next) return NULL;
+    next->func = func;
+
+    TaskFuture *head = atomic_get(&future->continuations);
+    while (head != __THREADPOOL_FUTURE_CLOSED__) {
+        next->next = head;
+        if (atomic_cas(&future->continuations, &head, next)) return next;
+    }
+    // The antecedent has settled already.
+    __threadpool_future_schedule__(future, next);
+    return next;
+}
+
+
+void future_release(TaskFuture *future) {
+    if (future == NULL) return;
+    if (atomic_sub(&future->refs, 1) == 1) __threadpool_future_free__(future->pool, future);
+}
+
+
+int threadpool_config_schedule(ThreadPool *pool, ThreadPoolSchedule schedule) {
+    if (pool == NULL || schedule < THREADPOOL_SCHEDULE_STATIC || schedule > THREADPOOL_SCHEDULE_GUIDED) return 1;
+    pool->schedule = schedule;
+    return 0;
+}
+
+
+int threadpool_config_stealing(ThreadPool *pool, int enable) {
+    if (pool == NULL) return 1;
+
+    mutex_lock(&pool->queue_lock);
+    if (pool->shutdown || atomic_get(&pool->n_pending) > 0) {
         mutex_unlock(&pool->queue_lock);
         return 1;
     }
+    if (enable) {
+        for (int i = 0; i < pool->n_workers; i++) {
+            _ThreadDeque *deque = &pool->workers[i].deque;
+            if (deque->buffer) continue;
+            deque->buffer = (ThreadTask *)malloc(THREADPOOL_DEQUE_CAPACITY * sizeof(ThreadTask));
+            if (!deque->buffer) {
+                mutex_unlock(&pool->queue_lock);
+                return 1;
+            }
+            deque->mask = THREADPOOL_DEQUE_CAPACITY - 1;
+        }
+    }
+    atomic_set(&pool->stealing, enable ? 1 : 0);
+    mutex_unlock(&pool->queue_lock);
+    return 0;
+}
 
-    pool->queue[pool->queue_tail].func = func;
-    pool->queue[pool->queue_tail].args = args;
-    pool->queue[pool->queue_tail].cleanup = cleanup;
 
-    pool->queue_tail = (pool->queue_tail + 1) % pool->queue_capacity;
-    pool->queue_length++;
+int threadpool_config_aging(ThreadPool *pool, int lane, double seconds) {
+    if (pool == NULL || lane < 0 || lane >= THREADPOOL_LANES || seconds < 0) return 1;
+    atomic_set(&pool->lanes[lane].aging, (long long)(seconds * 1e9));
+    atomic_set(&pool->timed, 1);
+    return 0;
+}
 
-    condition_signal(&pool->notify);
+
+int threadpool_config_elastic(ThreadPool *pool, double idle_timeout, double spawn_wait) {
+    if (pool == NULL || idle_timeout <= 0 || spawn_wait < 0) return 1;
+    atomic_set(&pool->idle_timeout, (long long)(idle_timeout * 1e9));
+    atomic_set(&pool->spawn_wait, (long long)(spawn_wait * 1e9));
+    return 0;
+}
+
+
+int threadpool_config_wait(ThreadPool *pool, double spin, double yield) {
+    if (pool == NULL || spin < 0 || yield < 0) return 1;
+    atomic_set(&pool->spin_time, (long long)(spin * 1e9));
+    atomic_set(&pool->yield_time, (long long)(yield * 1e9));
+    return 0;
+}
+
+
+int threadpool_config_affinity(ThreadPool *pool, const int *cpus, int n_cpus) {
+    if (pool == NULL || cpus == NULL || n_cpus <= 0) return 1;
+    for (int i = 0; i < n_cpus; i++) if (cpus[i] < 0) return 1;
+
+    int status = 0;
+    // Under the lock, a worker retiring or starting meanwhile keeps its slot and its thread consistent.
+    mutex_lock(&pool->queue_lock);
+    for (int i = 0; i < pool->n_workers; i++) {
+        _ThreadWorker *worker = &pool->workers[i];
+        worker->cpu = cpus[i % n_cpus];
+        worker->node = thread_numa_node(worker->cpu);
+        if (worker->state == THREADPOOL_WORKER_RUNNING && thread_affinity(&pool->threads[i], worker->cpu) != 0) status = 1;
+    }
     mutex_unlock(&pool->queue_lock);
+    return status;
+}
+
+
+int threadpool_numa_node(ThreadPool *pool) {
+    if (pool == NULL) return -1;
+    _ThreadWorker *worker = __threadpool_self__(pool);
+    if (worker && worker->cpu >= 0) return worker->node;
+    return thread_numa_node(thread_cpu());
+}
+
+
+int threadpool_workers(ThreadPool *pool) {
+    if (pool == NULL) return 0;
+    return atomic_get(&pool->n_active);
+}
+
+
+int threadpool_lane_stats(ThreadPool *pool, int lane, ThreadPoolLaneStats *stats) {
+    if (pool == NULL || stats == NULL || lane < 0 || lane >= THREADPOOL_LANES) return 1;
+
+    _ThreadLaneStats total;
+    memset(&total, 0, sizeof(_ThreadLaneStats));
+    for (int i = -1; i < pool->n_workers; i++) {
+        _ThreadLaneStats *part = i < 0 ? &pool->lanes[lane].stats : &pool->workers[i].lane_stats[lane];
+        total.n_started = total.n_started + atomic_get_relaxed(&part->n_started);
+        total.wait_total = total.wait_total + atomic_get_relaxed(&part->wait_total);
+        long long max = atomic_get_relaxed(&part->wait_max);
+        if (max > total.wait_max) total.wait_max = max;
+        for (int j = 0; j < THREADPOOL_WAIT_BUCKETS; j++) total.wait_buckets[j] = total.wait_buckets[j] + atomic_get_relaxed(&part->wait_buckets[j]);
+    }
+
+    long long head = atomic_get(&pool->lanes[lane].head);
+    long long tail = atomic_get(&pool->lanes[lane].tail);
+    stats->depth = tail > head ? tail - head : 0;
+    stats->n_added = tail;
+    stats->n_started = head;
+    stats->wait_mean = total.n_started ? (double)total.wait_total / total.n_started / 1e9 : 0;
+    stats->wait_max = (double)total.wait_max / 1e9;
+
+    // A percentile is reported as the upper bound of its bucket, never below the real value.
+    stats->wait_p50 = 0;
+    stats->wait_p99 = 0;
+    long long seen = 0;
+    for (int j = 0; j < THREADPOOL_WAIT_BUCKETS && total.n_started > 0; j++) {
+        seen = seen + total.wait_buckets[j];
+        double bound = (double)(1ULL << (j + 1)) / 1e9;
+        if (bound > stats->wait_max) bound = stats->wait_max;
+        if (stats->wait_p50 == 0 && 2 * seen >= total.n_started) stats->wait_p50 = bound;
+        if (100 * seen >= 99 * total.n_started) {
+            stats->wait_p99 = bound;
+            break;
+        }
+    }
     return 0;
 }
 
 
+void threadpool_lane_view(ThreadPool *pool) {
+    const char *names[THREADPOOL_LANES] = {"high", "normal", "low"};
+    for (int i = 0; i < THREADPOOL_LANES; i++) {
+        ThreadPoolLaneStats stats;
+        threadpool_lane_stats(pool, i, &stats);
+        printf("ThreadPool Lane [%s]: depth = %lld, added = %lld, started = %lld, wait mean = %.6f s, p50 <= %.6f s, p99 <= %.6f s, max = %.6f s\n", names[i], stats.depth, stats.n_added, stats.n_started, stats.wait_mean, stats.wait_p50, stats.wait_p99, stats.wait_max);
+    }
+}
+
+
+int threadpool_stats(ThreadPool *pool, ThreadPoolStats *stats) {
+    if (pool == NULL || stats == NULL) return 1;
+    memset(stats, 0, sizeof(ThreadPoolStats));
+    #if defined(THREADPOOL_STATS)
+        stats->n_workers = pool->n_workers;
+        long long latency_max = 0;
+        long long runtime_max = 0;
+        for (int i = 0; i < pool->n_workers; i++) {
+            ThreadPoolWorkerStats counters;
+            threadpool_worker_stats(pool, i, &counters);
+            stats->total.n_tasks = stats->total.n_tasks + counters.n_tasks;
+            stats->total.busy = stats->total.busy + counters.busy;
+            stats->total.idle = stats->total.idle + counters.idle;
+            stats->total.n_steal_attempts = stats->total.n_steal_attempts + counters.n_steal_attempts;
+            stats->total.n_steals = stats->total.n_steals + counters.n_steals;
+            stats->total.lock_wait = stats->total.lock_wait + counters.lock_wait;
+            stats->total.n_lock_waits = stats->total.n_lock_waits + counters.n_lock_waits;
+
+            _ThreadWorkerStats *part = &pool->workers[i].stats;
+            for (int j = 0; j < THREADPOOL_HISTOGRAM_BUCKETS; j++) {
+                stats->latency[j] = stats->latency[j] + atomic_get_relaxed(&part->latency[j]);
+                stats->runtime[j] = stats->runtime[j] + atomic_get_relaxed(&part->runtime[j]);
+                if (stats->latency[j] > 0) latency_max = __threadpool_histogram_bound__(j);
+                if (stats->runtime[j] > 0) runtime_max = __threadpool_histogram_bound__(j);
+            }
+        }
+        long long active = stats->total.busy + stats->total.idle;
+        stats->utilization = active > 0 ? (double)stats->total.busy / active : 0;
+        stats->latency_p50 = __threadpool_histogram_percentile__(stats->latency, 0.5);
+        stats->latency_p99 = __threadpool_histogram_percentile__(stats->latency, 0.99);
+        stats->latency_max = (double)latency_max / 1e9;
+        stats->runtime_p50 = __threadpool_histogram_percentile__(stats->runtime, 0.5);
+        stats->runtime_p99 = __threadpool_histogram_percentile__(stats->runtime, 0.99);
+        stats->runtime_max = (double)runtime_max / 1e9;
+        return 0;
+    #else
+        return 1;
+    #endif
+}
+
+
+int threadpool_worker_stats(ThreadPool *pool, int index, ThreadPoolWorkerStats *stats) {
+    if (pool == NULL || stats == NULL || index < 0 || index >= pool->n_workers) return 1;
+    memset(stats, 0, sizeof(ThreadPoolWorkerStats));
+    #if defined(THREADPOOL_STATS)
+        ThreadPoolWorkerStats *counters = &pool->workers[index].stats.counters;
+        stats->n_tasks = atomic_get_relaxed(&counters->n_tasks);
+        _ThreadWorkerStats *part = &pool->workers[index].stats;
+        stats->idle = atomic_get_relaxed(&counters->idle);
+        // A worker waiting right now stopped being busy when the wait began, that wait is not in `idle` yet.
+        long long origin = atomic_get_relaxed(&part->origin);
+        long long end = atomic_get_relaxed(&part->finish);
+        if (end == 0) end = atomic_get_relaxed(&part->waited) ? atomic_get_relaxed(&part->clock) : __threadpool_clock__();
+        stats->busy = origin > 0 && end - origin > stats->idle ? end - origin - stats->idle : 0;
+        stats->n_steal_attempts = atomic_get_relaxed(&counters->n_steal_attempts);
+        stats->n_steals = atomic_get_relaxed(&counters->n_steals);
+        stats->lock_wait = atomic_get_relaxed(&counters->lock_wait);
+        stats->n_lock_waits = atomic_get_relaxed(&counters->n_lock_waits);
+        return 0;
+    #else
+        return 1;
+    #endif
+}
+
+
+void threadpool_stats_view(ThreadPool *pool) {
+    ThreadPoolStats stats;
+    if (threadpool_stats(pool, &stats) != 0) {
+        printf("ThreadPool Stats: not compiled in (build with `-DTHREADPOOL_STATS`)\n");
+        threadpool_lane_view(pool);
+        return;
+    }
+
+    for (int i = 0; i < stats.n_workers; i++) {
+        if (pool->workers[i].state == THREADPOOL_WORKER_UNUSED) continue;
+        ThreadPoolWorkerStats counters;
+        threadpool_worker_stats(pool, i, &counters);
+        long long active = counters.busy + counters.idle;
+        printf("ThreadPool Worker [%d]: tasks = %lld, busy = %.6f s, idle = %.6f s, utilization = %.2f%%, steals = %lld / %lld, lock waits = %lld (%.6f s)\n", i, counters.n_tasks, counters.busy / 1e9, counters.idle / 1e9, active > 0 ? 100.0 * counters.busy / active : 0, counters.n_steals, counters.n_steal_attempts, counters.n_lock_waits, counters.lock_wait / 1e9);
+    }
+    printf("ThreadPool Stats: workers = %d, tasks = %lld, utilization = %.2f%%, steals = %lld / %lld, lock waits = %lld (%.6f s)\n", stats.n_workers, stats.total.n_tasks, 100 * stats.utilization, stats.total.n_steals, stats.total.n_steal_attempts, stats.total.n_lock_waits, stats.total.lock_wait / 1e9);
+    printf("ThreadPool Latency: p50 <= %.6f s, p99 <= %.6f s, max <= %.6f s\n", stats.latency_p50, stats.latency_p99, stats.latency_max);
+    printf("ThreadPool Runtime: p50 <= %.6f s, p99 <= %.6f s, max <= %.6f s\n", stats.runtime_p50, stats.runtime_p99, stats.runtime_max);
+
+    // Only the non-empty buckets, as `[lower, upper)` in nanoseconds.
+    for (int j = 0; j < THREADPOOL_HISTOGRAM_BUCKETS; j++) {
+        if (stats.latency[j] == 0 && stats.runtime[j] == 0) continue;
+        long long lower = j > 0 ? __threadpool_histogram_bound__(j - 1) : 0;
+        printf("ThreadPool Histogram [%lld, %lld) ns: latency = %lld, runtime = %lld\n", lower, __threadpool_histogram_bound__(j), stats.latency[j], stats.runtime[j]);
+    }
+    threadpool_lane_view(pool);
+}
+
+
 int threadpool_wait(ThreadPool *pool) {
     if (pool == NULL) return 1;
 
     mutex_lock(&pool->queue_lock);
-    while ((pool->queue_length > 0 || pool->n_working > 0) && !pool->shutdown) condition_wait(&pool->all_idle, &pool->queue_lock);
+    while (atomic_get(&pool->n_pending) > 0 && !pool->shutdown) condition_wait(&pool->all_idle, &pool->queue_lock);
     mutex_unlock(&pool->queue_lock);
     return 0;
 }
@@ -121,64 +612,954 @@ int threadpool_destroy(ThreadPool *pool, int safe_exit) {
         mutex_unlock(&pool->queue_lock);
         return 1;
     }
-    pool->shutdown = 1;
+    atomic_set(&pool->shutdown, safe_exit ? 1 : 2);
 
-    if (!safe_exit) {
-        for (int i = 0; i < pool->queue_length; i++) {
-            int idx = (pool->queue_head + i) % pool->queue_capacity;
+    for (int i = 0; i < THREADPOOL_LANES; i++) condition_broadcast(&pool->lanes[i].not_full.condition);
+    condition_broadcast(&pool->completed.condition);
+    mutex_unlock(&pool->queue_lock);
+    // A worker parking from now on sees the shutdown before it sleeps.
+    __threadpool_notify__(pool, pool->n_workers);
+
+    // Retired workers have exited already, joining them only releases their threads.
+    for (int i = 0; i < pool->n_workers; i++) if (pool->workers[i].state != THREADPOOL_WORKER_UNUSED) thread_join(&(pool->threads[i]), NULL);
 
-            ThreadTask *task = &pool->queue[idx];
-            if (task->cleanup) task->cleanup(task->args);
+    // Left over by `safe_exit == 0`, or added by a producer racing with the shutdown.
+    ThreadTask task;
+    while (__threadpool_pop__(pool, NULL, &task) == 0) if (task.cleanup) task.cleanup(task.args);
+    for (int i = 0; i < pool->n_workers; i++) {
+        _ThreadWorker *worker = &pool->workers[i];
+        for (; worker->batch_head < worker->batch_count; worker->batch_head++) {
+            task = worker->batch[worker->batch_head];
+            if (task.cleanup) task.cleanup(task.args);
         }
-        pool->queue_length = 0;
-        pool->queue_head = 0;
-        pool->queue_tail = 0;
+        _ThreadDeque *deque = &pool->workers[i].deque;
+        if (!deque->buffer) continue;
+        while (__threadpool_deque_pop__(deque, &task) == 0) if (task.cleanup) task.cleanup(task.args);
+        free(deque->buffer);
     }
 
-    condition_broadcast(&pool->notify);
-    condition_broadcast(&pool->not_full);
-    mutex_unlock(&pool->queue_lock);
-
-    for (int i = 0; i < pool->n_workers; i++) thread_join(&(pool->threads[i]), NULL);
+    // Every future must have been released by now, their storage goes with the pool.
+    while (pool->future_slabs) {
+        TaskFuture *slab = pool->future_slabs;
+        pool->future_slabs = slab->next;
+        free(slab);
+    }
 
     condition_destroy(&pool->all_idle);
-    condition_destroy(&pool->notify);
-    condition_destroy(&pool->not_full);
+    for (int i = 0; i < pool->n_workers; i++) event_destroy(&pool->workers[i].event);
+    for (int i = 0; i < THREADPOOL_LANES; i++) condition_destroy(&pool->lanes[i].not_full.condition);
+    condition_destroy(&pool->completed.condition);
     mutex_destroy(&pool->queue_lock);
+    mutex_destroy(&pool->future_lock);
+    free(pool->workers);
     free(pool);
     return 0;
 }
 
 
 int __threadpool_worker__(void *args) {
-    ThreadPool *pool = (ThreadPool *)args;
+    _ThreadWorker *worker = (_ThreadWorker *)args;
+    ThreadPool *pool = worker->pool;
+
+    atomic_set(&worker->id, thread_id());
+    #if defined(THREADPOOL_TLS)
+        __threadpool_current__ = worker;
+    #endif
+
+    ThreadTask task;
+    #if defined(THREADPOOL_STATS)
+        _ThreadWorkerStats *stats = &worker->stats;
+        long long origin = __threadpool_clock__();
+        // A slot started again keeps its counters, the time it spent retired counts as neither busy nor idle.
+        if (stats->finish) origin = stats->origin + origin - stats->finish;
+        atomic_set_relaxed(&stats->origin, origin);
+        atomic_set_relaxed(&stats->finish, 0);
+    #endif
+    while (__threadpool_next__(worker, &task) == 0) {
+        #if defined(THREADPOOL_STATS)
+            // The clock is read around waits and around sampled tasks only, `busy` is the time outside of `idle`.
+            if (stats->waited) {
+                __THREADPOOL_COUNT__(stats->counters.idle, __threadpool_clock__() - stats->clock);
+                atomic_set_relaxed(&stats->waited, 0);
+            }
+            long long start = 0;
+            if (stats->enqueued > 0 || (stats->counters.n_tasks & (THREADPOOL_STATS_SAMPLE - 1)) == 0) {
+                start = __threadpool_clock__();
+                if (stats->enqueued > 0) __THREADPOOL_COUNT__(stats->latency[__threadpool_histogram_index__(start - stats->enqueued)], 1);
+            }
+        #endif
+        if (task.func) task.func(task.args);
+        if (task.cleanup) task.cleanup(task.args);
+        #if defined(THREADPOOL_STATS)
+            if (start) __THREADPOOL_COUNT__(stats->runtime[__threadpool_histogram_index__(__threadpool_clock__() - start)], 1);
+            __THREADPOOL_COUNT__(stats->counters.n_tasks, 1);
+        #endif
+        __threadpool_done__(pool);
+    }
+    #if defined(THREADPOOL_STATS)
+        long long finish = __threadpool_clock__();
+        if (stats->waited) __THREADPOOL_COUNT__(stats->counters.idle, finish - stats->clock);
+        atomic_set_relaxed(&stats->waited, 0);
+        atomic_set_relaxed(&stats->finish, finish);
+    #endif
+    // Returning (rather than `thread_exit`) lets `thread_join` release the result of the thread wrapper.
+    return 0;
+}
+
+
+int __threadpool_next__(_ThreadWorker *worker, ThreadTask *task) {
+    ThreadPool *pool = worker->pool;
 
     while (1) {
-        mutex_lock(&pool->queue_lock);
+        if (atomic_get(&pool->shutdown) == 2) return 1;
 
-        while (pool->queue_length == 0 && !pool->shutdown) condition_wait(&pool->notify, &pool->queue_lock);
+        if (__threadpool_urgent__(worker) && __threadpool_lane_pop_many__(pool, worker, THREADPOOL_LANE_HIGH, task, 1, &worker->stats.enqueued) == 1) return 0;
 
-        if (pool->shutdown && pool->queue_length == 0) {
-            mutex_unlock(&pool->queue_lock);
-            thread_exit();
+        if (worker->batch_head < worker->batch_count) {
+            worker->stats.enqueued = worker->batch_enqueued[worker->batch_head];
+            *task = worker->batch[worker->batch_head++];
+            return 0;
+        }
+
+        worker->stats.enqueued = 0;
+        int stealing = atomic_get(&pool->stealing);
+        if (stealing && __threadpool_deque_pop__(&worker->deque, task) == 0) return 0;
+
+        #if defined(THREADPOOL_STATS)
+            // Out of local work, the time until the next task counts as idle.
+            if (!worker->stats.waited) {
+                atomic_set_relaxed(&worker->stats.clock, __threadpool_clock__());
+                atomic_set_relaxed(&worker->stats.waited, 1);
+            }
+        #endif
+        /**
+         * Poll with `atomic_pause` for `spin_time`, then with `thread_yield` for `yield_time`, a task arriving meanwhile starts without a wake-up.
+         * The pausing rounds look at the clock once every `THREADPOOL_SPIN` rounds (the first look starts the clock),
+         * a yield takes long enough to look every round. Without any polling time the queues get a single look before `__threadpool_sleep__`.
+        **/
+        long long spin_time = atomic_get_relaxed(&pool->spin_time);
+        long long wait_time = spin_time + atomic_get_relaxed(&pool->yield_time);
+        long long start = 0;
+        long long elapsed = 0;
+        for (int spin = 1; ; spin++) {
+            if (__threadpool_take__(worker, task) == 0) return 0;
+            if (stealing && __threadpool_steal__(worker, task) == 0) return 0;
+            if (wait_time <= 0) break;
+            if (spin % THREADPOOL_SPIN == 0 || (start > 0 && elapsed >= spin_time)) {
+                long long now = __threadpool_clock__();
+                if (start == 0) start = now;
+                elapsed = now - start;
+                if (elapsed >= wait_time) break;
+            }
+            if (start == 0 || elapsed < spin_time) atomic_pause();
+            else thread_yield();
         }
 
-        ThreadTask task = pool->queue[pool->queue_head];
+        // The queues ran dry, a backlog seen from now on is a new one.
+        if (atomic_get_relaxed(&pool->backlog_since)) atomic_set_relaxed(&pool->backlog_since, 0);
+        if (__threadpool_sleep__(worker)) return 1;
+    }
+}
+
+
+_ThreadWorker *__threadpool_self__(ThreadPool *pool) {
+    #if defined(THREADPOOL_TLS)
+        _ThreadWorker *worker = __threadpool_current__;
+        return worker && worker->pool == pool ? worker : NULL;
+    #else
+        unsigned long long id = thread_id();
+        for (int i = 0; i < pool->n_workers; i++) if (atomic_get(&pool->workers[i].id) == id) return &pool->workers[i];
+        return NULL;
+    #endif
+}
+
+
+void __threadpool_park__(ThreadPool *pool, _ThreadWaiters *waiters, int (*ready)(ThreadPool *pool, void *arg), void *arg) {
+    /**
+     * Announce the parking before the last look, a waker publishes its change before reading `n_waiting`,
+     * so either this thread sees the change or the waker sees this thread (and signals under the lock held here).
+    **/
+    atomic_add(&waiters->n_waiting, 1);
+    atomic_fence();
+    int waited = 0;
+    if (!ready(pool, arg)) {
+        condition_wait(&waiters->condition, &pool->queue_lock);
+        waited = 1;
+    }
+    atomic_sub(&waiters->n_waiting, 1);
+    if (waited && waiters->n_signaled > 0) atomic_sub(&waiters->n_signaled, 1);
+}
+
+
+void __threadpool_wake__(ThreadPool *pool, _ThreadWaiters *waiters, int n) {
+    atomic_fence();
+    // Every parked thread already has a signal on its way, the woken ones will see this change too.
+    if (atomic_get(&waiters->n_waiting) <= atomic_get(&waiters->n_signaled)) return;
+    __threadpool_lock__(pool);
+    int idle = waiters->n_waiting - waiters->n_signaled;
+    if (n > idle) n = idle;
+    if (n > 0) {
+        atomic_add(&waiters->n_signaled, n);
+        if (n == waiters->n_waiting) condition_broadcast(&waiters->condition);
+        else for (int i = 0; i < n; i++) condition_signal(&waiters->condition);
+    }
+    mutex_unlock(&pool->queue_lock);
+}
 
-        pool->queue_head = (pool->queue_head + 1) % pool->queue_capacity;
-        pool->queue_length--;
 
-        condition_signal(&pool->not_full);
-        pool->n_working++;
+int __threadpool_sleep__(_ThreadWorker *worker) {
+    ThreadPool *pool = worker->pool;
+    __threadpool_lock__(pool);
+    if (pool->shutdown && __threadpool_queued__(pool) <= 0) {
+        // The own deque is empty, the other deques are drained by their owners.
         mutex_unlock(&pool->queue_lock);
+        return 1;
+    }
 
-        if (task.func) task.func(task.args);
-        if (task.cleanup) task.cleanup(task.args);
+    // The last parked worker is woken up first, its cache is the warmest.
+    worker->idle_prev = NULL;
+    worker->idle_next = pool->idle;
+    if (pool->idle != NULL) pool->idle->idle_prev = worker;
+    pool->idle = worker;
+    worker->parked = 1;
+    /**
+     * Announce the parking before the last look, a submitter publishes its task before reading `n_idle`,
+     * so either this worker sees the task or the submitter sees this worker (and sets its event).
+    **/
+    atomic_add(&pool->n_idle, 1);
+    atomic_fence();
+    if (__threadpool_worker_ready__(pool, NULL)) {
+        __threadpool_unpark__(worker);
+        mutex_unlock(&pool->queue_lock);
+        return 0;
+    }
+    // Only the workers above `min_workers` park with a timeout, the one timing out first retires.
+    long long timeout = pool->n_active > pool->min_workers ? atomic_get_relaxed(&pool->idle_timeout) : 0;
+    mutex_unlock(&pool->queue_lock);
 
+    if (event_wait(&worker->event, timeout / 1e9) == 0) return 0;
+    __threadpool_lock__(pool);
+    // Still on the idle list, nobody has set the event meanwhile (an event set after the timeout only costs one spurious wake-up).
+    if (worker->parked) {
+        __threadpool_unpark__(worker);
+        if (pool->n_active > pool->min_workers && !__threadpool_worker_ready__(pool, NULL)) {
+            atomic_set(&worker->id, 0);
+            atomic_set(&worker->state, THREADPOOL_WORKER_RETIRED);
+            atomic_sub(&pool->n_active, 1);
+            mutex_unlock(&pool->queue_lock);
+            return 1;
+        }
+    }
+    mutex_unlock(&pool->queue_lock);
+    return 0;
+}
+
+
+void __threadpool_notify__(ThreadPool *pool, int n) {
+    atomic_fence();
+    if (atomic_get(&pool->n_idle) <= 0) return;
+    __threadpool_lock__(pool);
+    // Only the workers needed are woken up, the others stay parked instead of racing for the lock.
+    for (int i = 0; i < n && pool->idle != NULL; i++) {
+        _ThreadWorker *worker = pool->idle;
+        __threadpool_unpark__(worker);
+        event_set(&worker->event);
+    }
+    mutex_unlock(&pool->queue_lock);
+}
+
+
+void __threadpool_unpark__(_ThreadWorker *worker) {
+    ThreadPool *pool = worker->pool;
+    if (worker->idle_prev != NULL) worker->idle_prev->idle_next = worker->idle_next;
+    else pool->idle = worker->idle_next;
+    if (worker->idle_next != NULL) worker->idle_next->idle_prev = worker->idle_prev;
+    worker->idle_prev = NULL;
+    worker->idle_next = NULL;
+    worker->parked = 0;
+    atomic_sub(&pool->n_idle, 1);
+}
+
+
+int __threadpool_worker_ready__(ThreadPool *pool, void *arg) {
+    (void)arg;
+    if (pool->shutdown || __threadpool_queued__(pool) > 0) return 1;
+    return atomic_get(&pool->stealing) && __threadpool_has_work__(pool);
+}
+
+
+int __threadpool_producer_ready__(ThreadPool *pool, void *arg) {
+    _ThreadLane *lane = (_ThreadLane *)arg;
+    return pool->shutdown || atomic_get(&lane->tail) - atomic_get(&lane->head) < pool->queue_capacity;
+}
+
+
+void __threadpool_done__(ThreadPool *pool) {
+    if (atomic_sub(&pool->n_pending, 1) != 1) return;
+    __threadpool_lock__(pool);
+    condition_broadcast(&pool->all_idle);
+    mutex_unlock(&pool->queue_lock);
+}
+
+
+int __threadpool_has_work__(ThreadPool *pool) {
+    for (int i = 0; i < pool->n_workers; i++) {
+        _ThreadDeque *deque = &pool->workers[i].deque;
+        if (atomic_get(&deque->bottom) - atomic_get(&deque->top) > 0) return 1;
+    }
+    return 0;
+}
+
+
+int __threadpool_lane_push__(ThreadPool *pool, int index, ThreadTask *task) {
+    _ThreadLane *lane = &pool->lanes[index];
+    _ThreadCell *cell;
+    long long position = atomic_get_relaxed(&lane->tail);
+    while (1) {
+        cell = &lane->cells[position & lane->mask];
+        long long diff = atomic_get(&cell->sequence) - position;
+        // The slot is free for this lap, claim the position (a failed CAS reloads `position`).
+        if (diff == 0) {
+            if (atomic_cas(&lane->tail, &position, position + 1)) break;
+        }
+        // The slot still holds the task of the previous lap.
+        else if (diff < 0) return 1;
+        else position = atomic_get_relaxed(&lane->tail);
+    }
+    cell->task = *task;
+    long long now = __threadpool_stamped__(pool, position) ? __threadpool_clock__() : 0;
+    atomic_set_relaxed(&cell->enqueued, now);
+    atomic_set(&cell->sequence, position + 1);
+    return 0;
+}
+
+
+int __threadpool_lane_push_many__(ThreadPool *pool, int index, ThreadTask *tasks, int n, int whole) {
+    _ThreadLane *lane = &pool->lanes[index];
+    long long position = atomic_get_relaxed(&lane->tail);
+    long long count;
+    while (1) {
+        // Positions below `head + capacity` have been claimed by the consumers of the previous lap.
+        count = atomic_get(&lane->head) + lane->mask + 1 - position;
+        if (count > n) count = n;
+        if (count <= 0 || (whole && count < n)) return 0;
+        if (atomic_cas(&lane->tail, &position, position + count)) break;
+    }
+    // One clock read for the whole batch, taken at the first stamped task.
+    long long now = 0;
+    for (long long i = 0; i < count; i++) {
+        _ThreadCell *cell = &lane->cells[(position + i) & lane->mask];
+        // A consumer of the previous lap may still be copying the cell out.
+        while (atomic_get(&cell->sequence) != position + i) atomic_pause();
+        cell->task = tasks[i];
+        long long time = 0;
+        if (__threadpool_stamped__(pool, position + i)) {
+            if (now == 0) now = __threadpool_clock__();
+            time = now;
+        }
+        atomic_set_relaxed(&cell->enqueued, time);
+        atomic_set(&cell->sequence, position + i + 1);
+    }
+    return (int)count;
+}
+
+
+int __threadpool_lane_pop_many__(ThreadPool *pool, _ThreadWorker *worker, int index, ThreadTask *tasks, int n, long long *enqueued) {
+    _ThreadLane *lane = &pool->lanes[index];
+    long long position = atomic_get_relaxed(&lane->head);
+    int count;
+    while (1) {
+        count = 0;
+        while (count < n && atomic_get(&lane->cells[(position + count) & lane->mask].sequence) == position + count + 1) count++;
+        if (count == 0) {
+            // The head cell is not filled for this lap yet (empty lane), or `position` is stale.
+            long long head = atomic_get_relaxed(&lane->head);
+            if (head == position) return 0;
+            position = head;
+            continue;
+        }
+        if (atomic_cas(&lane->head, &position, position + count)) break;
+    }
+    int timed = atomic_get_relaxed(&pool->timed);
+    long long now = timed ? __threadpool_clock__() : 0;
+    for (int i = 0; i < count; i++) {
+        _ThreadCell *cell = &lane->cells[(position + i) & lane->mask];
+        tasks[i] = cell->task;
+        long long time = atomic_get_relaxed(&cell->enqueued);
+        if (enqueued) enqueued[i] = time;
+        if (timed && time > 0) __threadpool_lane_record__(pool, worker, index, now - time);
+        // Hand the slot to the producer of the next lap.
+        atomic_set(&cell->sequence, position + i + lane->mask + 1);
+    }
+    __threadpool_wake__(pool, &lane->not_full, count);
+    return count;
+}
+
+
+int __threadpool_lane_select__(ThreadPool *pool, int *aged) {
+    int best = -1;
+    long long now = 0;
+    *aged = 0;
+    for (int i = 0; i < THREADPOOL_LANES; i++) {
+        _ThreadLane *lane = &pool->lanes[i];
+        if (atomic_get_relaxed(&lane->tail) - atomic_get_relaxed(&lane->head) <= 0) continue;
+        if (best < 0) {
+            best = i;
+            if (!atomic_get_relaxed(&pool->timed)) return best;
+            continue;
+        }
+
+        // Only a peek, the cell may be taken (even refilled) right after, which at worst skips a turn.
+        long long head = atomic_get_relaxed(&lane->head);
+        _ThreadCell *cell = &lane->cells[head & lane->mask];
+        if (atomic_get(&cell->sequence) != head + 1) continue;
+        if (now == 0) now = __threadpool_clock__();
+        long long aging = atomic_get_relaxed(&lane->aging);
+        long long served = atomic_get_relaxed(&lane->served);
+        // One overdue task per aging period jumps the higher lanes, the CAS hands the turn to a single thread.
+        if (atomic_get_relaxed(&cell->enqueued) + aging <= now && now - served >= aging && atomic_cas(&lane->served, &served, now)) {
+            *aged = 1;
+            return i;
+        }
+    }
+    return best;
+}
+
+
+void __threadpool_lane_record__(ThreadPool *pool, _ThreadWorker *worker, int index, long long wait) {
+    if (wait < 0) wait = 0;
+    int bucket = 0;
+    while (bucket < THREADPOOL_WAIT_BUCKETS - 1 && (wait >> (bucket + 1)) > 0) bucket++;
+
+    if (worker) {
+        // Only the owner writes, relaxed stores keep the readers of `threadpool_lane_stats` race-free.
+        _ThreadLaneStats *stats = &worker->lane_stats[index];
+        atomic_set_relaxed(&stats->n_started, stats->n_started + 1);
+        atomic_set_relaxed(&stats->wait_total, stats->wait_total + wait);
+        if (wait > stats->wait_max) atomic_set_relaxed(&stats->wait_max, wait);
+        atomic_set_relaxed(&stats->wait_buckets[bucket], stats->wait_buckets[bucket] + 1);
+        return;
+    }
+    _ThreadLaneStats *stats = &pool->lanes[index].stats;
+    atomic_add(&stats->n_started, 1);
+    atomic_add(&stats->wait_total, wait);
+    long long max = atomic_get_relaxed(&stats->wait_max);
+    while (wait > max && !atomic_cas(&stats->wait_max, &max, wait)) {}
+    atomic_add(&stats->wait_buckets[bucket], 1);
+}
+
+
+int __threadpool_take__(_ThreadWorker *worker, ThreadTask *task) {
+    ThreadPool *pool = worker->pool;
+    int aged;
+    int first = __threadpool_lane_select__(pool, &aged);
+    // The selected lane, then every lane by priority (a stale peek must not hide a queued task).
+    for (int k = -1; k < THREADPOOL_LANES; k++) {
+        int index = k < 0 ? first : k;
+        if (index < 0 || (k >= 0 && index == first)) continue;
+        _ThreadLane *lane = &pool->lanes[index];
+
+        // Take a fair share of the lane in one reservation, the rest stays for the other workers.
+        long long share = (atomic_get_relaxed(&lane->tail) - atomic_get_relaxed(&lane->head)) / atomic_get_relaxed(&pool->n_active);
+        if (share < 1) share = 1;
+        if (share > THREADPOOL_BATCH) share = THREADPOOL_BATCH;
+        // An aging turn is a single task.
+        if (aged && index == first) share = 1;
+        int count = __threadpool_lane_pop_many__(pool, worker, index, worker->batch, (int)share, worker->batch_enqueued);
+        if (count > 0) {
+            worker->batch_head = 1;
+            worker->batch_count = count;
+            worker->batch_lane = index;
+            worker->batch_deadline = worker->batch_enqueued[0] + atomic_get_relaxed(&lane->aging);
+            worker->stats.enqueued = worker->batch_enqueued[0];
+            *task = worker->batch[0];
+            return 0;
+        }
+    }
+    return 1;
+}
+
+
+int __threadpool_pop__(ThreadPool *pool, _ThreadWorker *worker, ThreadTask *task) {
+    int aged;
+    int first = __threadpool_lane_select__(pool, &aged);
+    for (int k = -1; k < THREADPOOL_LANES; k++) {
+        int index = k < 0 ? first : k;
+        if (index < 0 || (k >= 0 && index == first)) continue;
+        if (__threadpool_lane_pop_many__(pool, worker, index, task, 1, NULL) == 1) return 0;
+    }
+    return 1;
+}
+
+
+int __threadpool_urgent__(_ThreadWorker *worker) {
+    ThreadPool *pool = worker->pool;
+    _ThreadLane *lane = &pool->lanes[THREADPOOL_LANE_HIGH];
+    if (atomic_get_relaxed(&lane->tail) - atomic_get_relaxed(&lane->head) <= 0) return 0;
+
+    if (worker->batch_head < worker->batch_count) {
+        if (worker->batch_lane == THREADPOOL_LANE_HIGH) return 0;
+        // Overdue buffered tasks keep their turn, a stream of high-priority tasks cannot hold them back for good.
+        return !atomic_get_relaxed(&pool->timed) || worker->batch_deadline > __threadpool_clock__();
+    }
+    // The own deque has no deadlines, and without local work the regular path serves the high lane first anyway.
+    return atomic_get_relaxed(&pool->stealing) && atomic_get_relaxed(&worker->deque.bottom) - atomic_get_relaxed(&worker->deque.top) > 0;
+}
+
+
+int __threadpool_spawn__(ThreadPool *pool) {
+    for (int i = 0; i < pool->n_workers; i++) {
+        _ThreadWorker *worker = &pool->workers[i];
+        if (worker->state == THREADPOOL_WORKER_RUNNING) continue;
+        // The retired thread left its loop before it gave up the lock held here, the join does not wait on the pool.
+        if (worker->state == THREADPOOL_WORKER_RETIRED) thread_join(&(pool->threads[i]), NULL);
+
+        atomic_set(&worker->state, THREADPOOL_WORKER_RUNNING);
+        atomic_add(&pool->n_active, 1);
+        if (thread_create(&(pool->threads[i]), __threadpool_worker__, (void *)worker) != 0) {
+            atomic_set(&worker->state, THREADPOOL_WORKER_UNUSED);
+            atomic_sub(&pool->n_active, 1);
+            return 1;
+        }
+        if (worker->cpu >= 0) thread_affinity(&(pool->threads[i]), worker->cpu);
+        return 0;
+    }
+    return 1;
+}
+
+
+void __threadpool_grow__(ThreadPool *pool) {
+    // A fixed-size pool stops at this check.
+    int n_active = atomic_get_relaxed(&pool->n_active);
+    if (n_active >= pool->n_workers) return;
+
+    long long since = atomic_get_relaxed(&pool->backlog_since);
+    if (__threadpool_queued__(pool) <= n_active) {
+        if (since) atomic_set_relaxed(&pool->backlog_since, 0);
+        return;
+    }
+    long long now = __threadpool_clock__();
+    if (since == 0) {
+        atomic_cas(&pool->backlog_since, &since, now);
+        return;
+    }
+    // The queued tasks beyond one per worker have waited about this long, one thread is started per `spawn_wait`.
+    if (now - since < atomic_get_relaxed(&pool->spawn_wait) || !atomic_cas(&pool->backlog_since, &since, now)) return;
+
+    __threadpool_lock__(pool);
+    if (!pool->shutdown && pool->n_active < pool->n_workers) __threadpool_spawn__(pool);
+    mutex_unlock(&pool->queue_lock);
+}
+
+
+long long __threadpool_queued__(ThreadPool *pool) {
+    long long count = 0;
+    for (int i = 0; i < THREADPOOL_LANES; i++) count = count + atomic_get(&pool->lanes[i].tail) - atomic_get(&pool->lanes[i].head);
+    return count;
+}
+
+
+long long __threadpool_clock__() {
+    #if defined(__OS_UNIX__)
+        struct timespec t;
+        clock_gettime(CLOCK_MONOTONIC, &t);
+        return (long long)t.tv_sec * 1000000000LL + t.tv_nsec;
+    #elif defined(__OS_WINDOWS__)
+        LARGE_INTEGER frequency;
+        LARGE_INTEGER counter;
+        QueryPerformanceFrequency(&frequency);
+        QueryPerformanceCounter(&counter);
+        return (long long)((double)counter.QuadPart * 1e9 / frequency.QuadPart);
+    #endif
+}
+
+
+int __threadpool_stamped__(ThreadPool *pool, long long position) {
+    if (atomic_get_relaxed(&pool->timed)) return 1;
+    #if defined(THREADPOOL_STATS)
+        return (position & (THREADPOOL_STATS_SAMPLE - 1)) == 0;
+    #else
+        (void)position;
+        return 0;
+    #endif
+}
+
+
+void __threadpool_lock__(ThreadPool *pool) {
+    #if defined(THREADPOOL_STATS)
+        if (mutex_trylock(&pool->queue_lock) == 0) return;
+        _ThreadWorker *worker = __threadpool_self__(pool);
+        if (worker == NULL) {
+            mutex_lock(&pool->queue_lock);
+            return;
+        }
+        long long start = __threadpool_clock__();
         mutex_lock(&pool->queue_lock);
-        pool->n_working--;
-        if (pool->n_working == 0 && pool->queue_length == 0) condition_broadcast(&pool->all_idle);
-        mutex_unlock(&pool->queue_lock);
+        // Under the lock, but the counters still belong to this worker alone.
+        __THREADPOOL_COUNT__(worker->stats.counters.lock_wait, __threadpool_clock__() - start);
+        __THREADPOOL_COUNT__(worker->stats.counters.n_lock_waits, 1);
+    #else
+        mutex_lock(&pool->queue_lock);
+    #endif
+}
+
+
+int __threadpool_histogram_index__(long long value) {
+    if (value < THREADPOOL_HISTOGRAM_SUB) return value > 0 ? (int)value : 0;
+    int e;
+    #if defined(__GNUC__) && !defined(__TINYC__)
+        e = 63 - __builtin_clzll((unsigned long long)value);
+    #else
+        e = 0;
+        for (unsigned long long v = (unsigned long long)value; v > 1; v = v >> 1) e++;
+    #endif
+    // `e - 1` octaves of `4` buckets above the linear part, the two bits after the leading one pick the sub-bucket.
+    int index = THREADPOOL_HISTOGRAM_SUB * (e - 1) + (int)((value >> (e - 2)) & (THREADPOOL_HISTOGRAM_SUB - 1));
+    return index < THREADPOOL_HISTOGRAM_BUCKETS ? index : THREADPOOL_HISTOGRAM_BUCKETS - 1;
+}
+
+
+long long __threadpool_histogram_bound__(int index) {
+    if (index < THREADPOOL_HISTOGRAM_SUB) return index + 1;
+    int e = index / THREADPOOL_HISTOGRAM_SUB + 1;
+    long long sub = index % THREADPOOL_HISTOGRAM_SUB;
+    return (1LL << e) + (sub + 1) * (1LL << (e - 2));
+}
+
+
+double __threadpool_histogram_percentile__(const long long *histogram, double q) {
+    long long total = 0;
+    for (int j = 0; j < THREADPOOL_HISTOGRAM_BUCKETS; j++) total = total + histogram[j];
+    if (total == 0) return 0;
+
+    long long seen = 0;
+    for (int j = 0; j < THREADPOOL_HISTOGRAM_BUCKETS; j++) {
+        seen = seen + histogram[j];
+        if (seen >= q * total) return (double)__threadpool_histogram_bound__(j) / 1e9;
     }
+    return (double)__threadpool_histogram_bound__(THREADPOOL_HISTOGRAM_BUCKETS - 1) / 1e9;
+}
+
+
+int __threadpool_deque_push__(_ThreadDeque *deque, ThreadTask *task) {
+    long long bottom = atomic_get_relaxed(&deque->bottom);
+    long long top = atomic_get(&deque->top);
+    if (bottom - top > deque->mask) return 1;
+
+    // Slots are written and read field by field with atomics, a thief may read a slot the owner is reusing (it then fails its CAS).
+    ThreadTask *slot = &deque->buffer[bottom & deque->mask];
+    atomic_set_relaxed(&slot->func, task->func);
+    atomic_set_relaxed(&slot->args, task->args);
+    atomic_set_relaxed(&slot->cleanup, task->cleanup);
+    atomic_set(&deque->bottom, bottom + 1);
     return 0;
 }
+
+
+int __threadpool_deque_pop__(_ThreadDeque *deque, ThreadTask *task) {
+    long long bottom = atomic_get_relaxed(&deque->bottom) - 1;
+    atomic_set_relaxed(&deque->bottom, bottom);
+    atomic_fence();
+    long long top = atomic_get_relaxed(&deque->top);
+
+    if (top > bottom) {
+        atomic_set_relaxed(&deque->bottom, bottom + 1);
+        return 1;
+    }
+
+    ThreadTask *slot = &deque->buffer[bottom & deque->mask];
+    task->func = atomic_get_relaxed(&slot->func);
+    task->args = atomic_get_relaxed(&slot->args);
+    task->cleanup = atomic_get_relaxed(&slot->cleanup);
+    if (top < bottom) return 0;
+
+    // The last task, race the thieves for it.
+    int won = atomic_cas(&deque->top, &top, top + 1);
+    atomic_set_relaxed(&deque->bottom, bottom + 1);
+    return won ? 0 : 1;
+}
+
+
+int __threadpool_deque_steal__(_ThreadDeque *deque, ThreadTask *task) {
+    long long top = atomic_get(&deque->top);
+    atomic_fence();
+    long long bottom = atomic_get(&deque->bottom);
+    if (top >= bottom) return 1;
+
+    ThreadTask *slot = &deque->buffer[top & deque->mask];
+    task->func = atomic_get_relaxed(&slot->func);
+    task->args = atomic_get_relaxed(&slot->args);
+    task->cleanup = atomic_get_relaxed(&slot->cleanup);
+    return atomic_cas(&deque->top, &top, top + 1) ? 0 : 2;
+}
+
+
+int __threadpool_steal__(_ThreadWorker *worker, ThreadTask *task) {
+    ThreadPool *pool = worker->pool;
+    int n = pool->n_workers;
+
+    // xorshift64.
+    worker->seed ^= worker->seed << 13;
+    worker->seed ^= worker->seed >> 7;
+    worker->seed ^= worker->seed << 17;
+    int start = (int)(worker->seed % (unsigned long long)n);
+
+    for (int i = 0; i < n; i++) {
+        _ThreadWorker *victim = &pool->workers[(start + i) % n];
+        if (victim == worker) continue;
+        int status;
+        while ((status = __threadpool_deque_steal__(&victim->deque, task)) == 2) atomic_pause();
+        #if defined(THREADPOOL_STATS)
+            __THREADPOOL_COUNT__(worker->stats.counters.n_steal_attempts, 1);
+            if (status == 0) __THREADPOOL_COUNT__(worker->stats.counters.n_steals, 1);
+        #endif
+        if (status == 0) return 0;
+    }
+    return 1;
+}
+
+
+int __threadpool_help__(ThreadPool *pool) {
+    ThreadTask task;
+    _ThreadWorker *worker = __threadpool_self__(pool);
+    int stealing = atomic_get(&pool->stealing);
+
+    if (worker && worker->batch_head < worker->batch_count) task = worker->batch[worker->batch_head++];
+    else if (worker && stealing && __threadpool_deque_pop__(&worker->deque, &task) == 0) {}
+    else if (__threadpool_pop__(pool, worker, &task) == 0) {}
+    else if (worker && stealing && __threadpool_steal__(worker, &task) == 0) {}
+    else return 1;
+
+    if (task.func) task.func(task.args);
+    if (task.cleanup) task.cleanup(task.args);
+    __threadpool_done__(pool);
+    return 0;
+}
+
+
+int __threadpool_add_helping__(ThreadPool *pool, void (*func)(void *args), void *args, void (*cleanup)(void *args)) {
+    // A worker parked on `not_full` could be the only one left to drain the queue, so a full queue is drained by helping.
+    int status;
+    while ((status = threadpool_add(pool, func, args, 0, cleanup)) == 2) {
+        if (__threadpool_help__(pool) != 0) {
+            status = threadpool_add(pool, func, args, 1, cleanup);
+            break;
+        }
+    }
+    return status;
+}
+
+
+int __threadpool_loop__(ThreadPool *pool, _ThreadLoop *loop) {
+    if (loop->end <= loop->begin) return 0;
+    if (loop->grain < 1) loop->grain = 1;
+
+    long long n = loop->end - loop->begin;
+    long long n_chunks = (n + loop->grain - 1) / loop->grain;
+    int n_participants = atomic_get_relaxed(&pool->n_active) + 1;
+    if (n_chunks < n_participants) n_participants = (int)n_chunks;
+
+    loop->schedule = pool->schedule;
+    loop->n_participants = n_participants;
+    loop->remaining = n_participants;
+    loop->next = loop->begin;
+    loop->chunk = (n + n_participants - 1) / n_participants;
+    if (loop->chunk < loop->grain) loop->chunk = loop->grain;
+
+    // A single chunk runs on the caller, no helper, no lock.
+    if (n_participants == 1) {
+        if (loop->partials) memcpy(loop->partials, loop->identity, loop->size);
+        __threadpool_loop_participant__(loop);
+        return 0;
+    }
+
+    if (loop->partials) for (int i = 0; i < n_participants; i++) memcpy(loop->partials + i * loop->stride, loop->identity, loop->size);
+
+    if (mutex_create(&loop->lock, 1) != 0) return 1;
+    if (condition_init(&loop->finished) != 0) {
+        mutex_destroy(&loop->lock);
+        return 1;
+    }
+
+    // `__threadpool_loop_leave__` is the cleanup, so a helper discarded by the shutdown is counted out as well.
+    ThreadTask tasks[THREADPOOL_BATCH];
+    for (int i = 0; i < THREADPOOL_BATCH; i++) {
+        tasks[i].func = __threadpool_loop_participant__;
+        tasks[i].args = loop;
+        tasks[i].cleanup = __threadpool_loop_leave__;
+    }
+    for (int i = 1; i < n_participants; i += THREADPOOL_BATCH) {
+        int count = n_participants - i < THREADPOOL_BATCH ? n_participants - i : THREADPOOL_BATCH;
+        // A worker parked on `not_full` could be the only one left to drain the queue, so a full queue is drained by helping.
+        while (threadpool_add_batch(pool, tasks, count, 0) == 2) {
+            if (__threadpool_help__(pool) != 0) {
+                threadpool_add_batch(pool, tasks, count, 1);
+                break;
+            }
+        }
+    }
+
+    __threadpool_loop_participant__(loop);
+    __threadpool_loop_leave__(loop);
+
+    // The helpers point at this stack frame, wait for all of them, running queued tasks (perhaps the helpers themselves) meanwhile.
+    while (1) {
+        mutex_lock(&loop->lock);
+        int remaining = loop->remaining;
+        mutex_unlock(&loop->lock);
+        if (remaining == 0) break;
+        if (__threadpool_help__(pool) == 0) continue;
+
+        mutex_lock(&loop->lock);
+        while (loop->remaining > 0) condition_wait(&loop->finished, &loop->lock);
+        mutex_unlock(&loop->lock);
+    }
+
+    condition_destroy(&loop->finished);
+    mutex_destroy(&loop->lock);
+    return 0;
+}
+
+
+void __threadpool_loop_participant__(void *args) {
+    _ThreadLoop *loop = (_ThreadLoop *)args;
+    int id = atomic_add(&loop->next_participant, 1);
+
+    void *partial = loop->partials ? loop->partials + id * loop->stride : NULL;
+
+    long long begin, end;
+    for (long long k = 0; __threadpool_loop_chunk__(loop, id, k, &begin, &end) == 0; k++) {
+        if (loop->body) loop->body(begin, end, loop->ctx);
+        else loop->reduce(begin, end, loop->ctx, partial);
+    }
+}
+
+
+void __threadpool_loop_leave__(void *args) {
+    _ThreadLoop *loop = (_ThreadLoop *)args;
+    mutex_lock(&loop->lock);
+    loop->remaining--;
+    if (loop->remaining == 0) condition_signal(&loop->finished);
+    mutex_unlock(&loop->lock);
+}
+
+
+int __threadpool_loop_chunk__(_ThreadLoop *loop, int id, long long k, long long *begin, long long *end) {
+    long long start, size;
+    switch (loop->schedule) {
+        case THREADPOOL_SCHEDULE_STATIC:
+            start = loop->begin + (id + k * loop->n_participants) * loop->chunk;
+            size = loop->chunk;
+            break;
+        case THREADPOOL_SCHEDULE_DYNAMIC:
+            start = atomic_add(&loop->next, loop->grain);
+            size = loop->grain;
+            break;
+        default:
+            start = atomic_get(&loop->next);
+            while (1) {
+                if (start >= loop->end) return 1;
+                size = (loop->end - start) / (2 * loop->n_participants);
+                if (size < loop->grain) size = loop->grain;
+                if (atomic_cas(&loop->next, &start, start + size)) break;
+            }
+            break;
+    }
+    if (start >= loop->end) return 1;
+    *begin = start;
+    *end = loop->end - start < size ? loop->end : start + size;
+    return 0;
+}
+
+
+int __threadpool_future_ready__(ThreadPool *pool, void *arg) {
+    (void)pool;
+    return atomic_get(&((TaskFuture *)arg)->state) != TASK_FUTURE_PENDING;
+}
+
+
+TaskFuture *__threadpool_future_allocate__(ThreadPool *pool) {
+    TaskFuture *future = NULL;
+    _ThreadWorker *worker = __threadpool_self__(pool);
+
+    if (worker && worker->futures) {
+        future = worker->futures;
+        worker->futures = future->next;
+        worker->n_futures--;
+    }
+    else {
+        mutex_lock(&pool->future_lock);
+        if (!pool->futures) {
+            TaskFuture *slab = (TaskFuture *)malloc(THREADPOOL_FUTURE_SLAB * sizeof(TaskFuture));
+            if (slab) {
+                slab->next = pool->future_slabs;
+                pool->future_slabs = slab;
+                for (int i = 1; i < THREADPOOL_FUTURE_SLAB; i++) {
+                    slab[i].next = pool->futures;
+                    pool->futures = &slab[i];
+                }
+            }
+        }
+        future = pool->futures;
+        if (future) pool->futures = future->next;
+        mutex_unlock(&pool->future_lock);
+        if (!future) return NULL;
+    }
+
+    memset(future, 0, sizeof(TaskFuture));
+    future->pool = pool;
+    // One reference for the handle, one for the task.
+    future->refs = 2;
+    return future;
+}
+
+
+void __threadpool_future_free__(ThreadPool *pool, TaskFuture *future) {
+    _ThreadWorker *worker = __threadpool_self__(pool);
+    if (worker && worker->n_futures < THREADPOOL_FUTURE_CACHE) {
+        future->next = worker->futures;
+        worker->futures = future;
+        worker->n_futures++;
+        return;
+    }
+    mutex_lock(&pool->future_lock);
+    future->next = pool->futures;
+    pool->futures = future;
+    mutex_unlock(&pool->future_lock);
+}
+
+
+void __threadpool_future_run__(void *args) {
+    TaskFuture *future = (TaskFuture *)args;
+    future->result = future->func(future->args);
+    atomic_set(&future->state, TASK_FUTURE_DONE);
+}
+
+
+void __threadpool_future_finish__(void *args) {
+    TaskFuture *future = (TaskFuture *)args;
+    ThreadPool *pool = future->pool;
+
+    if (atomic_get(&future->state) == TASK_FUTURE_PENDING) atomic_set(&future->state, TASK_FUTURE_CANCELLED);
+
+    // Closing the list makes a later `future_then` schedule its continuation by itself.
+    TaskFuture *continuation = atomic_swap(&future->continuations, __THREADPOOL_FUTURE_CLOSED__);
+    while (continuation) {
+        TaskFuture *next = continuation->next;
+        __threadpool_future_schedule__(future, continuation);
+        continuation = next;
+    }
+
+    __threadpool_wake__(pool, &pool->completed, 1 << 30);
+    future_release(future);
+}
+
+
+void __threadpool_future_schedule__(TaskFuture *antecedent, TaskFuture *future) {
+    future->next = NULL;
+    if (atomic_get(&antecedent->state) == TASK_FUTURE_DONE) {
+        future->args = antecedent->result;
+        if (__threadpool_add_helping__(future->pool, __threadpool_future_run__, future, __threadpool_future_finish__) == 0) return;
+    }
+    __threadpool_future_finish__(future);
+}
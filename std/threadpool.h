@@ -2,10 +2,64 @@
 #define _THREADPOOL_H_
 
 
+#include <time.h>
+#include <stdio.h>
 #include <string.h>
 
 
 #include "thread.h"
+#include "atomic.h"
+
+
+#define THREADPOOL_DEQUE_CAPACITY 4096     // Per-worker deque slots (power of two), a full deque spills into the shared queue.
+#define THREADPOOL_SPIN 64      // Rounds an idle worker polls the queue (and the deques) between two looks at the clock.
+#define THREADPOOL_SPIN_TIME 20000LL    // Nanoseconds an idle worker polls with `atomic_pause` before it starts yielding.
+#define THREADPOOL_YIELD_TIME 100000LL  // Nanoseconds it then polls with `thread_yield` before it parks on its event (both are `0` on a single CPU).
+#define THREADPOOL_BATCH 16     // Most tasks a worker takes from the shared queue at once (never more than its fair share).
+#define THREADPOOL_FUTURE_SLAB 256      // Futures allocated at once when the free lists run dry.
+#define THREADPOOL_FUTURE_CACHE 64      // Most free futures a worker keeps for itself.
+#define THREADPOOL_LANES 3
+#define THREADPOOL_AGING_NORMAL 1000000LL      // Nanoseconds a normal task waits before it outranks a new high-priority task.
+#define THREADPOOL_AGING_LOW 10000000LL        // The same for a low-priority task.
+#define THREADPOOL_WAIT_BUCKETS 40      // Log2 buckets of queue wait times (the last one collects waits beyond about 9 minutes).
+#define THREADPOOL_IDLE_TIMEOUT 1000000000LL   // Nanoseconds a worker above the minimum stays parked before it exits.
+#define THREADPOOL_SPAWN_WAIT 1000000LL         // Nanoseconds the queues stay backed up before another worker is started.
+#define THREADPOOL_STATS_SAMPLE 64     // One task in this many is timed by `THREADPOOL_STATS` (a power of two, every lane task once aging is on).
+#define THREADPOOL_HISTOGRAM_SUB 4      // Linear sub-buckets per power of two in the histograms of `THREADPOOL_STATS`.
+#define THREADPOOL_HISTOGRAM_BUCKETS 160    // Up to 2^41 nanoseconds (about 36 minutes), the last bucket collects the rest.
+
+
+#define THREADPOOL_LANE_HIGH 0      // Latency-sensitive tasks (request handlers, log flushes).
+#define THREADPOOL_LANE_NORMAL 1    // `threadpool_add` and everything built on it.
+#define THREADPOOL_LANE_LOW 2       // Batch work.
+
+
+#define THREADPOOL_WORKER_UNUSED 0
+#define THREADPOOL_WORKER_RUNNING 1
+#define THREADPOOL_WORKER_RETIRED 2     // Exited after an idle timeout, the thread is joined when the slot is reused.
+
+
+#define TASK_FUTURE_PENDING 0
+#define TASK_FUTURE_DONE 1
+#define TASK_FUTURE_CANCELLED 2     // The task was discarded by `threadpool_destroy(pool, 0)`, or its antecedent was.
+
+
+#if (defined(__GNUC__) || defined(__clang__)) && !defined(__TINYC__)
+    #define THREADPOOL_TLS __thread
+#endif
+
+
+/**
+ * Compile with `-DTHREADPOOL_STATS` to record the counters of `threadpool_stats`, every worker writes its own counters only.
+**/
+#define __THREADPOOL_COUNT__(counter, value) atomic_set_relaxed(&(counter), (counter) + (value))
+
+
+typedef enum {
+    THREADPOOL_SCHEDULE_STATIC,     // Blocks of `max(grain, n / participants)` iterations dealt round-robin up front.
+    THREADPOOL_SCHEDULE_DYNAMIC,    // Chunks of `grain` iterations claimed one by one.
+    THREADPOOL_SCHEDULE_GUIDED      // Chunks shrinking with the iterations left, never below `grain`.
+} ThreadPoolSchedule;
 
 
 typedef struct {
@@ -15,34 +69,238 @@ typedef struct {
 } ThreadTask;
 
 
+/**
+ * A condition with the bookkeeping that lets a waker skip the lock when nobody is waiting (both counters change under `queue_lock`).
+**/
+typedef struct {
+    ThreadCondition condition;
+    int n_waiting;      // Threads inside `condition_wait`.
+    int n_signaled;     // Signals sent and not consumed by a woken thread yet, so one parked thread is not signaled twice.
+} _ThreadWaiters;
+
+
+typedef struct TaskFuture {
+    void *(*func)(void *args);
+    void *args;
+    void *result;
+    int state;      // `TASK_FUTURE_PENDING`, `TASK_FUTURE_DONE` or `TASK_FUTURE_CANCELLED`.
+    int refs;       // The holder of the handle and the task not finished yet.
+    struct ThreadPool *pool;
+    struct TaskFuture *continuations;   // Futures created by `future_then`, `__THREADPOOL_FUTURE_CLOSED__` once they are scheduled.
+    struct TaskFuture *next;            // The next continuation of the same future, or the next free future.
+} TaskFuture;
+
+
+#define __THREADPOOL_FUTURE_CLOSED__ ((TaskFuture *)1)
+
+
+/**
+ * One slot of a lane, `sequence` tells producers and consumers whose turn the slot is (Vyukov bounded MPMC queue).
+**/
+typedef struct {
+    long long sequence;
+    ThreadTask task;
+    long long enqueued;     // `__threadpool_clock__` when the task was queued.
+} _ThreadCell;
+
+
+/**
+ * Queue wait times of one lane, measured from the enqueue to the dequeue of every task.
+**/
+typedef struct {
+    long long n_started;    // Tasks timed (queued after `timed` was set).
+    long long wait_total;   // Nanoseconds.
+    long long wait_max;
+    long long wait_buckets[THREADPOOL_WAIT_BUCKETS];    // Bucket `i` counts the waits below `2^(i+1)` nanoseconds and not below `2^i`.
+} _ThreadLaneStats;
+
+
+/**
+ * One priority lane, a lock-free queue of its own. Workers serve the highest lane holding a task, except that the head task
+ * of a lower lane waiting longer than the `aging` of its lane gets one turn per aging period, so it is never starved.
+**/
+typedef struct {
+    char padding_head[ATOMIC_CACHE_LINE];
+    long long head;     // Next position to dequeue.
+    char padding_tail[ATOMIC_CACHE_LINE];
+    long long tail;     // Next position to enqueue.
+    char padding_end[ATOMIC_CACHE_LINE];
+    _ThreadCell *cells;
+    long long mask;
+    long long aging;    // Nanoseconds.
+    long long served;   // `__threadpool_clock__` of the last turn given through aging.
+    _ThreadWaiters not_full;    // Used to wake up the producers blocked on this lane.
+    _ThreadLaneStats stats;     // Tasks taken by threads that are not workers (updated atomically).
+} _ThreadLane;
+
+
+typedef struct {
+    long long n_tasks;
+    long long busy;         // Nanoseconds outside of `idle` (running tasks and taking them from the queues).
+    long long idle;         // Nanoseconds spent spinning, stealing or parked after the local work ran out.
+    long long n_steal_attempts;     // Deques probed by this worker while stealing.
+    long long n_steals;
+    long long lock_wait;    // Nanoseconds blocked on `queue_lock` (acquisitions without contention are not timed).
+    long long n_lock_waits;
+} ThreadPoolWorkerStats;
+
+
+/**
+ * The counters of one worker, on cache lines of their own inside the worker.
+**/
+typedef struct {
+    char padding_head[ATOMIC_CACHE_LINE];
+    ThreadPoolWorkerStats counters;
+    long long latency[THREADPOOL_HISTOGRAM_BUCKETS];    // Enqueue to start of the sampled lane tasks (deque tasks carry no enqueue time).
+    long long runtime[THREADPOOL_HISTOGRAM_BUCKETS];    // Run time of the sampled tasks.
+    long long origin;       // `__threadpool_clock__` when the worker started.
+    long long finish;       // `__threadpool_clock__` when the worker stopped, `0` while running.
+    long long clock;        // `__threadpool_clock__` when the current wait began.
+    long long enqueued;     // The enqueue time of the task being started, `0` for unsampled.
+    int waited;             // `1` from running out of local work until the next task starts.
+    char padding_tail[ATOMIC_CACHE_LINE];
+} _ThreadWorkerStats;
+
+
 typedef struct {
-    int shutdown;   // `0` for running, `1` for shutdown.
     int n_workers;
-    int n_working;
+    ThreadPoolWorkerStats total;    // The sum over the workers.
+    double utilization;     // `busy / (busy + idle)`.
+    double latency_p50;     // Seconds from enqueue to start of the sampled tasks (upper bound of the bucket).
+    double latency_p99;
+    double latency_max;
+    double runtime_p50;     // Seconds of run time of the sampled tasks (upper bound of the bucket).
+    double runtime_p99;
+    double runtime_max;
+    long long latency[THREADPOOL_HISTOGRAM_BUCKETS];    // Log-linear histograms in nanoseconds, see `__threadpool_histogram_index__`.
+    long long runtime[THREADPOOL_HISTOGRAM_BUCKETS];
+} ThreadPoolStats;
+
+
+typedef struct {
+    long long depth;        // Tasks queued in the lane now.
+    long long n_added;      // Tasks queued since the pool was created.
+    long long n_started;    // Tasks taken out of the lane since the pool was created (the wait times cover the timed ones only).
+    double wait_mean;       // Seconds from enqueue to dequeue.
+    double wait_p50;        // Upper bound of the bucket holding the median.
+    double wait_p99;        // Upper bound of the bucket holding the 99th percentile.
+    double wait_max;
+} ThreadPoolLaneStats;
+
+
+/**
+ * Chase-Lev deque: the owner pushes and pops at `bottom`, thieves take from `top`.
+**/
+typedef struct {
+    long long top;
+    char padding[ATOMIC_CACHE_LINE - sizeof(long long)];
+    long long bottom;
+    ThreadTask *buffer;
+    long long mask;
+} _ThreadDeque;
+
+
+typedef struct _ThreadWorker {
+    _ThreadDeque deque;
+    struct ThreadPool *pool;
+    unsigned long long id;      // `thread_id()` of the worker, used when `THREADPOOL_TLS` is not available.
+    unsigned long long seed;    // State of the random victim selection.
+    int state;      // `THREADPOOL_WORKER_UNUSED`, `THREADPOOL_WORKER_RUNNING` or `THREADPOOL_WORKER_RETIRED` (changed under `queue_lock`).
+    int cpu;        // The CPU the worker is pinned to, `-1` for none.
+    int node;       // The NUMA node of `cpu`, `-1` for unknown.
+    ThreadEvent event;  // Set to wake up this worker when it is parked.
+    int parked;     // `1` while the worker is on the idle list (changed under `queue_lock`).
+    struct _ThreadWorker *idle_prev;    // Neighbours on the idle list.
+    struct _ThreadWorker *idle_next;
+    int batch_head;
+    int batch_count;
+    ThreadTask batch[THREADPOOL_BATCH];     // Tasks taken from one lane and not started yet.
+    long long batch_enqueued[THREADPOOL_BATCH];
+    int batch_lane;
+    long long batch_deadline;   // The enqueue time plus the aging of the first task in `batch`.
+    _ThreadLaneStats lane_stats[THREADPOOL_LANES];  // Written by this worker only.
+    _ThreadWorkerStats stats;   // Written by this worker only (`THREADPOOL_STATS`).
+    TaskFuture *futures;    // Free futures of this worker (no lock).
+    int n_futures;
+    char padding[ATOMIC_CACHE_LINE];
+} _ThreadWorker;
+
+
+typedef struct ThreadPool {
+    int shutdown;   // `0` for running, `1` for shutdown, `2` for shutdown discarding the queued tasks.
+    int stealing;   // `1` for work-stealing mode (see `threadpool_config_stealing`).
+    ThreadPoolSchedule schedule;    // Used by `threadpool_parallel_for` and `threadpool_parallel_reduce`.
+    int n_workers;  // Worker slots, the most threads the pool runs at once.
+    int min_workers;    // Threads kept however idle the pool is.
+    int n_active;   // Threads running now (changed under `queue_lock`).
+    long long idle_timeout;     // See `THREADPOOL_IDLE_TIMEOUT`.
+    long long spawn_wait;       // See `THREADPOOL_SPAWN_WAIT`.
+    long long backlog_since;    // `__threadpool_clock__` since the queues hold more tasks than running threads, `0` for none.
+    int timed;      // `1` once a task went to another lane than the normal one (or the aging was set), tasks are timestamped from then on.
+    long long n_pending;    // Tasks submitted and not finished yet (queued, in a deque or running).
     Thread *threads;
-    ThreadCondition notify;     // Used to wake up the sleeping threads.
-    ThreadCondition not_full;
-    ThreadCondition all_idle;   // The trigger condition is when the queue is empty and all threads are free.
-    Mutex queue_lock;
-    int queue_length;
-    int queue_capacity;
-    ThreadTask *queue;
-    int queue_head;
-    int queue_tail;
+    _ThreadWorker *workers;
+    _ThreadWorker *idle;    // The parked workers, the last one parked first (guarded by `queue_lock`).
+    int n_idle;     // Read without the lock, nobody needs waking at `0`.
+    long long spin_time;    // See `THREADPOOL_SPIN_TIME`.
+    long long yield_time;   // See `THREADPOOL_YIELD_TIME`.
+    _ThreadWaiters completed;   // Used to wake up the threads in `future_wait` (each checks its own future).
+    ThreadCondition all_idle;   // The trigger condition is when no task is pending.
+    Mutex queue_lock;   // Only taken to park and wake up threads, the queue itself is lock-free.
+    Mutex future_lock;  // Guards `futures` and `future_slabs`.
+    TaskFuture *futures;    // Free futures shared by all threads.
+    TaskFuture *future_slabs;   // The first future of every slab is its header, linking the slabs.
+    int queue_capacity;     // Slots of every lane (power of two).
+    _ThreadLane lanes[THREADPOOL_LANES];
 } ThreadPool;
 
 
+/**
+ * One `threadpool_parallel_for` (or `threadpool_parallel_reduce`) call, it lives on the stack of the caller.
+**/
+typedef struct {
+    long long begin;
+    long long end;
+    long long grain;
+    long long chunk;    // Block size of the static schedule.
+    long long next;     // First iteration not claimed yet (dynamic and guided schedules).
+    ThreadPoolSchedule schedule;
+    int n_participants;     // The caller and the helper tasks.
+    int next_participant;
+    int remaining;      // Participants not finished yet (guarded by `lock`).
+    void (*body)(long long begin, long long end, void *ctx);
+    void (*reduce)(long long begin, long long end, void *ctx, void *partial);
+    void *ctx;
+    char *partials;     // One cache-line aligned partial result per participant.
+    unsigned long long stride;
+    const void *identity;
+    unsigned long long size;
+    Mutex lock;
+    ThreadCondition finished;
+} _ThreadLoop;
+
+
 /**
  * @brief Create a thread pool.
  * @param n_workers The number of threads.
- * @param queue_capacity The maximum length of thread queue.
+ * @param queue_capacity The maximum length of every priority lane (rounded up to a power of two).
  * @return `NULL` for failure.
 **/
 ThreadPool *threadpool_create(int n_workers, int queue_capacity);
 
 
 /**
- * @brief Add a task to the thread pool.
+ * @brief Create a thread pool that starts more threads while the queues stay backed up and stops them when they idle.
+ * @param min_workers The number of threads started right away and never stopped (at least `1`).
+ * @param max_workers The most threads running at once.
+ * @param queue_capacity The maximum length of every priority lane (rounded up to a power of two).
+ * @return `NULL` for failure.
+**/
+ThreadPool *threadpool_create_elastic(int min_workers, int max_workers, int queue_capacity);
+
+
+/**
+ * @brief Add a task to the thread pool (normal priority).
  * @param func The pointer of task function like `void func(void *args)`.
  * @param args The arguments of task function.
  * @param block `1` for blocking and waiting when the queue is full, `0` for returning an error immediately.
@@ -52,6 +310,226 @@ ThreadPool *threadpool_create(int n_workers, int queue_capacity);
 int threadpool_add(ThreadPool *pool, void (*func)(void *args), void *args, int block, void (*cleanup)(void *args));
 
 
+/**
+ * @brief Add a task to a priority lane of the thread pool.
+ * A queued high-priority task is also taken before the tasks a worker has buffered or pushed to its deque (see `threadpool_config_aging` for the limits).
+ * @param pool The pointer of thread pool.
+ * @param func The pointer of task function like `void func(void *args)`.
+ * @param args The arguments of task function.
+ * @param block `1` for blocking and waiting when the lane is full, `0` for returning an error immediately.
+ * @param cleanup The cleanup function like `void cleanup(void *args)`, `NULL` for no cleaning.
+ * @param lane `THREADPOOL_LANE_HIGH`, `THREADPOOL_LANE_NORMAL` or `THREADPOOL_LANE_LOW`.
+ * @return `0` for success, `1` for failure, `2` for full lane.
+**/
+int threadpool_add_priority(ThreadPool *pool, void (*func)(void *args), void *args, int block, void (*cleanup)(void *args), int lane);
+
+
+/**
+ * @brief Add several tasks to the thread pool at once (one reservation in the queue, one round of wakeups).
+ * @param pool The pointer of thread pool.
+ * @param tasks The array of tasks (`func` must not be `NULL`, `cleanup` may be).
+ * @param n The number of tasks.
+ * @param block `1` for blocking until every task is queued, `0` for queuing nothing and returning an error when they do not all fit.
+ * @return `0` for success, `1` for failure (on a shutdown the tasks not queued get their `cleanup` called), `2` for full queue.
+**/
+int threadpool_add_batch(ThreadPool *pool, ThreadTask *tasks, int n, int block);
+
+
+/**
+ * @brief Run `body` over `[begin, end)` split into chunks, the caller takes part and returns when every chunk is done.
+ * Nothing is allocated, the helper tasks point at a descriptor on the stack of the caller. A caller waiting for the helpers runs queued tasks meanwhile,
+ * so a loop nested in a task of the same pool does not deadlock.
+ * @param pool The pointer of thread pool.
+ * @param begin The first iteration.
+ * @param end The iteration past the last one.
+ * @param grain The smallest chunk (`1` at least).
+ * @param body The chunk function like `void body(long long begin, long long end, void *ctx)`.
+ * @param ctx The context passed to `body`.
+ * @return `0` for success, `1` for failure.
+**/
+int threadpool_parallel_for(ThreadPool *pool, long long begin, long long end, long long grain, void (*body)(long long begin, long long end, void *ctx), void *ctx);
+
+
+/**
+ * @brief Reduce `[begin, end)` in parallel, every participant folds its chunks into its own partial result, then the caller combines them in order.
+ * @param pool The pointer of thread pool.
+ * @param begin The first iteration.
+ * @param end The iteration past the last one.
+ * @param grain The smallest chunk (`1` at least).
+ * @param body The chunk function like `void body(long long begin, long long end, void *ctx, void *partial)`.
+ * @param combine The function folding a partial result into the result like `void combine(void *result, const void *partial, void *ctx)`.
+ * @param ctx The context passed to `body` and `combine`.
+ * @param result The result (holding its initial value on entry).
+ * @param identity The initial value of every partial result.
+ * @param size The size of a result in bytes.
+ * @return `0` for success, `1` for failure.
+**/
+int threadpool_parallel_reduce(ThreadPool *pool, long long begin, long long end, long long grain, void (*body)(long long begin, long long end, void *ctx, void *partial), void (*combine)(void *result, const void *partial, void *ctx), void *ctx, void *result, const void *identity, unsigned long long size);
+
+
+/**
+ * @brief Submit a task returning a value, the handle lets the caller wait for this task alone.
+ * @param pool The pointer of thread pool.
+ * @param func The pointer of task function like `void *func(void *args)`.
+ * @param args The arguments of task function.
+ * @return The future of task, `NULL` for failure. Release it with `future_release`.
+**/
+TaskFuture *threadpool_submit(ThreadPool *pool, void *(*func)(void *args), void *args);
+
+
+/**
+ * @brief Wait for a future, running queued tasks of the pool meanwhile (a waiting worker never idles while there is work).
+ * @param future The pointer of future.
+ * @return `0` for a finished task, `1` for a cancelled one.
+**/
+int future_wait(TaskFuture *future);
+
+
+/**
+ * @brief Wait for a future and get the return value of its task.
+ * @param future The pointer of future.
+ * @return The return value (`NULL` for a cancelled task).
+**/
+void *future_get(TaskFuture *future);
+
+
+/**
+ * @brief Chain a task after a future, it runs on the pool once the future is done and receives its return value.
+ * @param future The pointer of future.
+ * @param func The pointer of task function like `void *func(void *result)`.
+ * @return The future of the chained task, `NULL` for failure. Release it with `future_release`.
+**/
+TaskFuture *future_then(TaskFuture *future, void *(*func)(void *result));
+
+
+/**
+ * @brief Give a future back (its storage is reused once the task is finished too).
+ * @param future The pointer of future.
+**/
+void future_release(TaskFuture *future);
+
+
+/**
+ * @brief Set the schedule of `threadpool_parallel_for` and `threadpool_parallel_reduce` (static by default).
+ * @param pool The pointer of thread pool.
+ * @param schedule `THREADPOOL_SCHEDULE_STATIC`, `THREADPOOL_SCHEDULE_DYNAMIC` or `THREADPOOL_SCHEDULE_GUIDED`.
+ * @return `0` for success, `1` for failure.
+**/
+int threadpool_config_schedule(ThreadPool *pool, ThreadPoolSchedule schedule);
+
+
+/**
+ * @brief Switch the work-stealing mode (only while the pool has no pending task).
+ * Every worker owns a deque, tasks added from inside a worker go to its own deque and idle workers steal from random victims.
+ * Tasks added from other threads go through the shared queue (the injector).
+ * @param pool The pointer of thread pool.
+ * @param enable `1` for enabling, `0` for disabling.
+ * @return `0` for success, `1` for failure.
+**/
+int threadpool_config_stealing(ThreadPool *pool, int enable);
+
+
+/**
+ * @brief Set how long the oldest task of a lane may wait before it jumps the tasks of higher lanes.
+ * An overdue lane gets one task through per aging period (`THREADPOOL_AGING_NORMAL` and `THREADPOOL_AGING_LOW` by default),
+ * which bounds both the starvation of a lower lane and the delay it adds to a higher one.
+ * @param pool The pointer of thread pool.
+ * @param lane The priority lane.
+ * @param seconds The aging in seconds.
+ * @return `0` for success, `1` for failure.
+**/
+int threadpool_config_aging(ThreadPool *pool, int lane, double seconds);
+
+
+/**
+ * @brief Set how long an idle worker keeps polling before it parks, a task queued meanwhile starts without a wake-up.
+ * @param pool The pointer of thread pool.
+ * @param spin The seconds of polling with `atomic_pause` (burns the CPU, lowest latency).
+ * @param yield The seconds of polling with `thread_yield` afterwards (leaves the CPU to ready threads).
+ * @return `0` for success, `1` for failure.
+**/
+int threadpool_config_wait(ThreadPool *pool, double spin, double yield);
+
+
+/**
+ * @brief Set when an elastic pool grows and shrinks.
+ * @param pool The pointer of thread pool.
+ * @param idle_timeout The seconds a worker above the minimum stays parked before it exits.
+ * @param spawn_wait The seconds the queues stay backed up (more tasks queued than threads running) before another worker is started.
+ * @return `0` for success, `1` for failure.
+**/
+int threadpool_config_elastic(ThreadPool *pool, double idle_timeout, double spawn_wait);
+
+
+/**
+ * @brief Pin the workers to CPUs, worker `i` goes to `cpus[i % n_cpus]` (workers started later are pinned too).
+ * @param pool The pointer of thread pool.
+ * @param cpus The indexes of CPU.
+ * @param n_cpus The number of CPUs.
+ * @return `0` for success, `1` for failure (or a platform without pinning, see `thread_affinity`).
+**/
+int threadpool_config_affinity(ThreadPool *pool, const int *cpus, int n_cpus);
+
+
+/**
+ * @brief Get the NUMA node of the calling thread, a task can allocate its memory there.
+ * @param pool The pointer of thread pool.
+ * @return The node of the CPU a pinned worker is bound to, otherwise the node of the CPU the thread runs on now (`-1` for unknown).
+**/
+int threadpool_numa_node(ThreadPool *pool);
+
+
+/**
+ * @brief Get the number of threads running now.
+ * @param pool The pointer of thread pool.
+ * @return The number of threads.
+**/
+int threadpool_workers(ThreadPool *pool);
+
+
+/**
+ * @brief Read the queue depth and the wait-time counters of a priority lane.
+ * @param pool The pointer of thread pool.
+ * @param lane The priority lane.
+ * @param stats The counters read (approximate while the pool is running).
+ * @return `0` for success, `1` for failure.
+**/
+int threadpool_lane_stats(ThreadPool *pool, int lane, ThreadPoolLaneStats *stats);
+
+
+/**
+ * @brief Print the queue depth and the wait times of every priority lane.
+ * @param pool The pointer of thread pool.
+**/
+void threadpool_lane_view(ThreadPool *pool);
+
+
+/**
+ * @brief Read the counters and histograms of every worker summed up (needs `THREADPOOL_STATS`).
+ * @param pool The pointer of thread pool.
+ * @param stats The counters read (approximate while the pool is running).
+ * @return `0` for success, `1` for failure (or a build without `THREADPOOL_STATS`, `stats` is zeroed).
+**/
+int threadpool_stats(ThreadPool *pool, ThreadPoolStats *stats);
+
+
+/**
+ * @brief Read the counters of one worker (needs `THREADPOOL_STATS`).
+ * @param pool The pointer of thread pool.
+ * @param index The index of worker.
+ * @param stats The counters read.
+ * @return `0` for success, `1` for failure (or a build without `THREADPOOL_STATS`, `stats` is zeroed).
+**/
+int threadpool_worker_stats(ThreadPool *pool, int index, ThreadPoolWorkerStats *stats);
+
+
+/**
+ * @brief Print the counters of every worker, the latency and run time percentiles, the histograms and the priority lanes.
+ * @param pool The pointer of thread pool.
+**/
+void threadpool_stats_view(ThreadPool *pool);
+
+
 /**
  * @brief Wait thread task in pool with blocking.
  * @param pool The pointer of thread pool.
@@ -71,10 +549,392 @@ int threadpool_destroy(ThreadPool *pool, int safe_exit);
 
 /**
  * @brief The worker function of thread pool.
- * @param args The arguments of task function.
+ * @param args The pointer of worker.
  * @return `0` for success.
 **/
 int __threadpool_worker__(void *args);
 
 
+/**
+ * @brief Get the next task of a worker (an urgent high-priority task, own buffer and deque, the lanes, then stealing), parking when there is none.
+ * @param worker The pointer of worker.
+ * @param task The task taken.
+ * @return `0` for a task, `1` for shutdown.
+**/
+int __threadpool_next__(_ThreadWorker *worker, ThreadTask *task);
+
+
+/**
+ * @brief Get the worker of the calling thread.
+ * @param pool The pointer of thread pool.
+ * @return The pointer of worker, `NULL` when the caller is not a worker of this pool.
+**/
+_ThreadWorker *__threadpool_self__(ThreadPool *pool);
+
+
+/**
+ * @brief Park the calling thread unless the awaited change has been published meanwhile (the caller holds `queue_lock`).
+ * @param pool The pointer of thread pool.
+ * @param waiters The condition to park on.
+ * @param ready The function telling whether the awaited change is visible.
+ * @param arg The argument of `ready`.
+**/
+void __threadpool_park__(ThreadPool *pool, _ThreadWaiters *waiters, int (*ready)(ThreadPool *pool, void *arg), void *arg);
+
+
+/**
+ * @brief Park an idle worker on its event until a task is queued, a parked worker above `min_workers` retires after `idle_timeout`.
+ * @param worker The pointer of worker.
+ * @return `1` for the worker to exit (shutdown or retired), `0` to look for tasks again.
+**/
+int __threadpool_sleep__(_ThreadWorker *worker);
+
+
+/**
+ * @brief Wake up parked workers, the last ones parked first.
+ * @param pool The pointer of thread pool.
+ * @param n The most workers to wake up.
+**/
+void __threadpool_notify__(ThreadPool *pool, int n);
+
+
+/**
+ * @brief Take a worker off the idle list (the caller holds `queue_lock`).
+ * @param worker The pointer of worker.
+**/
+void __threadpool_unpark__(_ThreadWorker *worker);
+
+
+/**
+ * @brief Start a worker in the first slot not running (the caller holds `queue_lock`).
+ * @param pool The pointer of thread pool.
+ * @return `0` for success, `1` for failure or no free slot.
+**/
+int __threadpool_spawn__(ThreadPool *pool);
+
+
+/**
+ * @brief Start another worker once the queues have stayed backed up for `spawn_wait` (called after a task is queued).
+ * @param pool The pointer of thread pool.
+**/
+void __threadpool_grow__(ThreadPool *pool);
+
+
+/**
+ * @brief Wake up parked threads not signaled yet if any (called after publishing a change without the lock).
+ * @param pool The pointer of thread pool.
+ * @param waiters The condition they are parked on.
+ * @param n The most threads to wake up (the number of tasks or slots published).
+**/
+void __threadpool_wake__(ThreadPool *pool, _ThreadWaiters *waiters, int n);
+
+
+/**
+ * @brief Determine whether an idle worker should stay awake (a task in a lane, a task in a deque or the shutdown).
+ * @param pool The pointer of thread pool.
+ * @param arg Unused.
+ * @return `1` for yes, `0` for no.
+**/
+int __threadpool_worker_ready__(ThreadPool *pool, void *arg);
+
+
+/**
+ * @brief Determine whether a blocked producer should retry (a free slot in its lane or the shutdown).
+ * @param pool The pointer of thread pool.
+ * @param arg The pointer of lane.
+ * @return `1` for yes, `0` for no.
+**/
+int __threadpool_producer_ready__(ThreadPool *pool, void *arg);
+
+
+/**
+ * @brief Determine whether a future is no longer pending.
+ * @param pool The pointer of thread pool.
+ * @param arg The pointer of future.
+ * @return `1` for yes, `0` for no.
+**/
+int __threadpool_future_ready__(ThreadPool *pool, void *arg);
+
+
+/**
+ * @brief Take a future from the free list of the calling worker, or from the shared one (allocating a slab when both are empty).
+ * @param pool The pointer of thread pool.
+ * @return The pointer of future, `NULL` for failure.
+**/
+TaskFuture *__threadpool_future_allocate__(ThreadPool *pool);
+
+
+/**
+ * @brief Give a future back to the free list of the calling worker, or to the shared one when that is full.
+ * @param pool The pointer of thread pool.
+ * @param future The pointer of future.
+**/
+void __threadpool_future_free__(ThreadPool *pool, TaskFuture *future);
+
+
+/**
+ * @brief The task function of a future, it stores the return value.
+ * @param args The pointer of future.
+**/
+void __threadpool_future_run__(void *args);
+
+
+/**
+ * @brief The cleanup of a future task: settle the future (cancelled when it never ran), schedule its continuations and wake up the waiters.
+ * @param args The pointer of future.
+**/
+void __threadpool_future_finish__(void *args);
+
+
+/**
+ * @brief Queue a continuation of a settled future (or cancel it along with a cancelled antecedent).
+ * @param antecedent The settled future.
+ * @param future The continuation.
+**/
+void __threadpool_future_schedule__(TaskFuture *antecedent, TaskFuture *future);
+
+
+
+/**
+ * @brief Finish one pending task and wake up `threadpool_wait` when it was the last one.
+ * @param pool The pointer of thread pool.
+**/
+void __threadpool_done__(ThreadPool *pool);
+
+
+/**
+ * @brief Determine whether any deque holds a task.
+ * @param pool The pointer of thread pool.
+ * @return `1` for yes, `0` for no.
+**/
+int __threadpool_has_work__(ThreadPool *pool);
+
+
+/**
+ * @brief Append a task to a lane without locking.
+ * @param pool The pointer of thread pool.
+ * @param index The index of lane.
+ * @param task The task.
+ * @return `0` for success, `1` for full lane.
+**/
+int __threadpool_lane_push__(ThreadPool *pool, int index, ThreadTask *task);
+
+
+/**
+ * @brief Run one queued task on the calling thread (own buffer and deque first when the caller is a worker).
+ * @param pool The pointer of thread pool.
+ * @return `0` for a task run, `1` for nothing to run.
+**/
+int __threadpool_help__(ThreadPool *pool);
+
+
+/**
+ * @brief Add a task from inside the pool (a task or a waiting thread), running queued tasks instead of parking while the queue is full.
+ * @param pool The pointer of thread pool.
+ * @param func The pointer of task function.
+ * @param args The arguments of task function.
+ * @param cleanup The cleanup function of task, `NULL` for none.
+ * @return `0` for success, `1` for shutdown.
+**/
+int __threadpool_add_helping__(ThreadPool *pool, void (*func)(void *args), void *args, void (*cleanup)(void *args));
+
+
+/**
+ * @brief Run a loop over `[begin, end)` on the pool and the caller (shared by `threadpool_parallel_for` and `threadpool_parallel_reduce`).
+ * @param pool The pointer of thread pool.
+ * @param loop The descriptor with the range and the body filled in.
+ * @return `0` for success, `1` for failure.
+**/
+int __threadpool_loop__(ThreadPool *pool, _ThreadLoop *loop);
+
+
+/**
+ * @brief The task of a loop participant, it claims chunks until the range is exhausted.
+ * @param args The pointer of loop.
+**/
+void __threadpool_loop_participant__(void *args);
+
+
+/**
+ * @brief Count a participant out of the loop (after it ran, or when its task is discarded).
+ * @param args The pointer of loop.
+**/
+void __threadpool_loop_leave__(void *args);
+
+
+/**
+ * @brief Claim the next chunk of a participant.
+ * @param loop The pointer of loop.
+ * @param id The participant index.
+ * @param k The number of chunks the participant claimed so far (static schedule).
+ * @param begin The first iteration of chunk.
+ * @param end The iteration past the last one of chunk.
+ * @return `0` for a chunk, `1` for an exhausted range.
+**/
+int __threadpool_loop_chunk__(_ThreadLoop *loop, int id, long long k, long long *begin, long long *end);
+
+
+/**
+ * @brief Append consecutive tasks to a lane with a single reservation.
+ * @param pool The pointer of thread pool.
+ * @param index The index of lane.
+ * @param tasks The array of tasks.
+ * @param n The number of tasks.
+ * @param whole `1` for queuing all or none, `0` for queuing as many as fit.
+ * @return The number of tasks queued.
+**/
+int __threadpool_lane_push_many__(ThreadPool *pool, int index, ThreadTask *tasks, int n, int whole);
+
+
+/**
+ * @brief Take up to `n` consecutive tasks from a lane with a single reservation (and wake up its blocked producers).
+ * @param pool The pointer of thread pool.
+ * @param worker The worker taking the tasks, `NULL` for another thread.
+ * @param index The index of lane.
+ * @param tasks The tasks taken.
+ * @param n The most tasks to take.
+ * @param enqueued The enqueue times of the tasks taken (may be `NULL`).
+ * @return The number of tasks taken.
+**/
+int __threadpool_lane_pop_many__(ThreadPool *pool, _ThreadWorker *worker, int index, ThreadTask *tasks, int n, long long *enqueued);
+
+
+/**
+ * @brief Pick the lane to serve: an overdue lower lane whose aging turn has come, otherwise the highest lane holding a task.
+ * @param pool The pointer of thread pool.
+ * @param aged `1` when the lane got an aging turn (one task only), `0` otherwise.
+ * @return The index of lane, `-1` when every lane looks empty.
+**/
+int __threadpool_lane_select__(ThreadPool *pool, int *aged);
+
+
+/**
+ * @brief Count the wait of a task taken from a lane.
+ * @param pool The pointer of thread pool.
+ * @param worker The worker taking the task (its own counters), `NULL` for another thread (the shared counters of lane).
+ * @param index The index of lane.
+ * @param wait The wait in nanoseconds.
+**/
+void __threadpool_lane_record__(ThreadPool *pool, _ThreadWorker *worker, int index, long long wait);
+
+
+/**
+ * @brief Fill the buffer of a worker from the lanes (see `__threadpool_lane_select__`).
+ * @param worker The pointer of worker.
+ * @param task The first task taken.
+ * @return `0` for a task, `1` for empty lanes.
+**/
+int __threadpool_take__(_ThreadWorker *worker, ThreadTask *task);
+
+
+/**
+ * @brief Take a single task from the lanes (see `__threadpool_lane_select__`).
+ * @param pool The pointer of thread pool.
+ * @param worker The worker taking the task, `NULL` for another thread.
+ * @param task The task taken.
+ * @return `0` for a task, `1` for empty lanes.
+**/
+int __threadpool_pop__(ThreadPool *pool, _ThreadWorker *worker, ThreadTask *task);
+
+
+/**
+ * @brief Determine whether a worker should run the head task of the high lane before its own buffer and deque.
+ * @param worker The pointer of worker.
+ * @return `1` for yes, `0` for no.
+**/
+int __threadpool_urgent__(_ThreadWorker *worker);
+
+
+/**
+ * @brief Count the tasks queued in every lane.
+ * @param pool The pointer of thread pool.
+ * @return The number of tasks.
+**/
+long long __threadpool_queued__(ThreadPool *pool);
+
+
+/**
+ * @brief Read the monotonic clock.
+ * @return Nanoseconds.
+**/
+long long __threadpool_clock__();
+
+
+/**
+ * @brief Determine whether a lane task gets an enqueue time.
+ * @param pool The pointer of thread pool.
+ * @param position The position of task in the lane.
+ * @return `1` for every task once aging is on, one in `THREADPOOL_STATS_SAMPLE` with `THREADPOOL_STATS`, `0` otherwise.
+**/
+int __threadpool_stamped__(ThreadPool *pool, long long position);
+
+
+/**
+ * @brief Take `queue_lock`, a worker times the wait when the lock is contended (`THREADPOOL_STATS`).
+ * @param pool The pointer of thread pool.
+**/
+void __threadpool_lock__(ThreadPool *pool);
+
+
+/**
+ * @brief Get the histogram bucket of a value, `4` linear buckets per power of two (relative error under 25%).
+ * @param value The value in nanoseconds.
+ * @return The bucket index.
+**/
+int __threadpool_histogram_index__(long long value);
+
+
+/**
+ * @brief Get the upper bound of a histogram bucket.
+ * @param index The bucket index.
+ * @return The smallest value above the bucket in nanoseconds.
+**/
+long long __threadpool_histogram_bound__(int index);
+
+
+/**
+ * @brief Find a percentile in a histogram.
+ * @param histogram The histogram.
+ * @param q The quantile in `(0, 1]`.
+ * @return The upper bound of the bucket holding it in seconds, `0` for an empty histogram.
+**/
+double __threadpool_histogram_percentile__(const long long *histogram, double q);
+
+
+/**
+ * @brief Push a task at the bottom of a deque (owner only).
+ * @param deque The pointer of deque.
+ * @param task The task.
+ * @return `0` for success, `1` for full deque.
+**/
+int __threadpool_deque_push__(_ThreadDeque *deque, ThreadTask *task);
+
+
+/**
+ * @brief Pop a task from the bottom of a deque (owner only).
+ * @param deque The pointer of deque.
+ * @param task The task taken.
+ * @return `0` for success, `1` for empty deque.
+**/
+int __threadpool_deque_pop__(_ThreadDeque *deque, ThreadTask *task);
+
+
+/**
+ * @brief Steal a task from the top of a deque.
+ * @param deque The pointer of deque.
+ * @param task The task taken.
+ * @return `0` for success, `1` for empty deque, `2` for losing the race to another thread.
+**/
+int __threadpool_deque_steal__(_ThreadDeque *deque, ThreadTask *task);
+
+
+/**
+ * @brief Steal a task from the workers starting at a random victim.
+ * @param worker The pointer of the thief.
+ * @param task The task taken.
+ * @return `0` for success, `1` for nothing to steal.
+**/
+int __threadpool_steal__(_ThreadWorker *worker, ThreadTask *task);
+
+
 #endif
@@ -0,0 +1,404 @@
+#include "typed_set.h"
+
+
+unsigned long long __typed_set_key_size__(_TypedSetKind kind) {
+    if (kind == TYPED_SET_INT) return sizeof(int);
+    if (kind == TYPED_SET_LONG) return sizeof(long long);
+    if (kind == TYPED_SET_DOUBLE) return sizeof(double);
+    return sizeof(char *);
+}
+
+
+unsigned long long __typed_set_hash__(_TypedSetKind kind, const void *key) {
+    if (kind == TYPED_SET_INT) return hash_integer((unsigned long long)*(const int *)key);
+    if (kind == TYPED_SET_LONG) return hash_integer((unsigned long long)*(const long long *)key);
+    if (kind == TYPED_SET_DOUBLE) {
+        double d = *(const double *)key;
+        // NaN.
+        if (d != d) return hash_integer(0x7FF8000000000000ULL);
+        // +0.0 or -0.0.
+        if (d == 0.0) d = 0.0;
+        unsigned long long bits;
+        memcpy(&bits, &d, sizeof(bits));
+        return hash_integer(bits);
+    }
+    return hash_string(*(char *const *)key);
+}
+
+
+int __typed_set_equal__(_TypedSet *set, unsigned long long index, const void *key) {
+    switch (set->kind) {
+        case TYPED_SET_INT:
+            return ((int *)set->keys)[index] == *(const int *)key;
+        case TYPED_SET_LONG:
+            return ((long long *)set->keys)[index] == *(const long long *)key;
+        case TYPED_SET_DOUBLE: {
+            double a = ((double *)set->keys)[index], b = *(const double *)key;
+            // A set holds at most one NaN.
+            return a == b || (a != a && b != b);
+        }
+        default:
+            return strcmp(((char **)set->keys)[index], *(char *const *)key) == 0;
+    }
+}
+
+
+_TypedSet *__typed_set_create__(_TypedSetKind kind) {
+    _TypedSet *set = (_TypedSet *)calloc(1, sizeof(_TypedSet));
+    if (!set) return NULL;
+    set->kind = kind;
+    if (__typed_set_rehash__(set, TYPED_SET_MIN_CAPACITY) != 0) {
+        free(set);
+        return NULL;
+    }
+    return set;
+}
+
+
+unsigned long long __typed_set_find_free__(_TypedSet *set, unsigned long long hash) {
+    unsigned long long n_groups = set->capacity / HASH_GROUP_WIDTH;
+    unsigned long long group = (hash >> 7) & (n_groups - 1);
+    // Triangular probing over whole groups visits every group once when `n_groups` is a power of two.
+    for (unsigned long long step = 1; ; step++) {
+        unsigned int mask = hash_group_free(set->ctrl + group * HASH_GROUP_WIDTH);
+        if (mask) return group * HASH_GROUP_WIDTH + hash_ctz(mask);
+        group = (group + step) & (n_groups - 1);
+    }
+}
+
+
+int __typed_set_rehash__(_TypedSet *set, unsigned long long capacity) {
+    unsigned long long size = __typed_set_key_size__(set->kind);
+    signed char *ctrl = (signed char *)malloc(capacity);
+    char *keys = (char *)malloc(capacity * size);
+    if (!ctrl || !keys) {
+        free(ctrl);
+        free(keys);
+        return 1;
+    }
+    memset(ctrl, TYPED_SET_CTRL_EMPTY, capacity);
+
+    signed char *old_ctrl = set->ctrl;
+    char *old_keys = (char *)set->keys;
+    unsigned long long old_capacity = set->capacity;
+
+    set->ctrl = ctrl;
+    set->keys = keys;
+    set->capacity = capacity;
+    set->deleted = 0;
+
+    for (unsigned long long i = 0; i < old_capacity; i++) {
+        if (old_ctrl[i] < 0) continue;
+        // Hashes are not stored (they would double the footprint of an `IntSet`), hashing a number is cheap.
+        unsigned long long index = __typed_set_find_free__(set, __typed_set_hash__(set->kind, old_keys + i * size));
+        set->ctrl[index] = old_ctrl[i];
+        memcpy(keys + index * size, old_keys + i * size, size);
+    }
+    free(old_ctrl);
+    free(old_keys);
+    return 0;
+}
+
+
+long long __typed_set_find__(_TypedSet *set, const void *key, unsigned long long hash) {
+    unsigned long long n_groups = set->capacity / HASH_GROUP_WIDTH;
+    unsigned long long group = (hash >> 7) & (n_groups - 1);
+    signed char tag = (signed char)(hash & 0x7F);
+
+    for (unsigned long long step = 1; step <= n_groups; step++) {
+        signed char *ctrl = set->ctrl + group * HASH_GROUP_WIDTH;
+        // The keys are only touched for the slots whose 7-bit tag matches.
+        unsigned int mask = hash_group_match(ctrl, tag);
+        while (mask) {
+            unsigned long long index = group * HASH_GROUP_WIDTH + hash_ctz(mask);
+            if (__typed_set_equal__(set, index, key)) return (long long)index;
+            mask = mask & (mask - 1);
+        }
+        // A group with an empty slot terminates every probe sequence passing through it.
+        if (hash_group_match(ctrl, TYPED_SET_CTRL_EMPTY)) return -1;
+        group = (group + step) & (n_groups - 1);
+    }
+    return -1;
+}
+
+
+void __typed_set_add__(_TypedSet *set, const void *key, unsigned long long hash) {
+    if (__typed_set_find__(set, key, hash) >= 0) return;
+
+    // Keep the load factor (tombstones included) below 7/8 so that every probe meets an empty group.
+    if ((set->count + set->deleted + 1) * 8 > set->capacity * 7) {
+        unsigned long long capacity = set->capacity;
+        if ((set->count + 1) * 16 > set->capacity * 7) capacity = capacity * 2;
+        if (__typed_set_rehash__(set, capacity) != 0) {
+            printf("\x1b[31m[Error] memory re-allocation failed and the program exited...\x1b[0m\n");
+            __typed_set_destroy__(set);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    unsigned long long size = __typed_set_key_size__(set->kind);
+    unsigned long long index = __typed_set_find_free__(set, hash);
+    if (set->ctrl[index] == TYPED_SET_CTRL_DELETED) set->deleted--;
+    set->ctrl[index] = (signed char)(hash & 0x7F);
+    if (set->kind == TYPED_SET_STRING) ((char **)set->keys)[index] = strdup(*(char *const *)key);
+    else memcpy((char *)set->keys + index * size, key, size);
+    set->count++;
+}
+
+
+void __typed_set_remove__(_TypedSet *set, const void *key, unsigned long long hash) {
+    long long index = __typed_set_find__(set, key, hash);
+    if (index < 0) return;
+
+    if (set->kind == TYPED_SET_STRING) free(((char **)set->keys)[index]);
+    signed char *group = set->ctrl + (index & ~(long long)(HASH_GROUP_WIDTH - 1));
+    // No probe sequence continues past a group that still has an empty slot, so no tombstone is needed.
+    if (hash_group_match(group, TYPED_SET_CTRL_EMPTY)) set->ctrl[index] = TYPED_SET_CTRL_EMPTY;
+    else {
+        set->ctrl[index] = TYPED_SET_CTRL_DELETED;
+        set->deleted++;
+    }
+    set->count--;
+
+    if (set->capacity > TYPED_SET_MIN_CAPACITY && set->count * 4 <= set->capacity) __typed_set_rehash__(set, set->capacity / 2);
+}
+
+
+int __typed_set_contains__(_TypedSet *set, const void *key, unsigned long long hash) {
+    return __typed_set_find__(set, key, hash) >= 0;
+}
+
+
+void __typed_set_add_many__(_TypedSet *set, const void *keys, int n) {
+    unsigned long long hashes[TYPED_SET_BATCH];
+    unsigned long long size = __typed_set_key_size__(set->kind);
+    for (int base = 0; base < n; base = base + TYPED_SET_BATCH) {
+        int m = n - base < TYPED_SET_BATCH ? n - base : TYPED_SET_BATCH;
+        const char *batch = (const char *)keys + base * size;
+        for (int i = 0; i < m; i++) {
+            hashes[i] = __typed_set_hash__(set->kind, batch + i * size);
+            hash_prefetch(set->ctrl + ((hashes[i] >> 7) & (set->capacity / HASH_GROUP_WIDTH - 1)) * HASH_GROUP_WIDTH);
+        }
+        for (int i = 0; i < m; i++) __typed_set_add__(set, batch + i * size, hashes[i]);
+    }
+}
+
+
+int __typed_set_contains_many__(_TypedSet *set, const void *keys, int n, int *results) {
+    unsigned long long hashes[TYPED_SET_BATCH];
+    unsigned long long size = __typed_set_key_size__(set->kind);
+    int found = 0;
+    for (int base = 0; base < n; base = base + TYPED_SET_BATCH) {
+        int m = n - base < TYPED_SET_BATCH ? n - base : TYPED_SET_BATCH;
+        const char *batch = (const char *)keys + base * size;
+        for (int i = 0; i < m; i++) {
+            hashes[i] = __typed_set_hash__(set->kind, batch + i * size);
+            hash_prefetch(set->ctrl + ((hashes[i] >> 7) & (set->capacity / HASH_GROUP_WIDTH - 1)) * HASH_GROUP_WIDTH);
+        }
+        for (int i = 0; i < m; i++) {
+            int exist = __typed_set_find__(set, batch + i * size, hashes[i]) >= 0;
+            if (results) results[base + i] = exist;
+            found = found + exist;
+        }
+    }
+    return found;
+}
+
+
+void __typed_set_destroy__(_TypedSet *set) {
+    if (set->kind == TYPED_SET_STRING) {
+        for (unsigned long long i = 0; i < set->capacity; i++) if (set->ctrl[i] >= 0) free(((char **)set->keys)[i]);
+    }
+    free(set->ctrl);
+    free(set->keys);
+    free(set);
+}
+
+
+void __typed_set_view__(_TypedSet *set) {
+    if (set->count == 0) printf("{}_0\n");
+    else {
+        printf("{");
+        int first = 1;
+        for (unsigned long long i = 0; i < set->capacity; i++) {
+            if (set->ctrl[i] < 0) continue;
+            if (!first) printf(", ");
+            first = 0;
+            switch (set->kind) {
+                case TYPED_SET_INT:
+                    printf("%d", ((int *)set->keys)[i]);
+                    break;
+                case TYPED_SET_LONG:
+                    printf("%lld", ((long long *)set->keys)[i]);
+                    break;
+                case TYPED_SET_DOUBLE:
+                    printf("%lf", ((double *)set->keys)[i]);
+                    break;
+                case TYPED_SET_STRING:
+                    printf("\"%s\"", ((char **)set->keys)[i]);
+                    break;
+            }
+        }
+        printf("}_%llu\n", set->count);
+    }
+}
+
+
+IntSet *intset_create() {
+    return (IntSet *)__typed_set_create__(TYPED_SET_INT);
+}
+
+
+LongSet *longset_create() {
+    return (LongSet *)__typed_set_create__(TYPED_SET_LONG);
+}
+
+
+DoubleSet *doubleset_create() {
+    return (DoubleSet *)__typed_set_create__(TYPED_SET_DOUBLE);
+}
+
+
+StrSet *strset_create() {
+    return (StrSet *)__typed_set_create__(TYPED_SET_STRING);
+}
+
+
+void intset_add(IntSet *set, int value) {
+    __typed_set_add__(&set->base, &value, __typed_set_hash__(TYPED_SET_INT, &value));
+}
+
+
+void longset_add(LongSet *set, long long value) {
+    __typed_set_add__(&set->base, &value, __typed_set_hash__(TYPED_SET_LONG, &value));
+}
+
+
+void doubleset_add(DoubleSet *set, double value) {
+    __typed_set_add__(&set->base, &value, __typed_set_hash__(TYPED_SET_DOUBLE, &value));
+}
+
+
+void strset_add(StrSet *set, char *value) {
+    __typed_set_add__(&set->base, &value, __typed_set_hash__(TYPED_SET_STRING, &value));
+}
+
+
+void intset_remove(IntSet *set, int value) {
+    __typed_set_remove__(&set->base, &value, __typed_set_hash__(TYPED_SET_INT, &value));
+}
+
+
+void longset_remove(LongSet *set, long long value) {
+    __typed_set_remove__(&set->base, &value, __typed_set_hash__(TYPED_SET_LONG, &value));
+}
+
+
+void doubleset_remove(DoubleSet *set, double value) {
+    __typed_set_remove__(&set->base, &value, __typed_set_hash__(TYPED_SET_DOUBLE, &value));
+}
+
+
+void strset_remove(StrSet *set, char *value) {
+    __typed_set_remove__(&set->base, &value, __typed_set_hash__(TYPED_SET_STRING, &value));
+}
+
+
+int intset_contains(IntSet *set, int value) {
+    return __typed_set_contains__(&set->base, &value, __typed_set_hash__(TYPED_SET_INT, &value));
+}
+
+
+int longset_contains(LongSet *set, long long value) {
+    return __typed_set_contains__(&set->base, &value, __typed_set_hash__(TYPED_SET_LONG, &value));
+}
+
+
+int doubleset_contains(DoubleSet *set, double value) {
+    return __typed_set_contains__(&set->base, &value, __typed_set_hash__(TYPED_SET_DOUBLE, &value));
+}
+
+
+int strset_contains(StrSet *set, char *value) {
+    return __typed_set_contains__(&set->base, &value, __typed_set_hash__(TYPED_SET_STRING, &value));
+}
+
+
+void intset_add_many(IntSet *set, int *values, int n) {
+    __typed_set_add_many__(&set->base, values, n);
+}
+
+
+void longset_add_many(LongSet *set, long long *values, int n) {
+    __typed_set_add_many__(&set->base, values, n);
+}
+
+
+void doubleset_add_many(DoubleSet *set, double *values, int n) {
+    __typed_set_add_many__(&set->base, values, n);
+}
+
+
+void strset_add_many(StrSet *set, char **values, int n) {
+    __typed_set_add_many__(&set->base, values, n);
+}
+
+
+int intset_contains_many(IntSet *set, int *values, int n, int *results) {
+    return __typed_set_contains_many__(&set->base, values, n, results);
+}
+
+
+int longset_contains_many(LongSet *set, long long *values, int n, int *results) {
+    return __typed_set_contains_many__(&set->base, values, n, results);
+}
+
+
+int doubleset_contains_many(DoubleSet *set, double *values, int n, int *results) {
+    return __typed_set_contains_many__(&set->base, values, n, results);
+}
+
+
+int strset_contains_many(StrSet *set, char **values, int n, int *results) {
+    return __typed_set_contains_many__(&set->base, values, n, results);
+}
+
+
+void intset_destroy(IntSet *set) {
+    __typed_set_destroy__(&set->base);
+}
+
+
+void longset_destroy(LongSet *set) {
+    __typed_set_destroy__(&set->base);
+}
+
+
+void doubleset_destroy(DoubleSet *set) {
+    __typed_set_destroy__(&set->base);
+}
+
+
+void strset_destroy(StrSet *set) {
+    __typed_set_destroy__(&set->base);
+}
+
+
+void intset_view(IntSet *set) {
+    __typed_set_view__(&set->base);
+}
+
+
+void longset_view(LongSet *set) {
+    __typed_set_view__(&set->base);
+}
+
+
+void doubleset_view(DoubleSet *set) {
+    __typed_set_view__(&set->base);
+}
+
+
+void strset_view(StrSet *set) {
+    __typed_set_view__(&set->base);
+}
@@ -0,0 +1,297 @@
+#ifndef _TYPED_SET_H_
+#define _TYPED_SET_H_
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+#include "hash.h"
+
+
+#define TYPED_SET_MIN_CAPACITY 16
+#define TYPED_SET_CTRL_EMPTY ((signed char)-128)   // 0b10000000
+#define TYPED_SET_CTRL_DELETED ((signed char)-2)   // 0b11111110
+#define TYPED_SET_BATCH 16      // Elements hashed and prefetched together by the `_many` functions.
+
+
+typedef enum {
+    TYPED_SET_INT,
+    TYPED_SET_LONG,
+    TYPED_SET_DOUBLE,
+    TYPED_SET_STRING
+} _TypedSetKind;
+
+
+typedef struct {
+    signed char *ctrl;      // One metadata byte per slot: the low 7 bits of the hash, or `EMPTY` / `DELETED`.
+    void *keys;             // Packed keys only (`int`, `long long`, `double` or `char *`), no tag and no padding.
+    unsigned long long capacity;
+    unsigned long long count;
+    unsigned long long deleted;
+    _TypedSetKind kind;
+} _TypedSet;
+
+
+/**
+ * Distinct wrapper types, so `_Generic` in `set.h` can route `set_add` and friends by the type of the set.
+**/
+typedef struct {
+    _TypedSet base;
+} IntSet;
+
+
+typedef struct {
+    _TypedSet base;
+} LongSet;
+
+
+typedef struct {
+    _TypedSet base;
+} DoubleSet;
+
+
+typedef struct {
+    _TypedSet base;
+} StrSet;
+
+
+/**
+ * @brief Create a set holding `int` elements only.
+ * @return The pointer of set (`NULL` for failure).
+**/
+IntSet *intset_create();
+
+
+/**
+ * @brief Create a set holding `long long` elements only.
+ * @return The pointer of set (`NULL` for failure).
+**/
+LongSet *longset_create();
+
+
+/**
+ * @brief Create a set holding `double` elements only.
+ * @return The pointer of set (`NULL` for failure).
+**/
+DoubleSet *doubleset_create();
+
+
+/**
+ * @brief Create a set holding strings only (every string is copied).
+ * @return The pointer of set (`NULL` for failure).
+**/
+StrSet *strset_create();
+
+
+void intset_add(IntSet *set, int value);
+
+
+void longset_add(LongSet *set, long long value);
+
+
+void doubleset_add(DoubleSet *set, double value);
+
+
+void strset_add(StrSet *set, char *value);
+
+
+void intset_remove(IntSet *set, int value);
+
+
+void longset_remove(LongSet *set, long long value);
+
+
+void doubleset_remove(DoubleSet *set, double value);
+
+
+void strset_remove(StrSet *set, char *value);
+
+
+int intset_contains(IntSet *set, int value);
+
+
+int longset_contains(LongSet *set, long long value);
+
+
+int doubleset_contains(DoubleSet *set, double value);
+
+
+int strset_contains(StrSet *set, char *value);
+
+
+void intset_add_many(IntSet *set, int *values, int n);
+
+
+void longset_add_many(LongSet *set, long long *values, int n);
+
+
+void doubleset_add_many(DoubleSet *set, double *values, int n);
+
+
+void strset_add_many(StrSet *set, char **values, int n);
+
+
+int intset_contains_many(IntSet *set, int *values, int n, int *results);
+
+
+int longset_contains_many(LongSet *set, long long *values, int n, int *results);
+
+
+int doubleset_contains_many(DoubleSet *set, double *values, int n, int *results);
+
+
+int strset_contains_many(StrSet *set, char **values, int n, int *results);
+
+
+void intset_destroy(IntSet *set);
+
+
+void longset_destroy(LongSet *set);
+
+
+void doubleset_destroy(DoubleSet *set);
+
+
+void strset_destroy(StrSet *set);
+
+
+void intset_view(IntSet *set);
+
+
+void longset_view(LongSet *set);
+
+
+void doubleset_view(DoubleSet *set);
+
+
+void strset_view(StrSet *set);
+
+
+/**
+ * @brief Get the size of one packed key.
+ * @param kind The element type of set.
+ * @return The number of bytes.
+**/
+unsigned long long __typed_set_key_size__(_TypedSetKind kind);
+
+
+/**
+ * @brief Hash an element (`-0.0` and `0.0` hash alike, every NaN hashes alike).
+ * @param kind The element type of set.
+ * @param key The pointer to the element.
+ * @return The 64-bit hash value.
+**/
+unsigned long long __typed_set_hash__(_TypedSetKind kind, const void *key);
+
+
+/**
+ * @brief Compare the key stored in a slot with an element.
+ * @param set The typed set.
+ * @param index The slot index.
+ * @param key The pointer to the element.
+ * @return `1` for equality, `0` otherwise.
+**/
+int __typed_set_equal__(_TypedSet *set, unsigned long long index, const void *key);
+
+
+/**
+ * @brief Allocate an empty typed set.
+ * @param kind The element type of set.
+ * @return The pointer of set (`NULL` for failure).
+**/
+_TypedSet *__typed_set_create__(_TypedSetKind kind);
+
+
+/**
+ * @brief Find the first free slot on the probe sequence of a hash value.
+ * @param set The typed set.
+ * @param hash The hash value.
+ * @return The slot index.
+**/
+unsigned long long __typed_set_find_free__(_TypedSet *set, unsigned long long hash);
+
+
+/**
+ * @brief Rebuild the slot arrays with a new capacity.
+ * @param set The typed set.
+ * @param capacity The new capacity (power of two, at least `HASH_GROUP_WIDTH`).
+ * @return `0` for success, `1` for failure.
+**/
+int __typed_set_rehash__(_TypedSet *set, unsigned long long capacity);
+
+
+/**
+ * @brief Find the slot of an element by probing 16 metadata bytes at a time.
+ * @param set The typed set.
+ * @param key The pointer to the element.
+ * @param hash The hash value of element.
+ * @return The slot index, `-1` for nonexistence.
+**/
+long long __typed_set_find__(_TypedSet *set, const void *key, unsigned long long hash);
+
+
+/**
+ * @brief Insert an element (strings are copied).
+ * @param set The typed set.
+ * @param key The pointer to the element.
+ * @param hash The hash value of element (computed by the typed wrapper with a constant kind).
+**/
+void __typed_set_add__(_TypedSet *set, const void *key, unsigned long long hash);
+
+
+/**
+ * @brief Remove an element.
+ * @param set The typed set.
+ * @param key The pointer to the element.
+ * @param hash The hash value of element.
+**/
+void __typed_set_remove__(_TypedSet *set, const void *key, unsigned long long hash);
+
+
+/**
+ * @brief Determine whether an element exists.
+ * @param set The typed set.
+ * @param key The pointer to the element.
+ * @param hash The hash value of element.
+ * @return `1` for existence, `0` for nonexistence.
+**/
+int __typed_set_contains__(_TypedSet *set, const void *key, unsigned long long hash);
+
+
+/**
+ * @brief Insert the elements of an array, hashed in batches of `TYPED_SET_BATCH` whose metadata groups are prefetched before the first probe.
+ * @param set The typed set.
+ * @param keys The packed array of elements.
+ * @param n The number of elements.
+**/
+void __typed_set_add_many__(_TypedSet *set, const void *keys, int n);
+
+
+/**
+ * @brief Determine whether each element of an array exists, hashed in batches of `TYPED_SET_BATCH`.
+ * @param set The typed set.
+ * @param keys The packed array of elements.
+ * @param n The number of elements.
+ * @param results Receive `1` or `0` for every element (`NULL` for counting only).
+ * @return The number of existing elements.
+**/
+int __typed_set_contains_many__(_TypedSet *set, const void *keys, int n, int *results);
+
+
+/**
+ * @brief Free the memory of a typed set.
+ * @param set The typed set.
+**/
+void __typed_set_destroy__(_TypedSet *set);
+
+
+/**
+ * @brief Print the view of a typed set.
+ * @param set The typed set.
+**/
+void __typed_set_view__(_TypedSet *set);
+
+
+#endif